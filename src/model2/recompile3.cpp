@@ -3,6 +3,7 @@
 #include "../query_generator/object_generator.hpp"
 #include "../query_generator/query_generator.hpp"
 #include "../query_generator/sanitizer_processor.hpp"
+#include "../query_generator/sanitizer_report.hpp"
 #include <filesystem>
 #include <fstream>
 #include <iostream>
@@ -79,6 +80,14 @@ int main(int argc, char *argv[]) {
     // Parse model name from command line
     std::string modelName = parseModelOption(argc, argv);
     std::cout << "Using LLM model: " << modelName << std::endl;
+
+    // --early-exit: stop the sanitizer checks of a file at the first failure
+    bool earlyExit = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--early-exit") {
+            earlyExit = true;
+        }
+    }
     
     // Ensure directories exist
     fs::create_directories("log");
@@ -193,7 +202,7 @@ int main(int argc, char *argv[]) {
         
         // Step 5.3: Run sanitizer checks
         std::cout << "Running sanitizer checks..." << std::endl;
-        SanitizerProcessor sanitizer;
+        SanitizerProcessor sanitizer(earlyExit);
         sanitizer.processSourceFile(objectPath);
         
         // Step 5.4: Check if sanitizer errors still exist
@@ -212,8 +221,9 @@ int main(int argc, char *argv[]) {
                 if (fs::exists(sanitizerLogPath)) {
                     std::string logContent = readFileContent(sanitizerLogPath);
                     if (!logContent.empty()) {
+                        // Parsed findings, one per signature, instead of raw logs
                         sanitizerContent += "=== " + sanitizer + " Sanitizer Log ===\n";
-                        sanitizerContent += logContent + "\n\n";
+                        sanitizerContent += SanitizerReport::compactOrRaw(logContent) + "\n\n";
                     }
                 }
                 
@@ -29,14 +29,11 @@ private:
   }
   
   static bool looksLikeCCode(const std::string& code) {
-    bool hasInclude = code.find("#include") != std::string::npos;
-    bool hasMain = code.find("int main") != std::string::npos;
-    
-    bool hasExplanationText = (code.find("This program demonstrates") != std::string::npos ||
-                              code.find("The output of this program") != std::string::npos ||
-                              code.find("demonstrates the use") != std::string::npos);
-    
-    return hasInclude && hasMain && !hasExplanationText;
+    return code.find("#include") != std::string::npos &&
+           code.find("int main") != std::string::npos &&
+           code.find("This program demonstrates") == std::string::npos &&
+           code.find("The output of this program") == std::string::npos &&
+           code.find("demonstrates the use") == std::string::npos;
   }
 
   static std::string cleanExtractedCode(const std::string& code) {
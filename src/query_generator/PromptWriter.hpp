@@ -32,7 +32,8 @@ public:
 
   std::pair<std::string, bool>
   savePrompt(const std::string &prompt, const std::string &sourceFilename,
-             const std::string &optLevel, const std::string &compilerOpt,
+             const std::string &optLevel, const std::string &compilerFlag,
+             const std::string &compilerOpt,
              const std::string &compilerParts, const std::string &plFeature) {
     std::filesystem::path sourcePath(sourceFilename);
     std::string promptFilename = sourcePath.stem().string() + ".prompt";
@@ -48,6 +49,7 @@ public:
 
       promptFile << "Original Source: " << sourceFilename << "\n";
       promptFile << "Optimization Level: " << optLevel << "\n";
+      promptFile << "Compiler Flag: " << compilerFlag << "\n";
       promptFile << "Compiler Optimization: " << compilerOpt << "\n";
       promptFile << "Compiler Parts: " << compilerParts << "\n";
       promptFile << "Programming Language Feature: " << plFeature << "\n";
@@ -0,0 +1,292 @@
+#ifndef ARTIFACT_CACHE_HPP
+#define ARTIFACT_CACHE_HPP
+
+#include "cache_utils.hpp"
+#include "process_runner.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/** ccache-style store for compile outcomes and sanitizer/differential
+ * verdicts. An entry is keyed by the hash of the preprocessed source,
+ * the full flag string, the compiler identity (--version plus binary
+ * hash) and an optional context string (e.g. the run environment of a
+ * sanitizer verdict). Each entry directory holds `meta`, `diagnostics`
+ * and, for successful builds, the produced `artifact`.
+ *
+ * Entries are evicted least-recently-used once the store exceeds its
+ * size bound; hits refresh an entry's mtime.
+ * */
+class ArtifactCache {
+public:
+  struct Entry {
+    bool success = false;
+    int exitCode = 0;
+    std::string verdict;
+    std::string diagnostics;
+  };
+
+private:
+  std::string cacheDir;
+  uintmax_t maxBytes;
+  std::mutex mutex;
+  unsigned long hits = 0;
+  unsigned long misses = 0;
+  // Running estimate of the store size; -1 until the first full scan.
+  intmax_t knownBytes = -1;
+
+  std::filesystem::path entryDir(const std::string &key) const {
+    return std::filesystem::path(cacheDir) / key.substr(0, 2) / key;
+  }
+
+  bool preprocess(const std::string &compiler, const std::string &flags,
+                  const std::string &sourcePath, std::string &output) {
+    std::vector<std::string> argv = ProcessRunner::splitArgs(flags);
+    argv.insert(argv.begin(), compiler);
+    argv.push_back("-E");
+    argv.push_back(sourcePath);
+    // The whole preprocessed text is the key; it must not be truncated.
+    ProcessRunner::Options options;
+    options.captureLimit = SIZE_MAX;
+    ProcessRunner::Result result = ProcessRunner::run(argv, options);
+    output = result.out;
+    return result.success();
+  }
+
+  std::filesystem::path statsPath() const {
+    return std::filesystem::path(cacheDir) / "stats";
+  }
+
+  // Merges this process' hit/miss counters into the persistent totals.
+  void flushStats() {
+    unsigned long totalHits = 0, totalMisses = 0;
+    std::ifstream in(statsPath());
+    in >> totalHits >> totalMisses;
+    in.close();
+
+    std::ofstream out(statsPath(), std::ios::trunc);
+    out << totalHits + hits << " " << totalMisses + misses << "\n";
+    hits = 0;
+    misses = 0;
+  }
+
+  void evictIfNeeded(uintmax_t addedBytes) {
+    if (knownBytes >= 0) {
+      knownBytes += addedBytes;
+      if (static_cast<uintmax_t>(knownBytes) <= maxBytes) {
+        return;
+      }
+    }
+
+    namespace fs = std::filesystem;
+    struct Item {
+      fs::path dir;
+      fs::file_time_type lastUse;
+      uintmax_t bytes;
+    };
+    std::vector<Item> items;
+    uintmax_t total = 0;
+    std::error_code ec;
+
+    for (const auto &shard : fs::directory_iterator(cacheDir, ec)) {
+      if (!shard.is_directory()) {
+        continue;
+      }
+      for (const auto &entry : fs::directory_iterator(shard.path(), ec)) {
+        Item item{entry.path(), fs::last_write_time(entry.path() / "meta", ec),
+                  0};
+        for (const auto &file : fs::directory_iterator(entry.path(), ec)) {
+          item.bytes += file.file_size(ec);
+        }
+        total += item.bytes;
+        items.push_back(item);
+      }
+    }
+    knownBytes = total;
+    if (total <= maxBytes) {
+      return;
+    }
+
+    std::sort(items.begin(), items.end(), [](const Item &a, const Item &b) {
+      return a.lastUse < b.lastUse;
+    });
+    // Evict down to 90% so we do not rescan on every store.
+    for (const auto &item : items) {
+      if (total <= maxBytes / 10 * 9) {
+        break;
+      }
+      fs::remove_all(item.dir, ec);
+      total -= item.bytes;
+    }
+    knownBytes = total;
+  }
+
+public:
+  explicit ArtifactCache(
+      const std::string &dir = CacheUtils::cacheRoot() + "/artifacts")
+      : cacheDir(dir) {
+    const char *maxMb = std::getenv("REFUZZER_CACHE_MAX_MB");
+    maxBytes = (maxMb ? std::strtoull(maxMb, nullptr, 10) : 2048) * 1024 * 1024;
+  }
+
+  ~ArtifactCache() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (hits + misses > 0 && std::filesystem::exists(cacheDir)) {
+      flushStats();
+    }
+  }
+
+  static bool enabled() { return std::getenv("REFUZZER_NO_CACHE") == nullptr; }
+
+  // Cache key for compiling sourcePath with compiler and flags. The
+  // context string distinguishes verdicts that depend on more than the
+  // build (run options, timeouts, ...). Empty when the source cannot be
+  // preprocessed, in which case the caller must not use the cache.
+  std::string key(const std::string &compiler, const std::string &flags,
+                  const std::string &sourcePath,
+                  const std::string &context = "") {
+    if (!enabled()) {
+      return "";
+    }
+    std::string preprocessed;
+    if (!preprocess(compiler, flags, sourcePath, preprocessed)) {
+      return "";
+    }
+    std::string keyData = CacheUtils::compilerIdentity(compiler) + "\n" +
+                          flags + "\n" + context + "\n" + preprocessed;
+    return CacheUtils::hashString(keyData) +
+           CacheUtils::toHex(CacheUtils::fnv1a(keyData, 0x9e3779b97f4a7c15ULL));
+  }
+
+  // Fills entry on a hit. For successful entries with an artifactPath,
+  // the cached artifact is copied there and is required for a hit.
+  bool lookup(const std::string &key, Entry &entry,
+              const std::string &artifactPath = "") {
+    if (key.empty()) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    std::filesystem::path dir = entryDir(key);
+    std::ifstream meta(dir / "meta");
+    if (!meta.is_open()) {
+      misses++;
+      return false;
+    }
+
+    std::string line;
+    while (std::getline(meta, line)) {
+      size_t eq = line.find('=');
+      if (eq == std::string::npos) {
+        continue;
+      }
+      std::string name = line.substr(0, eq);
+      std::string value = line.substr(eq + 1);
+      if (name == "success") {
+        entry.success = value == "1";
+      } else if (name == "exit") {
+        entry.exitCode = std::atoi(value.c_str());
+      } else if (name == "verdict") {
+        entry.verdict = value;
+      }
+    }
+    meta.close();
+    entry.diagnostics = CacheUtils::readFile((dir / "diagnostics").string());
+
+    std::error_code ec;
+    if (entry.success && !artifactPath.empty()) {
+      if (!std::filesystem::exists(dir / "artifact")) {
+        misses++;
+        return false;
+      }
+      std::filesystem::copy_file(
+          dir / "artifact", artifactPath,
+          std::filesystem::copy_options::overwrite_existing, ec);
+      if (ec) {
+        misses++;
+        return false;
+      }
+      std::filesystem::permissions(artifactPath,
+                                   std::filesystem::perms::owner_exec |
+                                       std::filesystem::perms::group_exec |
+                                       std::filesystem::perms::others_exec,
+                                   std::filesystem::perm_options::add, ec);
+    }
+
+    std::filesystem::last_write_time(
+        dir / "meta", std::filesystem::file_time_type::clock::now(), ec);
+    hits++;
+    return true;
+  }
+
+  void store(const std::string &key, const Entry &entry,
+             const std::string &artifactPath = "") {
+    if (key.empty()) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    std::filesystem::path dir = entryDir(key);
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+      std::cerr << "Error creating cache entry " << dir << ": "
+                << ec.message() << std::endl;
+      return;
+    }
+
+    if (!artifactPath.empty() && std::filesystem::exists(artifactPath)) {
+      std::filesystem::copy_file(
+          artifactPath, dir / "artifact",
+          std::filesystem::copy_options::overwrite_existing, ec);
+    }
+    std::ofstream(dir / "diagnostics", std::ios::trunc) << entry.diagnostics;
+    // meta is written last: its presence marks the entry complete.
+    std::ofstream meta(dir / "meta", std::ios::trunc);
+    meta << "success=" << (entry.success ? 1 : 0) << "\n";
+    meta << "exit=" << entry.exitCode << "\n";
+    meta << "verdict=" << entry.verdict << "\n";
+    meta.close();
+
+    uintmax_t addedBytes = 0;
+    for (const auto &file : std::filesystem::directory_iterator(dir, ec)) {
+      addedBytes += file.file_size(ec);
+    }
+    evictIfNeeded(addedBytes);
+  }
+
+  void printStats(std::ostream &os = std::cout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (std::filesystem::exists(cacheDir)) {
+      flushStats();
+    }
+    unsigned long totalHits = 0, totalMisses = 0;
+    std::ifstream in(statsPath());
+    in >> totalHits >> totalMisses;
+
+    uintmax_t bytes = 0;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(cacheDir, ec);
+         it != std::filesystem::recursive_directory_iterator(); ++it) {
+      if (it->is_regular_file(ec)) {
+        bytes += it->file_size(ec);
+      }
+    }
+
+    unsigned long total = totalHits + totalMisses;
+    os << "Artifact cache: " << cacheDir << std::endl;
+    os << "  Hits: " << totalHits << ", misses: " << totalMisses;
+    if (total > 0) {
+      os << " (" << (100.0 * totalHits / total) << "% hit rate)";
+    }
+    os << std::endl;
+    os << "  Size: " << bytes / 1024 << " KiB of " << maxBytes / 1024
+       << " KiB" << std::endl;
+  }
+};
+
+#endif // ARTIFACT_CACHE_HPP
@@ -0,0 +1,339 @@
+#ifndef BACKEND_FUZZER_HPP
+#define BACKEND_FUZZER_HPP
+
+#include "crash_buckets.hpp"
+#include "differential_tester.hpp"
+#include "ir_cache.hpp"
+#include "process_runner.hpp"
+#include "task_graph.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/** Fuzzes the LLVM backends with the corpus: every program's bitcode,
+ * optimized once with opt's default<O2> pipeline (IrCache), is compiled
+ * by many `llc` runs with sampled target options: a registered target,
+ * -O0 to -O3, a CPU and up to three features that target lists
+ * (-mcpu=help), a register allocator, and GlobalISel where the target
+ * has it. Crashes, assertion failures and fatal errors (e.g. "Cannot
+ * select") are bucketed with CrashBuckets, and hangs are llc runs still
+ * going at the compile deadline. No model is involved and the runs use
+ * every core, so each seed yields many backend runs.
+ *
+ * The bitcode is lowered for the host; llc replaces its triple and data
+ * layout, so other targets see host-ABI IR, which they must still
+ * compile. Features are only ever enabled, since disabling a base
+ * feature (say -sse2) makes many targets give up by design, and fatal
+ * errors that reject an option combination (optionRejections) are
+ * counted with the other rejected runs.
+ *
+ * Findings go to backend_bugs.log, each with its llc command, so
+ * `llc <options>` on the seed's optimized bitcode reproduces it.
+ * */
+class BackendFuzzer {
+private:
+  struct Target {
+    std::string name;
+    std::vector<std::string> cpus;
+    std::vector<std::string> features;
+  };
+
+  struct Seed {
+    std::string source;
+    std::string bitcode;
+    bool ready = false;
+    std::vector<std::vector<std::string>> options;
+  };
+
+  // Tried when registered; GPUs and microcontrollers are left out.
+  static inline const std::vector<std::string> defaultTargets = {
+      "x86-64", "x86", "aarch64", "arm", "riscv64", "ppc64le", "systemz", "mips64el", "sparcv9", "wasm32"};
+  static inline const std::set<std::string> globalIselTargets = {"x86-64", "x86", "aarch64", "arm", "riscv64",
+                                                                 "mips64el"};
+  static inline const std::vector<std::string> registerAllocators = {"default", "fast", "basic", "greedy",
+                                                                     "pbqp"};
+  static constexpr size_t maxFeatures = 3;
+  // Fatal errors with which a backend turns down the sampled options
+  // (a 32-bit CPU for a 64-bit target, a feature for another ABI)
+  // rather than failing on the program.
+  static inline const std::vector<std::string> optionRejections = {
+      "requested on a subtarget that doesn't support it",
+      "target requires an RV",
+      "is not implemented",
+      "is only supported for",
+      "-mattr=",
+  };
+
+  std::vector<Target> targets;
+  size_t perSeed;
+  size_t jobs;
+  std::mt19937 rng;
+  std::string workDir;
+  double compileTimeout = DifferentialTester::defaultCompileTimeout();
+  IrCache irCache;
+  CrashBuckets crashBuckets;
+  std::mutex logMutex;
+
+  std::atomic<size_t> seeds{0};
+  std::atomic<size_t> runs{0};
+  std::atomic<size_t> rejected{0};
+  std::atomic<size_t> crashes{0};
+  std::atomic<size_t> hangs{0};
+  std::map<std::string, size_t> crashesPerTarget;
+
+  static std::vector<std::string> registeredTargets() {
+    std::vector<std::string> names;
+    std::istringstream lines(ProcessRunner::run({"llc", "--version"}).out);
+    std::string line;
+    bool listing = false;
+    while (std::getline(lines, line)) {
+      if (line.find("Registered Targets:") != std::string::npos) {
+        listing = true;
+      } else if (listing) {
+        std::istringstream fields(line);
+        std::string name;
+        if (fields >> name) {
+          names.push_back(name);
+        }
+      }
+    }
+    return names;
+  }
+
+  // The CPUs and features `llc -march=<target> -mcpu=help` lists.
+  static Target describe(const std::string &name) {
+    Target target;
+    target.name = name;
+    ProcessRunner::Options options;
+    options.mergeStderr = true;
+    std::istringstream lines(ProcessRunner::run({"llc", "-march=" + name, "-mcpu=help"}, options).out);
+    std::string line;
+    std::vector<std::string> *section = nullptr;
+    while (std::getline(lines, line)) {
+      if (line.rfind("Available CPUs", 0) == 0) {
+        section = &target.cpus;
+      } else if (line.rfind("Available features", 0) == 0) {
+        section = &target.features;
+      } else if (section && line.rfind("  ", 0) == 0 && line.find(" - ") != std::string::npos) {
+        std::istringstream fields(line);
+        std::string entry;
+        fields >> entry;
+        section->push_back(entry);
+      } else if (section && !line.empty()) {
+        section = nullptr;
+      }
+    }
+    return target;
+  }
+
+  template <typename T> const T &pick(const std::vector<T> &values) {
+    return values[std::uniform_int_distribution<size_t>(0, values.size() - 1)(rng)];
+  }
+
+  std::vector<std::string> randomOptions() {
+    const Target &target = pick(targets);
+    std::vector<std::string> options = {"-march=" + target.name, "-O" + std::to_string(rng() % 4)};
+    if (!target.cpus.empty()) {
+      options.push_back("-mcpu=" + pick(target.cpus));
+    }
+    if (!target.features.empty()) {
+      std::string features;
+      for (size_t i = rng() % (maxFeatures + 1); i > 0; i--) {
+        features += (features.empty() ? "+" : ",+") + pick(target.features);
+      }
+      if (!features.empty()) {
+        options.push_back("-mattr=" + features);
+      }
+    }
+    // -O0 only takes the fast allocator.
+    const std::string &allocator = pick(registerAllocators);
+    if (allocator != "default" && (options[1] != "-O0" || allocator == "fast")) {
+      options.push_back("-regalloc=" + allocator);
+    }
+    // Fall back to SelectionDAG with a warning where GlobalISel is
+    // incomplete; only its crashes count.
+    if (globalIselTargets.count(target.name) && rng() % 3 == 0) {
+      options.insert(options.end(), {"-global-isel", "-global-isel-abort=2"});
+    }
+    return options;
+  }
+
+  static bool isOptionRejection(const CrashBuckets::Signature &signature) {
+    return signature.kind == "fatal-error" &&
+           std::any_of(optionRejections.begin(), optionRejections.end(), [&](const std::string &text) {
+             return signature.headline.find(text) != std::string::npos;
+           });
+  }
+
+  static std::string join(const std::vector<std::string> &options) {
+    std::string text;
+    for (const auto &option : options) {
+      text += " " + option;
+    }
+    return text;
+  }
+
+  void prepare(Seed &seed) {
+    seed.ready = irCache.optimized(seed.source, "O2", seed.bitcode);
+    if (seed.ready) {
+      seeds++;
+    }
+  }
+
+  void tryOptions(const Seed &seed, size_t index) {
+    if (!seed.ready) {
+      return;
+    }
+    runs++;
+    const std::vector<std::string> &options = seed.options[index];
+    std::vector<std::string> argv = {"llc"};
+    argv.insert(argv.end(), options.begin(), options.end());
+    argv.insert(argv.end(), {"-filetype=obj", seed.bitcode, "-o", "/dev/null"});
+    ProcessRunner::Options runOptions;
+    runOptions.mergeStderr = true;
+    runOptions.timeoutSeconds = compileTimeout;
+    ProcessRunner::Result result = ProcessRunner::run(argv, runOptions);
+    std::string command = "llc" + join(options);
+    if (result.timedOut) {
+      logFinding(seed, options[0], "COMPILER HANG DETECTED", command, CrashBuckets::hang(command, seed.source),
+                 "Deadline: " + std::to_string(compileTimeout) + " s");
+    } else if (!result.success() && DifferentialTester::isCompilerCrash(result.out, result.exitCode)) {
+      CrashBuckets::Signature signature = CrashBuckets::extract(result.out, result.exitCode, command);
+      if (isOptionRejection(signature)) {
+        rejected++;
+      } else {
+        logFinding(seed, options[0], "COMPILER CRASH DETECTED", command, signature, result.out);
+      }
+    } else if (!result.success()) {
+      rejected++;
+    }
+  }
+
+  void logFinding(const Seed &seed, const std::string &march, const std::string &header,
+                  const std::string &command, const CrashBuckets::Signature &signature,
+                  const std::string &output) {
+    (signature.kind == "hang" ? hangs : crashes)++;
+    bool fresh = crashBuckets.record(signature, seed.source, command);
+    std::lock_guard<std::mutex> lock(logMutex);
+    crashesPerTarget[march.substr(march.find('=') + 1)]++;
+    if (!fresh) {
+      return;
+    }
+    std::cout << header << " (" << signature.describe() << ") for " << seed.source << std::endl;
+    std::ofstream log("backend_bugs.log", std::ios::app);
+    log << "=== " << header << " ===" << std::endl;
+    log << "File: " << seed.source << std::endl;
+    log << "Bitcode: opt -passes=default<O2> over " << IrCache::flags << std::endl;
+    log << "Compiler: " << command << std::endl;
+    log << "Bucket: " << signature.key() << std::endl;
+    log << "Signature: " << signature.describe() << std::endl;
+    log << "Error output:" << std::endl << output << std::endl;
+    log << "===============================" << std::endl << std::endl;
+  }
+
+public:
+  // targetNames: llc -march names to sample from; empty for the
+  // registered ones among defaultTargets.
+  BackendFuzzer(const std::vector<std::string> &targetNames = {}, size_t runsPerSeed = 100, size_t workers = 0,
+                uint32_t seed = 1, const std::string &work = "../test/backend")
+      : perSeed(runsPerSeed), jobs(workers ? workers : TaskGraph::availableCpus()), rng(seed), workDir(work) {
+    std::vector<std::string> registered = registeredTargets();
+    for (const auto &name : targetNames.empty() ? defaultTargets : targetNames) {
+      if (std::find(registered.begin(), registered.end(), name) == registered.end()) {
+        if (!targetNames.empty()) {
+          std::cerr << "llc has no target " << name << "; skipping it" << std::endl;
+        }
+        continue;
+      }
+      targets.push_back(describe(name));
+    }
+  }
+
+  // Every C and C++ source in dir.
+  bool processDirectory(const std::string &dir) {
+    if (targets.empty()) {
+      std::cerr << "No llc targets to fuzz (is llc in PATH?)" << std::endl;
+      return false;
+    }
+    std::vector<std::string> sources;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+      std::string extension = entry.path().extension().string();
+      if (entry.is_regular_file() && (extension == ".c" || extension == ".cpp")) {
+        sources.push_back(entry.path().string());
+      }
+    }
+    if (ec) {
+      std::cerr << "Cannot read " << dir << ": " << ec.message() << std::endl;
+      return false;
+    }
+    std::sort(sources.begin(), sources.end());
+    std::filesystem::create_directories(workDir, ec);
+    std::ofstream("backend_bugs.log", std::ios::trunc) << "=== Backend Fuzzing Bug Log ===" << std::endl
+                                                       << std::endl;
+    std::cout << "Targets:";
+    for (const auto &target : targets) {
+      std::cout << " " << target.name << " (" << target.cpus.size() << " CPUs, " << target.features.size()
+                << " features)";
+    }
+    std::cout << std::endl;
+
+    // Options are drawn up front, so a seed reproduces a campaign.
+    std::vector<std::unique_ptr<Seed>> work;
+    for (const auto &source : sources) {
+      auto seed = std::make_unique<Seed>();
+      seed->source = source;
+      seed->bitcode = workDir + "/" + std::filesystem::path(source).stem().string() + ".O2.bc";
+      for (size_t i = 0; i < perSeed; i++) {
+        seed->options.push_back(randomOptions());
+      }
+      work.push_back(std::move(seed));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    TaskGraph graph;
+    size_t slots = graph.addResource(jobs);
+    for (auto &entry : work) {
+      Seed *seed = entry.get();
+      TaskGraph::TaskId prepared = graph.addTask(slots, [this, seed] { prepare(*seed); });
+      std::vector<TaskGraph::TaskId> tried;
+      for (size_t i = 0; i < seed->options.size(); i++) {
+        tried.push_back(graph.addTask(slots, [this, seed, i] { tryOptions(*seed, i); }, {prepared}));
+      }
+      graph.addTask(slots, [seed] {
+        std::error_code ec;
+        std::filesystem::remove(seed->bitcode, ec);
+      }, tried);
+    }
+    graph.run(jobs);
+    crashBuckets.save();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::filesystem::remove(workDir, ec);  // only when empty
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Backend fuzzing: " << seeds << " of " << sources.size() << " programs, " << runs
+              << " llc runs in " << seconds << "s (" << (seconds > 0 ? runs / seconds : 0) << " runs/second on "
+              << jobs << " workers)" << std::endl;
+    std::cout << "  rejected by llc: " << rejected << ", crashes: " << crashes << " ("
+              << crashBuckets.getNewBuckets() << " new buckets), hangs: " << hangs << " (backend_bugs.log)"
+              << std::endl;
+    for (const auto &[target, count] : crashesPerTarget) {
+      std::cout << "    " << target << ": " << count << std::endl;
+    }
+    return true;
+  }
+};
+
+#endif // BACKEND_FUZZER_HPP
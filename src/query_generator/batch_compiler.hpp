@@ -0,0 +1,197 @@
+#ifndef BATCH_COMPILER_HPP
+#define BATCH_COMPILER_HPP
+
+#include "pch_cache.hpp"
+#include "process_runner.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/** Compiles many small programs per driver invocation
+ * (`clang++ -c a.cpp b.cpp ...`) to amortize process and driver startup.
+ * Sources are grouped by their PCH prefix header so that every member of
+ * a batch really shares the same flags. When a batch fails it is split
+ * in half until each failure is attributed to a single file, so every
+ * result carries only its own diagnostics. A batch that times out is not
+ * split but compiled file by file, so a hanging file costs its own
+ * deadline once more rather than once per halving.
+ * */
+class BatchCompiler {
+public:
+  struct Result {
+    std::string source;
+    bool success = false;
+    int exitCode = 0;
+    std::string diagnostics;
+    std::string objectPath;
+    // The compile of this source alone missed its deadline.
+    bool timedOut = false;
+  };
+
+private:
+  size_t batchSize;
+  PchCache pchCache;
+  bool usePch = true;
+  unsigned long invocations = 0;
+  // Per source in a batch; 0 means none.
+  double timeoutSeconds = 0;
+
+  // Lines of a batch's output that mention the given source.
+  static std::string diagnosticsFor(const std::string &output,
+                                    const std::string &source) {
+    std::string result;
+    size_t start = 0;
+    while (start < output.size()) {
+      size_t end = output.find('\n', start);
+      if (end == std::string::npos) {
+        end = output.size();
+      }
+      std::string line = output.substr(start, end - start);
+      if (line.find(source) != std::string::npos) {
+        result += line + "\n";
+      }
+      start = end + 1;
+    }
+    return result;
+  }
+
+  std::string objectPathFor(const std::string &source,
+                            const std::string &outDir, bool syntaxOnly) {
+    if (syntaxOnly) {
+      return "";
+    }
+    return (std::filesystem::path(outDir) /
+            (std::filesystem::path(source).stem().string() + ".o"))
+        .string();
+  }
+
+  void compileBatch(const std::string &compiler, const std::string &flags,
+                    const std::string &pchFlags,
+                    const std::vector<std::string> &sources,
+                    const std::string &outDir, bool syntaxOnly,
+                    std::vector<Result> &results) {
+    std::vector<std::string> argv =
+        ProcessRunner::splitArgs(flags + (syntaxOnly ? " " : " -c ") + pchFlags);
+    argv.insert(argv.begin(), compiler);
+    argv.insert(argv.end(), sources.begin(), sources.end());
+
+    // -c writes <stem>.o into the working directory, hence the cwd.
+    ProcessRunner::Options options;
+    options.cwd = outDir;
+    options.mergeStderr = true;
+    // A hanging member times the batch out; the members are then
+    // compiled one by one with the per-source deadline.
+    options.timeoutSeconds = timeoutSeconds * sources.size();
+    invocations++;
+    ProcessRunner::Result run = ProcessRunner::run(argv, options);
+    std::string output = run.out;
+    int exitCode = run.exitCode;
+    bool success = run.success();
+
+    if (!success && !pchFlags.empty() && PchCache::isPchFailure(output)) {
+      compileBatch(compiler, flags, "", sources, outDir, syntaxOnly, results);
+      return;
+    }
+
+    if (run.timedOut && sources.size() > 1) {
+      for (const auto &source : sources) {
+        compileBatch(compiler, flags, pchFlags, {source}, outDir, syntaxOnly, results);
+      }
+      return;
+    }
+
+    if (success || sources.size() == 1) {
+      for (const auto &source : sources) {
+        Result result;
+        result.source = source;
+        result.success = success;
+        result.exitCode = exitCode;
+        result.timedOut = run.timedOut;
+        result.diagnostics =
+            sources.size() == 1 ? output : diagnosticsFor(output, source);
+        result.objectPath =
+            success ? objectPathFor(source, outDir, syntaxOnly) : "";
+        results.push_back(result);
+      }
+      return;
+    }
+
+    size_t half = sources.size() / 2;
+    std::vector<std::string> left(sources.begin(), sources.begin() + half);
+    std::vector<std::string> right(sources.begin() + half, sources.end());
+    compileBatch(compiler, flags, pchFlags, left, outDir, syntaxOnly, results);
+    compileBatch(compiler, flags, pchFlags, right, outDir, syntaxOnly,
+                 results);
+  }
+
+public:
+  explicit BatchCompiler(size_t size = 8) : batchSize(std::max<size_t>(1, size)) {}
+
+  void setBatchSize(size_t size) { batchSize = std::max<size_t>(1, size); }
+  size_t getBatchSize() const { return batchSize; }
+  void setUsePch(bool enabled) { usePch = enabled; }
+  void setTimeout(double seconds) { timeoutSeconds = seconds; }
+  unsigned long getInvocationCount() const { return invocations; }
+
+  // Compiles every source with `compiler flags -c` into outDir (or only
+  // checks them when flags contain -fsyntax-only). Results are returned
+  // in the order of the input.
+  std::vector<Result> compile(const std::string &compiler,
+                              const std::string &flags,
+                              const std::vector<std::string> &sources,
+                              const std::string &outDir) {
+    bool syntaxOnly = flags.find("-fsyntax-only") != std::string::npos;
+    std::filesystem::create_directories(outDir);
+    std::string absOutDir = std::filesystem::absolute(outDir).string();
+
+    // Group by prefix header: an -include applies to every input.
+    std::map<std::string, std::vector<std::string>> groups;
+    for (const auto &source : sources) {
+      std::string absSource = std::filesystem::absolute(source).string();
+      std::string pchFlags =
+          usePch ? pchCache.includeFlags(compiler, flags, absSource) : "";
+      groups[pchFlags].push_back(absSource);
+    }
+
+    std::vector<Result> results;
+    for (const auto &[pchFlags, members] : groups) {
+      std::vector<std::string> batch;
+      std::set<std::string> stems;
+      for (const auto &source : members) {
+        // Two inputs with the same stem would overwrite each other's .o.
+        std::string stem = std::filesystem::path(source).stem().string();
+        if (batch.size() >= batchSize || stems.count(stem)) {
+          compileBatch(compiler, flags, pchFlags, batch, absOutDir,
+                       syntaxOnly, results);
+          batch.clear();
+          stems.clear();
+        }
+        batch.push_back(source);
+        stems.insert(stem);
+      }
+      if (!batch.empty()) {
+        compileBatch(compiler, flags, pchFlags, batch, absOutDir, syntaxOnly,
+                     results);
+      }
+    }
+
+    std::map<std::string, size_t> order;
+    for (size_t i = 0; i < sources.size(); i++) {
+      order[std::filesystem::absolute(sources[i]).string()] = i;
+    }
+    std::sort(results.begin(), results.end(),
+              [&order](const Result &a, const Result &b) {
+                return order[a.source] < order[b.source];
+              });
+    for (auto &result : results) {
+      result.source = sources[order[result.source]];
+    }
+    return results;
+  }
+};
+
+#endif // BATCH_COMPILER_HPP
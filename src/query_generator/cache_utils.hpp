@@ -0,0 +1,137 @@
+#ifndef CACHE_UTILS_HPP
+#define CACHE_UTILS_HPP
+
+#include "process_runner.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+/** Small helpers shared by the on-disk caches (PCH, artifacts, ...).
+ * Hashes must be stable across runs, so we use FNV-1a instead of
+ * std::hash.
+ * */
+class CacheUtils {
+public:
+  static uint64_t fnv1a(const std::string &data,
+                        uint64_t seed = 1469598103934665603ULL) {
+    uint64_t hash = seed;
+    for (unsigned char c : data) {
+      hash ^= c;
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  static std::string toHex(uint64_t value) {
+    std::stringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << value;
+    return ss.str();
+  }
+
+  static std::string hashString(const std::string &data) {
+    return toHex(fnv1a(data));
+  }
+
+  static std::string readFile(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+      return "";
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+  }
+
+  // Root of all persistent caches. REFUZZER_CACHE_DIR wins, then
+  // ~/.cache/refuzzer, then a directory next to the default test dir.
+  static std::string cacheRoot() {
+    if (const char *dir = std::getenv("REFUZZER_CACHE_DIR")) {
+      if (*dir) {
+        return dir;
+      }
+    }
+    if (const char *home = std::getenv("HOME")) {
+      return std::string(home) + "/.cache/refuzzer";
+    }
+    return "../cache";
+  }
+
+  // Output of `<compiler> --version`, memoized per process so every
+  // compile does not pay for an extra driver spawn.
+  static std::string compilerVersion(const std::string &compiler) {
+    static std::mutex mutex;
+    static std::map<std::string, std::string> versions;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = versions.find(compiler);
+    if (it != versions.end()) {
+      return it->second;
+    }
+
+    std::string result = ProcessRunner::run({compiler, "--version"}).out;
+    versions[compiler] = result;
+    return result;
+  }
+
+  // Absolute path of an executable, searched in PATH like the shell does.
+  static std::string resolveExecutable(const std::string &name) {
+    if (name.find('/') != std::string::npos) {
+      return name;
+    }
+    const char *path = std::getenv("PATH");
+    std::stringstream dirs(path ? path : "/usr/bin:/bin");
+    std::string dir;
+    while (std::getline(dirs, dir, ':')) {
+      std::filesystem::path candidate = std::filesystem::path(dir) / name;
+      if (access(candidate.c_str(), X_OK) == 0) {
+        return candidate.string();
+      }
+    }
+    return "";
+  }
+
+  // `--version` output plus a hash of the compiler binary, so that a
+  // rebuilt compiler with an unchanged version string still counts as a
+  // different toolchain. The binary hash is memoized by size and mtime.
+  static std::string compilerIdentity(const std::string &compiler) {
+    static std::mutex mutex;
+    static std::map<std::string, std::string> binaryHashes;
+
+    std::string identity = compilerVersion(compiler);
+    std::string binary = resolveExecutable(compiler);
+    std::error_code ec;
+    std::filesystem::path canonical =
+        std::filesystem::canonical(binary, ec);
+    if (binary.empty() || ec) {
+      return identity;
+    }
+
+    auto size = std::filesystem::file_size(canonical, ec);
+    auto mtime = std::filesystem::last_write_time(canonical, ec)
+                     .time_since_epoch()
+                     .count();
+    std::string stamp = canonical.string() + ":" + std::to_string(size) +
+                        ":" + std::to_string(mtime);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = binaryHashes.find(stamp);
+    if (it == binaryHashes.end()) {
+      it = binaryHashes
+               .emplace(stamp, hashString(readFile(canonical.string())))
+               .first;
+    }
+    return identity + "binary: " + it->second + "\n";
+  }
+
+  static bool isClang(const std::string &compiler) {
+    return compilerVersion(compiler).find("clang") != std::string::npos;
+  }
+};
+
+#endif // CACHE_UTILS_HPP
@@ -0,0 +1,609 @@
+#ifndef CHILD_SUPERVISOR_HPP
+#define CHILD_SUPERVISOR_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <pthread.h>
+#include <spawn.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "sandbox.hpp"
+
+extern char **environ;
+
+/** Runs many child processes at once from a single thread. Each child is
+ * watched through its pidfd, its stdout/stderr pipes and an optional
+ * timerfd, all registered with one epoll instance, so exits, output and
+ * deadlines are handled as they happen instead of by sleep polling.
+ *
+ * Children with a deadline get their own process group; a wall deadline
+ * kills the whole group, a CPU deadline is enforced by the kernel through
+ * RLIMIT_CPU. On kernels without pidfd_open, exits are picked up with
+ * waitpid(WNOHANG) every few milliseconds instead.
+ *
+ * Children with an enabled Sandbox::Policy are started with fork and
+ * confined before exec; all others use posix_spawn.
+ * */
+class ChildSupervisor {
+public:
+  struct Options {
+    // Working directory of the child; empty keeps ours.
+    std::string cwd;
+    // KEY=VALUE entries added to (or replacing in) the inherited
+    // environment.
+    std::vector<std::string> env;
+    // Written to the child's stdin; otherwise stdin is /dev/null.
+    std::string input;
+    // Wall-clock limit in seconds; 0 means none. On expiry the child's
+    // whole process group is killed.
+    double timeoutSeconds = 0;
+    // CPU-time limit in seconds (rounded up); 0 means none.
+    double cpuSeconds = 0;
+    // Per-stream capture bound in bytes.
+    size_t captureLimit = 1 << 20;
+    // Send stderr into the stdout capture, preserving interleaving.
+    bool mergeStderr = false;
+    // Limits, namespaces and system call filter for untrusted programs.
+    Sandbox::Policy sandbox;
+  };
+
+  struct Result {
+    bool started = false;
+    int exitCode = -1;
+    int signal = 0;
+    bool timedOut = false;
+    bool cpuLimitHit = false;
+    double wallSeconds = 0;
+    struct rusage usage {};
+    std::string out;
+    std::string err;
+    // FNV-1a (as CacheUtils::fnv1a) of all of stdout, including what
+    // captureLimit left out of `out`.
+    uint64_t outHash = 0;
+
+    bool success() const {
+      return started && !timedOut && signal == 0 && exitCode == 0;
+    }
+    // stdout followed by stderr, for callers that used to read `2>&1`.
+    std::string output() const { return out + err; }
+  };
+
+  using Callback = std::function<void(Result &)>;
+
+private:
+  // Keeps the first and the last limit/2 bytes of a stream, and hashes
+  // all of it.
+  class CappedBuffer {
+    size_t half;
+    std::string head;
+    std::string tail;
+    size_t omitted = 0;
+    uint64_t streamHash = 1469598103934665603ULL;
+
+  public:
+    explicit CappedBuffer(size_t limit)
+        : half(std::max<size_t>(1, limit / 2)) {}
+
+    uint64_t hash() const { return streamHash; }
+
+    void append(const char *data, size_t size) {
+      for (size_t i = 0; i < size; i++) {
+        streamHash ^= static_cast<unsigned char>(data[i]);
+        streamHash *= 1099511628211ULL;
+      }
+      if (head.size() < half) {
+        size_t take = std::min(size, half - head.size());
+        head.append(data, take);
+        data += take;
+        size -= take;
+      }
+      tail.append(data, size);
+      if (tail.size() > 2 * half) {
+        size_t drop = tail.size() - half;
+        omitted += drop;
+        tail.erase(0, drop);
+      }
+    }
+
+    std::string str() const {
+      if (omitted == 0) {
+        return head + tail;
+      }
+      if (tail.size() > half) {
+        return head + "\n[... " +
+               std::to_string(omitted + tail.size() - half) +
+               " bytes omitted ...]\n" + tail.substr(tail.size() - half);
+      }
+      return head + "\n[... " + std::to_string(omitted) +
+             " bytes omitted ...]\n" + tail;
+    }
+  };
+
+  enum Source : uint64_t { kOut, kErr, kIn, kPid, kTimer };
+
+  struct Child {
+    pid_t pid = -1;
+    bool ownGroup = false;
+    int outFd = -1, errFd = -1, inFd = -1, pidFd = -1, timerFd = -1;
+    std::string input;
+    size_t inputOffset = 0;
+    bool exited = false;
+    int status = 0;
+    double cpuSeconds = 0;
+    bool hasDeadline = false;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point deadline;
+    CappedBuffer out, err;
+    Result result;
+    Callback done;
+
+    explicit Child(size_t limit) : out(limit), err(limit) {}
+  };
+
+  int epollFd;
+  uint64_t nextId = 1;
+  std::map<uint64_t, Child> children;
+  std::vector<char> buffer = std::vector<char>(64 * 1024);
+
+  static void closeAll(std::initializer_list<int> fds) {
+    for (int fd : fds) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  static std::vector<std::string>
+  mergedEnvironment(const std::vector<std::string> &overrides) {
+    std::vector<std::string> env;
+    for (char **entry = environ; entry && *entry; entry++) {
+      std::string value(*entry);
+      std::string name = value.substr(0, value.find('='));
+      bool overridden = false;
+      for (const auto &override : overrides) {
+        overridden =
+            overridden || override.substr(0, override.find('=')) == name;
+      }
+      if (!overridden) {
+        env.push_back(value);
+      }
+    }
+    env.insert(env.end(), overrides.begin(), overrides.end());
+    return env;
+  }
+
+  // write() with SIGPIPE blocked for this thread, so a child that closes
+  // its stdin early yields EPIPE instead of killing us.
+  static ssize_t writeInput(int fd, const std::string &input, size_t offset) {
+    sigset_t pipeSignal, previous;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, &previous);
+    ssize_t bytes = write(fd, input.data() + offset, input.size() - offset);
+    if (bytes < 0 && errno == EPIPE) {
+      struct timespec zero = {0, 0};
+      sigtimedwait(&pipeSignal, nullptr, &zero);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+    return bytes;
+  }
+
+  // The posix_spawn file actions and attributes below, done by hand in a
+  // forked child so the sandbox can be entered before exec.
+  static pid_t forkSandboxed(const Sandbox::Launch &launch, const Options &options,
+                             int inFd, int outFd, int errFd, bool ownGroup) {
+    pid_t pid = fork();
+    if (pid != 0) {
+      if (pid > 0 && ownGroup) {
+        // Also set from the parent, so a kill(-pid) right away works.
+        setpgid(pid, pid);
+      }
+      return pid;
+    }
+    if (ownGroup) {
+      setpgid(0, 0);
+    }
+    int in = inFd >= 0 ? inFd : open("/dev/null", O_RDONLY);
+    if (in < 0 || dup2(in, STDIN_FILENO) < 0 || dup2(outFd, STDOUT_FILENO) < 0 ||
+        dup2(errFd, STDERR_FILENO) < 0) {
+      _exit(127);
+    }
+    if (!options.cwd.empty() && chdir(options.cwd.c_str()) != 0) {
+      _exit(127);
+    }
+    struct sigaction action = {};
+    action.sa_handler = SIG_DFL;
+    sigaction(SIGPIPE, &action, nullptr);
+    sigset_t noSignals;
+    sigemptyset(&noSignals);
+    sigprocmask(SIG_SETMASK, &noSignals, nullptr);
+    launch.enter();
+  }
+
+  void watch(int fd, uint64_t id, Source source, uint32_t events) {
+    struct epoll_event event = {};
+    event.events = events;
+    event.data.u64 = (id << 3) | source;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+  }
+
+  void unwatch(int &fd) {
+    if (fd >= 0) {
+      epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+      close(fd);
+      fd = -1;
+    }
+  }
+
+  void killChild(Child &child) {
+    if (child.ownGroup) {
+      // The group id cannot be reused while grandchildren still hold it.
+      kill(-child.pid, SIGKILL);
+    }
+    if (!child.exited) {
+      kill(child.pid, SIGKILL);
+    }
+  }
+
+  void reap(Child &child, int flags) {
+    pid_t reaped;
+    while ((reaped = wait4(child.pid, &child.status, flags,
+                           &child.result.usage)) < 0 &&
+           errno == EINTR) {
+    }
+    if (reaped == child.pid) {
+      child.exited = true;
+    }
+  }
+
+  void drain(int &fd, CappedBuffer &target) {
+    ssize_t bytes = read(fd, buffer.data(), buffer.size());
+    if (bytes > 0) {
+      target.append(buffer.data(), bytes);
+    } else if (bytes == 0 || (errno != EINTR && errno != EAGAIN)) {
+      unwatch(fd);
+    }
+  }
+
+  void handle(uint64_t id, Source source) {
+    auto it = children.find(id);
+    if (it == children.end()) {
+      return;
+    }
+    Child &child = it->second;
+    switch (source) {
+    case kOut:
+      drain(child.outFd, child.out);
+      break;
+    case kErr:
+      drain(child.errFd, child.err);
+      break;
+    case kIn: {
+      ssize_t bytes = writeInput(child.inFd, child.input, child.inputOffset);
+      if (bytes > 0) {
+        child.inputOffset += bytes;
+      }
+      if ((bytes < 0 && errno != EAGAIN && errno != EINTR) ||
+          child.inputOffset >= child.input.size()) {
+        unwatch(child.inFd);
+      }
+      break;
+    }
+    case kPid:
+      reap(child, WNOHANG);
+      if (child.exited) {
+        unwatch(child.pidFd);
+      }
+      break;
+    case kTimer:
+      // The exit may be in the same batch of events, or a grandchild may
+      // hold the pipes of a child that has exited: only a child still
+      // running has timed out. The group is killed either way, so the
+      // pipes get their EOF.
+      if (!child.exited) {
+        reap(child, WNOHANG);
+      }
+      child.result.timedOut = !child.exited;
+      killChild(child);
+      unwatch(child.timerFd);
+      break;
+    }
+  }
+
+  // A child is done once it has exited and both pipes are at EOF.
+  void finishReady() {
+    std::vector<uint64_t> ready;
+    auto now = std::chrono::steady_clock::now();
+    for (auto &[id, child] : children) {
+      if (!child.exited && child.pidFd < 0) {
+        reap(child, WNOHANG);
+      }
+      if (child.hasDeadline && child.timerFd < 0 && !child.result.timedOut &&
+          now >= child.deadline) {
+        if (!child.exited) {
+          reap(child, WNOHANG);
+        }
+        child.result.timedOut = !child.exited;
+        killChild(child);
+        child.hasDeadline = false;
+      }
+      if (child.exited && child.outFd < 0 && child.errFd < 0) {
+        ready.push_back(id);
+      }
+    }
+    for (uint64_t id : ready) {
+      auto it = children.find(id);
+      Child &child = it->second;
+      unwatch(child.inFd);
+      unwatch(child.timerFd);
+      unwatch(child.pidFd);
+
+      Result result = std::move(child.result);
+      result.wallSeconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - child.start)
+                               .count();
+      if (WIFEXITED(child.status)) {
+        result.exitCode = WEXITSTATUS(child.status);
+      } else if (WIFSIGNALED(child.status)) {
+        result.signal = WTERMSIG(child.status);
+        result.exitCode = 128 + result.signal;
+      }
+      double cpuUsed = result.usage.ru_utime.tv_sec +
+                       result.usage.ru_stime.tv_sec +
+                       (result.usage.ru_utime.tv_usec +
+                        result.usage.ru_stime.tv_usec) / 1e6;
+      result.cpuLimitHit =
+          child.cpuSeconds > 0 &&
+          (result.signal == SIGXCPU ||
+           (result.signal == SIGKILL && !result.timedOut &&
+            cpuUsed >= child.cpuSeconds));
+      result.out = child.out.str();
+      result.outHash = child.out.hash();
+      result.err = child.err.str();
+      Callback done = std::move(child.done);
+      children.erase(it);
+      // Last, so the callback may start new children.
+      if (done) {
+        done(result);
+      }
+    }
+  }
+
+  // Children whose exit or deadline we cannot get an event for.
+  bool needsPolling() const {
+    for (const auto &entry : children) {
+      const Child &child = entry.second;
+      if ((!child.exited && child.pidFd < 0) ||
+          (child.hasDeadline && child.timerFd < 0 && !child.result.timedOut)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+public:
+  ChildSupervisor() : epollFd(epoll_create1(EPOLL_CLOEXEC)) {}
+
+  ChildSupervisor(const ChildSupervisor &) = delete;
+  ChildSupervisor &operator=(const ChildSupervisor &) = delete;
+
+  // Children still running when the supervisor goes away are killed.
+  ~ChildSupervisor() {
+    for (auto &entry : children) {
+      Child &child = entry.second;
+      if (!child.exited) {
+        killChild(child);
+        reap(child, 0);
+      }
+      closeAll({child.outFd, child.errFd, child.inFd, child.pidFd,
+                child.timerFd});
+    }
+    closeAll({epollFd});
+  }
+
+  size_t running() const { return children.size(); }
+
+  // Starts argv and calls done with its result once it has exited and its
+  // output is drained. When the spawn fails, done is called right away
+  // with started == false and false is returned.
+  bool spawn(const std::vector<std::string> &argv, const Options &options,
+             Callback done) {
+    Result failed;
+    if (argv.empty() || epollFd < 0) {
+      failed.err = argv.empty() ? "empty command\n" : "epoll unavailable\n";
+      if (done) {
+        done(failed);
+      }
+      return false;
+    }
+
+    int outPipe[2] = {-1, -1};
+    int errPipe[2] = {-1, -1};
+    int inPipe[2] = {-1, -1};
+    if (pipe2(outPipe, O_CLOEXEC | O_NONBLOCK) != 0 ||
+        (!options.mergeStderr && pipe2(errPipe, O_CLOEXEC | O_NONBLOCK) != 0) ||
+        (!options.input.empty() && pipe2(inPipe, O_CLOEXEC) != 0)) {
+      failed.err = std::string("pipe: ") + std::strerror(errno) + "\n";
+      closeAll({outPipe[0], outPipe[1], errPipe[0], errPipe[1], inPipe[0],
+                inPipe[1]});
+      if (done) {
+        done(failed);
+      }
+      return false;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (options.input.empty()) {
+      posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+                                       O_RDONLY, 0);
+    } else {
+      posix_spawn_file_actions_adddup2(&actions, inPipe[0], STDIN_FILENO);
+    }
+    // The write ends are non-blocking for us only; dup2 gives the child
+    // a fresh descriptor, but the flag lives on the open file, so clear
+    // it before handing the pipe over.
+    fcntl(outPipe[1], F_SETFL, 0);
+    posix_spawn_file_actions_adddup2(&actions, outPipe[1], STDOUT_FILENO);
+    if (!options.mergeStderr) {
+      fcntl(errPipe[1], F_SETFL, 0);
+    }
+    posix_spawn_file_actions_adddup2(
+        &actions, options.mergeStderr ? outPipe[1] : errPipe[1],
+        STDERR_FILENO);
+    if (!options.cwd.empty()) {
+      posix_spawn_file_actions_addchdir_np(&actions, options.cwd.c_str());
+    }
+
+    bool ownGroup = options.timeoutSeconds > 0 || options.cpuSeconds > 0;
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    short spawnFlags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    if (ownGroup) {
+      // Own process group, so a timeout also kills grandchildren.
+      spawnFlags |= POSIX_SPAWN_SETPGROUP;
+      posix_spawnattr_setpgroup(&attr, 0);
+    }
+    sigset_t noSignals, defaultSignals;
+    sigemptyset(&noSignals);
+    sigemptyset(&defaultSignals);
+    sigaddset(&defaultSignals, SIGPIPE);
+    posix_spawnattr_setsigmask(&attr, &noSignals);
+    posix_spawnattr_setsigdefault(&attr, &defaultSignals);
+    posix_spawnattr_setflags(&attr, spawnFlags);
+
+    std::vector<char *> args;
+    for (const auto &arg : argv) {
+      args.push_back(const_cast<char *>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+    std::vector<std::string> envStrings = mergedEnvironment(options.env);
+    std::vector<char *> envp;
+    for (auto &entry : envStrings) {
+      envp.push_back(const_cast<char *>(entry.c_str()));
+    }
+    envp.push_back(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid;
+    int spawnError;
+    if (options.sandbox.enabled) {
+      Sandbox::Launch launch(argv, envStrings, options.cwd, options.sandbox,
+                             options.cpuSeconds);
+      pid = forkSandboxed(launch, options, inPipe[0], outPipe[1],
+                          options.mergeStderr ? outPipe[1] : errPipe[1],
+                          ownGroup);
+      spawnError = pid < 0 ? errno : 0;
+    } else {
+      spawnError = posix_spawnp(&pid, args[0], &actions, &attr, args.data(),
+                                envp.data());
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    closeAll({outPipe[1], errPipe[1], inPipe[0]});
+
+    if (spawnError != 0) {
+      closeAll({outPipe[0], errPipe[0], inPipe[1]});
+      failed.exitCode = 127;
+      failed.err = "failed to execute " + argv[0] + ": " +
+                   std::strerror(spawnError) + "\n";
+      if (done) {
+        done(failed);
+      }
+      return false;
+    }
+
+    if (options.cpuSeconds > 0) {
+      // SIGXCPU at the soft limit, SIGKILL one second later.
+      rlim_t seconds = static_cast<rlim_t>(std::ceil(options.cpuSeconds));
+      struct rlimit limit = {seconds, seconds + 1};
+      prlimit(pid, RLIMIT_CPU, &limit, nullptr);
+    }
+
+    uint64_t id = nextId++;
+    Child &child = children.emplace(id, Child(options.captureLimit)).first->second;
+    child.pid = pid;
+    child.ownGroup = ownGroup;
+    child.start = start;
+    child.cpuSeconds = options.cpuSeconds;
+    child.done = std::move(done);
+    child.result.started = true;
+
+    child.outFd = outPipe[0];
+    watch(child.outFd, id, kOut, EPOLLIN);
+    if (errPipe[0] >= 0) {
+      child.errFd = errPipe[0];
+      watch(child.errFd, id, kErr, EPOLLIN);
+    }
+    if (inPipe[1] >= 0) {
+      child.inFd = inPipe[1];
+      child.input = options.input;
+      fcntl(child.inFd, F_SETFL, O_NONBLOCK);
+      watch(child.inFd, id, kIn, EPOLLOUT);
+    }
+
+    child.pidFd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    if (child.pidFd >= 0) {
+      watch(child.pidFd, id, kPid, EPOLLIN);
+    }
+
+    if (options.timeoutSeconds > 0) {
+      child.hasDeadline = true;
+      child.deadline = start + std::chrono::microseconds(static_cast<long long>(
+                                   options.timeoutSeconds * 1e6));
+      child.timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+      if (child.timerFd >= 0) {
+        auto nanos = static_cast<long long>(options.timeoutSeconds * 1e9);
+        struct itimerspec spec = {};
+        spec.it_value.tv_sec = nanos / 1000000000LL;
+        spec.it_value.tv_nsec = std::max(1LL, nanos % 1000000000LL);
+        timerfd_settime(child.timerFd, 0, &spec, nullptr);
+        watch(child.timerFd, id, kTimer, EPOLLIN);
+      }
+    }
+    return true;
+  }
+
+  // Handles events for up to timeoutMs (-1: until something happens) and
+  // runs the callbacks of children that finished.
+  void poll(int timeoutMs = -1) {
+    if (children.empty()) {
+      return;
+    }
+    if (needsPolling()) {
+      timeoutMs = timeoutMs < 0 ? 5 : std::min(timeoutMs, 5);
+    }
+    struct epoll_event events[64];
+    int count = epoll_wait(epollFd, events, 64, timeoutMs);
+    for (int i = 0; i < count; i++) {
+      handle(events[i].data.u64 >> 3,
+             static_cast<Source>(events[i].data.u64 & 7));
+    }
+    finishReady();
+  }
+
+  // Runs until every child has finished.
+  void wait() {
+    while (!children.empty()) {
+      poll(-1);
+    }
+  }
+};
+
+#endif // CHILD_SUPERVISOR_HPP
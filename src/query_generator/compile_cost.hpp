@@ -0,0 +1,321 @@
+#ifndef COMPILE_COST_HPP
+#define COMPILE_COST_HPP
+
+#include "cache_utils.hpp"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+/** Compile time and memory as a bug oracle: a program that takes far
+ * more CPU time or peak RSS to compile at one stage (compiler, level and
+ * language) than the corpus does is a candidate optimizer performance
+ * bug, like a crash is a correctness one.
+ *
+ * Every successful compile is recorded with its wall time, user time and
+ * peak RSS (the rusage of the compiler driver, which covers cc1 and the
+ * linker it waited for). The baseline of a stage is the log-scale median
+ * and MAD of its samples, from earlier campaigns in
+ * <cache root>/compile_stats.tsv plus this run. A compile is an outlier
+ * when its robust z-score exceeds outlierZ, it costs at least minRatio
+ * times the median, and it is above an absolute floor, so that noise on
+ * tiny compiles is not reported. Stages with fewer than minSamples are
+ * not judged.
+ *
+ * With -ftime-report output the outliers are bucketed by the dominant
+ * pass (the one with the most user time), which points at the optimizer
+ * behind the blow-up.
+ * */
+class CompileCostOracle {
+public:
+  struct Sample {
+    std::string stage;
+    std::string source;
+    std::string command;
+    double wallSeconds = 0;
+    double userSeconds = 0;
+    double rssMb = 0;
+    std::string dominantPass;
+  };
+
+  struct Outlier {
+    Sample sample;
+    std::string metric;
+    double value = 0;
+    double median = 0;
+    double z = 0;
+
+    std::string bucket() const {
+      return metric + " / " + (sample.dominantPass.empty() ? "unknown pass" : sample.dominantPass);
+    }
+  };
+
+  struct Baseline {
+    size_t samples = 0;
+    double logMedian = 0;
+    double logMad = 0;
+  };
+
+private:
+  static constexpr double outlierZ = 3.5;
+  static constexpr size_t minSamples = 20;
+  static constexpr size_t keptSamples = 2000;
+  static constexpr double minTimeRatio = 3.0;
+  static constexpr double minRssRatio = 1.5;
+  static constexpr double minUserSeconds = 0.5;
+  static constexpr double minRssMb = 256;
+  // MAD floor on the log scale (10%), for stages whose costs barely vary.
+  static constexpr double minLogMad = 0.0953;
+
+  std::string path;
+  std::mutex mutex;
+  // stage -> (user seconds, RSS MB), loaded and this run's.
+  std::map<std::string, std::vector<std::pair<double, double>>> history;
+  std::vector<Sample> pending;
+
+  static std::map<std::string, std::vector<std::pair<double, double>>> load(const std::string &file) {
+    std::map<std::string, std::vector<std::pair<double, double>>> loaded;
+    std::ifstream input(file);
+    std::string line;
+    while (std::getline(input, line)) {
+      std::stringstream fields(line);
+      std::string stage;
+      double user, rss;
+      if (std::getline(fields, stage, '\t') && fields >> user >> rss) {
+        loaded[stage].push_back({user, rss});
+      }
+    }
+    return loaded;
+  }
+
+  static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+  }
+
+  static Baseline baseline(const std::vector<double> &values) {
+    Baseline result;
+    result.samples = values.size();
+    if (values.empty()) {
+      return result;
+    }
+    std::vector<double> logs;
+    for (double value : values) {
+      logs.push_back(std::log(std::max(value, 1e-3)));
+    }
+    result.logMedian = median(logs);
+    std::vector<double> deviations;
+    for (double value : logs) {
+      deviations.push_back(std::fabs(value - result.logMedian));
+    }
+    result.logMad = std::max(median(deviations), minLogMad);
+    return result;
+  }
+
+  // Robust z-score (0.6745 scales the MAD to a standard deviation).
+  static double zScore(const Baseline &base, double value) {
+    return 0.6745 * (std::log(std::max(value, 1e-3)) - base.logMedian) / base.logMad;
+  }
+
+  static double userSeconds(const struct rusage &usage) {
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+  }
+
+public:
+  explicit CompileCostOracle(const std::string &file = CacheUtils::cacheRoot() + "/compile_stats.tsv")
+      : path(file), history(load(file)) {}
+
+  // The pass with the most user time in gcc or clang -ftime-report
+  // output; aggregate rows (phases, totals, front-end timers) are
+  // skipped. Empty without a report.
+  static std::string dominantPass(const std::string &report) {
+    std::string best;
+    double bestSeconds = 0;
+    std::istringstream lines(report);
+    std::string line;
+    while (std::getline(lines, line)) {
+      std::string name;
+      double seconds = 0;
+      size_t colon = line.find(" : ");
+      if (colon != std::string::npos && line.find('%', colon) != std::string::npos) {
+        // gcc: " tree PTA        :   0.01 (  5%)   0.00 (  0%) ..."
+        size_t begin = line.find_first_not_of(' ');
+        size_t end = line.find_last_not_of(' ', colon);
+        name = line.substr(begin, end - begin + 1);
+        seconds = std::atof(line.c_str() + colon + 3);
+      } else {
+        // clang: "   0.0025 ( 19.4%)   0.0003 ( 28.4%) ...  X86 DAG->DAG Instruction Selection"
+        size_t last = line.rfind("%)");
+        size_t begin = line.find_first_not_of(' ');
+        if (last == std::string::npos || begin == std::string::npos || !std::isdigit(line[begin])) {
+          continue;
+        }
+        seconds = std::atof(line.c_str() + begin);
+        size_t nameStart = line.find_first_not_of(' ', last + 2);
+        name = nameStart == std::string::npos ? "" : line.substr(nameStart);
+      }
+      if (name.empty() || name.rfind("phase ", 0) == 0 || name.rfind("callgraph ", 0) == 0 ||
+          name.find("TOTAL") != std::string::npos || name.find("Total") != std::string::npos ||
+          name.find("front-end timer") != std::string::npos) {
+        continue;
+      }
+      if (seconds > bestSeconds) {
+        bestSeconds = seconds;
+        best = name;
+      }
+    }
+    return best;
+  }
+
+  void record(const std::string &stage, const std::string &source, const std::string &command,
+              double wallSeconds, const struct rusage &usage, const std::string &output) {
+    Sample sample;
+    sample.stage = stage;
+    sample.source = source;
+    sample.command = command;
+    sample.wallSeconds = wallSeconds;
+    sample.userSeconds = userSeconds(usage);
+    // ru_maxrss is in kilobytes on Linux.
+    sample.rssMb = usage.ru_maxrss / 1024.0;
+    sample.dominantPass = dominantPass(output);
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.push_back(std::move(sample));
+  }
+
+  // This run's outliers against the baselines of their stages.
+  std::vector<Outlier> findOutliers() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::string, std::vector<double>> times, rss;
+    for (const auto &[stage, values] : history) {
+      for (const auto &[user, memory] : values) {
+        times[stage].push_back(user);
+        rss[stage].push_back(memory);
+      }
+    }
+    for (const auto &sample : pending) {
+      times[sample.stage].push_back(sample.userSeconds);
+      rss[sample.stage].push_back(sample.rssMb);
+    }
+    std::map<std::string, Baseline> timeBase, rssBase;
+    for (const auto &[stage, values] : times) {
+      timeBase[stage] = baseline(values);
+      rssBase[stage] = baseline(rss[stage]);
+    }
+
+    std::vector<Outlier> outliers;
+    for (const auto &sample : pending) {
+      const Baseline &time = timeBase[sample.stage];
+      const Baseline &memory = rssBase[sample.stage];
+      if (time.samples < minSamples) {
+        continue;
+      }
+      auto check = [&](const std::string &metric, const Baseline &base, double value, double ratio,
+                       double floor) {
+        double typical = std::exp(base.logMedian);
+        double z = zScore(base, value);
+        if (z > outlierZ && value >= ratio * typical && value >= floor) {
+          outliers.push_back({sample, metric, value, typical, z});
+        }
+      };
+      check("compile time", time, sample.userSeconds, minTimeRatio, minUserSeconds);
+      check("peak RSS", memory, sample.rssMb, minRssRatio, minRssMb);
+    }
+    std::sort(outliers.begin(), outliers.end(), [](const Outlier &a, const Outlier &b) { return a.z > b.z; });
+    return outliers;
+  }
+
+  size_t recorded() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending.size();
+  }
+
+  static void log(const std::vector<Outlier> &outliers, const std::string &file) {
+    std::ofstream output(file, std::ios::app);
+    if (!output.is_open()) {
+      std::cerr << "Failed to open " << file << std::endl;
+      return;
+    }
+    output << std::fixed << std::setprecision(2);
+    for (const auto &outlier : outliers) {
+      const Sample &sample = outlier.sample;
+      output << "=== COMPILE COST OUTLIER ===" << std::endl;
+      output << "File: " << sample.source << std::endl;
+      output << "Compiler: " << sample.command << std::endl;
+      output << "Bucket: " << outlier.bucket() << std::endl;
+      output << "Metric: " << outlier.metric << " " << outlier.value
+             << (outlier.metric == "peak RSS" ? " MB" : " s") << ", stage median " << outlier.median
+             << ", z " << outlier.z << std::endl;
+      output << "Cost: wall " << sample.wallSeconds << " s, user " << sample.userSeconds << " s, RSS "
+             << sample.rssMb << " MB" << std::endl;
+      output << "===============================" << std::endl << std::endl;
+    }
+  }
+
+  static void printSummary(const std::vector<Outlier> &outliers) {
+    if (outliers.empty()) {
+      return;
+    }
+    std::map<std::string, size_t> buckets;
+    for (const auto &outlier : outliers) {
+      buckets[outlier.bucket()]++;
+    }
+    std::cout << "  compile cost outliers: " << outliers.size() << " (compile_outliers.log)" << std::endl;
+    for (const auto &[bucket, count] : buckets) {
+      std::cout << "    " << count << "x " << bucket << std::endl;
+    }
+  }
+
+  // Adds this run's samples to the file, keeping the newest keptSamples
+  // per stage.
+  void save() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending.empty()) {
+      return;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    auto merged = load(path);
+    for (const auto &sample : pending) {
+      merged[sample.stage].push_back({sample.userSeconds, sample.rssMb});
+    }
+    for (auto &[stage, values] : merged) {
+      if (values.size() > keptSamples) {
+        values.erase(values.begin(), values.end() - keptSamples);
+      }
+    }
+
+    std::string temp = path + ".tmp." + std::to_string(getpid());
+    {
+      std::ofstream file(temp);
+      if (!file.is_open()) {
+        std::cerr << "Failed to write compile stats: " << temp << std::endl;
+        return;
+      }
+      for (const auto &[stage, values] : merged) {
+        for (const auto &[user, rss] : values) {
+          file << stage << "\t" << user << "\t" << rss << "\n";
+        }
+      }
+    }
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+      std::cerr << "Failed to write compile stats: " << ec.message() << std::endl;
+      std::filesystem::remove(temp, ec);
+      return;
+    }
+    history = std::move(merged);
+    pending.clear();
+  }
+};
+
+#endif // COMPILE_COST_HPP
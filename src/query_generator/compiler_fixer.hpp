@@ -5,10 +5,10 @@
 #include <fstream>
 #include <iostream>
 #include <string>
-#include <array>
 #include <vector>
 #include <sstream>
-#include <cstdio>
+#include "artifact_cache.hpp"
+#include "process_runner.hpp"
 #include "query_generator.hpp"
 #include "TestWriter.hpp"
 #include "object_generator.hpp"
@@ -18,6 +18,8 @@ namespace fs = std::filesystem;
 
 class CompilerFixer {
 private:
+    ArtifactCache artifactCache;
+
     bool createDirectory(const std::string& path) {
         try {
             if (!fs::exists(path)) {
@@ -36,21 +38,16 @@ private:
         return path.stem().string();
     }
 
-    bool executeCommand(const std::string& command, std::string& output) {
-        std::array<char, 128> buffer;
-        output.clear();
-
-        FILE* pipe = popen((command + " 2>&1").c_str(), "r");
-        if (!pipe) {
-            std::cerr << "Error executing command" << std::endl;
+    bool executeCommand(const std::vector<std::string>& command, std::string& output) {
+        ProcessRunner::Options options;
+        options.mergeStderr = true;
+        ProcessRunner::Result result = ProcessRunner::run(command, options);
+        output = result.out;
+        if (!result.started) {
+            std::cerr << "Error executing command: " << result.err;
             return false;
         }
-
-        while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-            output += buffer.data();
-        }
-
-        return pclose(pipe) == 0;
+        return result.success();
     }
 
     std::string readFile(const std::string& filePath) {
@@ -198,18 +195,33 @@ private:
         return "";
     }
 
-    bool compileFile(const std::string& sourcePath, std::string& output, bool generateObject = true) {
-        std::string command;
+    bool compileFile(const std::string& sourcePath, std::string& output, bool generateObject = true,
+                     bool* cacheHit = nullptr) {
+        std::vector<std::string> command;
+        std::string objectPath;
         if (generateObject) {
-            std::string objectPath = "../object/" + getFileName(sourcePath) + ".o";
-            command = "gcc -c " + sourcePath + " -o " + objectPath + " -w"; // Add -w to suppress warnings
+            objectPath = "../object/" + getFileName(sourcePath) + ".o";
+            command = {"gcc", "-c", sourcePath, "-o", objectPath, "-w"}; // Add -w to suppress warnings
         } else {
             // Just check if it compiles without generating object file
-            command = "gcc -fsyntax-only " + sourcePath + " -w"; // Add -w to suppress warnings
+            command = {"gcc", "-fsyntax-only", sourcePath, "-w"}; // Add -w to suppress warnings
+        }
+
+        std::string cacheKey = artifactCache.key("gcc", generateObject ? "-c -w" : "-fsyntax-only -w", sourcePath);
+        ArtifactCache::Entry cached;
+        if (artifactCache.lookup(cacheKey, cached, objectPath)) {
+            std::cout << "Using cached compile result for: " << sourcePath << std::endl;
+            if (cacheHit) {
+                *cacheHit = true;
+            }
+            output = cached.diagnostics;
+            return cached.success;
         }
 
-        std::cout << "Executing: " << command << std::endl;
-        return executeCommand(command, output);
+        std::cout << "Executing: " << ProcessRunner::describe(command) << std::endl;
+        bool success = executeCommand(command, output);
+        artifactCache.store(cacheKey, {success, success ? 0 : 1, success ? "ok" : "error", output}, objectPath);
+        return success;
     }
 
     std::string getObjectPathForSource(const std::string& sourcePath) {
@@ -256,13 +268,6 @@ public:
 
     void processFile(const std::string& sourcePath) {
         std::string fileName = getFileName(sourcePath);
-        std::string objectPath = getObjectPathForSource(sourcePath);
-        
-        // Skip if object file already exists
-        if (fs::exists(objectPath)) {
-            std::cout << "Object file already exists for " << fileName << ", skipping." << std::endl;
-            return;
-        }
         
         std::cout << "\n===============================================" << std::endl;
         std::cout << "Processing: " << sourcePath << std::endl;
@@ -280,7 +285,14 @@ public:
         
         // Try to compile the source file
         std::string compileOutput;
-        bool compileSuccess = compileFile(sourcePath, compileOutput);
+        bool cacheHit = false;
+        bool compileSuccess = compileFile(sourcePath, compileOutput, true, &cacheHit);
+        
+        // Skip if this exact source already compiled with the current toolchain
+        if (compileSuccess && cacheHit) {
+            std::cout << "Object file restored from cache for " << fileName << ", skipping." << std::endl;
+            return;
+        }
         
         if (compileSuccess) {
             std::cout << "Compilation successful for: " << sourcePath << std::endl;
@@ -0,0 +1,426 @@
+#ifndef CRASH_BUCKETS_HPP
+#define CRASH_BUCKETS_HPP
+
+#include "cache_utils.hpp"
+#include "pattern_matcher.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+/** Groups compiler crashes into buckets, one per underlying bug, so that
+ * an ICE hit by hundreds of seeds is triaged and reduced once.
+ *
+ * A crash's signature is its compiler family (gcc, clang or llvm for opt
+ * and llc), its kind (assertion, unreachable, fatal error, verifier
+ * failure, ICE, signal or hang), a headline (the assertion text,
+ * UNREACHABLE, ICE or verifier message) with paths cut to the file
+ * name and numbers masked, and the top frames of the backtrace, without
+ * addresses, arguments and the signal-handling frames above the fault.
+ * The bucket key hashes all of it.
+ *
+ * The index (<cache root>/crash_buckets.tsv) persists across campaigns:
+ * per bucket, the crash count and the first crash (representative
+ * source and command). record() only touches memory; save() merges this
+ * run's counts into the file like RuntimeBudget does, so concurrent
+ * campaigns do not lose each other's buckets.
+ * */
+class CrashBuckets {
+public:
+  struct Signature {
+    std::string compiler;
+    std::string kind;
+    std::string headline;
+    std::vector<std::string> frames;
+
+    std::string key() const {
+      std::string data = compiler + "\n" + kind + "\n" + headline;
+      for (const auto &frame : frames) {
+        data += "\n" + frame;
+      }
+      return CacheUtils::hashString(data).substr(0, 16);
+    }
+
+    std::string describe() const { return kind + ": " + headline; }
+  };
+
+  struct Bucket {
+    std::string key;
+    size_t count = 0;
+    std::string source;
+    std::string command;
+    std::string kind;
+    std::string headline;
+    std::string frames;
+  };
+
+private:
+  static constexpr size_t maxFrames = 5;
+
+  std::string path;
+  mutable std::mutex mutex;
+  std::unordered_map<std::string, Bucket> known;
+  // This run's crashes per bucket, merged into the file by save().
+  std::unordered_map<std::string, Bucket> pending;
+  size_t newBuckets = 0;
+  size_t duplicates = 0;
+
+  static std::unordered_map<std::string, Bucket> load(const std::string &file) {
+    std::unordered_map<std::string, Bucket> loaded;
+    std::ifstream input(file);
+    std::string line;
+    size_t skipped = 0;
+    while (std::getline(input, line)) {
+      std::vector<std::string> fields;
+      std::stringstream stream(line);
+      std::string field;
+      while (std::getline(stream, field, '\t')) {
+        fields.push_back(field);
+      }
+      // A truncated or corrupt line costs its bucket, not the campaign.
+      char *end = nullptr;
+      unsigned long count = fields.size() < 7 ? 0 : std::strtoul(fields[1].c_str(), &end, 10);
+      if (fields.size() < 7 || fields[1].empty() || *end != '\0') {
+        skipped += !line.empty();
+        continue;
+      }
+      Bucket bucket{fields[0], count, fields[2], fields[3], fields[4], fields[5], fields[6]};
+      loaded[bucket.key] = bucket;
+    }
+    if (skipped > 0) {
+      std::cerr << "Warning: skipped " << skipped << " malformed lines of " << file << std::endl;
+    }
+    return loaded;
+  }
+
+  static std::string clean(std::string text) {
+    std::replace(text.begin(), text.end(), '\t', ' ');
+    return text;
+  }
+
+  // Paths cut to their file name, addresses and numbers masked.
+  static std::string mask(const std::string &text) {
+    static const std::regex directory(R"((/[^\s:'`/()]+)+/)");
+    static const std::regex number(R"(\b(0x[0-9a-fA-F]+|\d+)\b)");
+    return std::regex_replace(std::regex_replace(text, directory, ""), number, "N");
+  }
+
+  static std::string trim(std::string_view text) {
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos) {
+      return "";
+    }
+    size_t end = text.find_last_not_of(" \t\r");
+    return std::string(text.substr(begin, end - begin + 1));
+  }
+
+  static bool isHex(std::string_view text) {
+    return text.size() > 2 && text.substr(0, 2) == "0x" &&
+           std::all_of(text.begin() + 2, text.end(), [](char c) { return std::isxdigit(static_cast<unsigned char>(c)); });
+  }
+
+  // The function of a backtrace line, clang's "#3 0x55d0 llvm::f(int)
+  // (/usr/bin/clang+0x12)" or gcc's "0x8a1b2c f(tree_node*)", without
+  // arguments; empty for other lines and frames without a symbol.
+  static std::string frameName(std::string_view line) {
+    size_t begin = line.find_first_not_of(" \t");
+    if (begin == std::string_view::npos) {
+      return "";
+    }
+    line.remove_prefix(begin);
+    if (line[0] == '#') {
+      size_t space = line.find(' ');
+      if (space == std::string_view::npos) {
+        return "";
+      }
+      line.remove_prefix(space + 1);
+    }
+    size_t space = line.find(' ');
+    if (space == std::string_view::npos || !isHex(line.substr(0, space))) {
+      return "";
+    }
+    std::string name = trim(line.substr(space + 1));
+    // Module and offset: " (/usr/bin/clang+0x1234)", or gcc's " + 42".
+    size_t module = name.rfind(" (/");
+    if (module != std::string::npos && name.back() == ')') {
+      name.erase(module);
+    }
+    size_t offset = name.find(" + ");
+    if (offset != std::string::npos) {
+      name.erase(offset);
+    }
+    if (name.size() > 6 && name.compare(name.size() - 6, 6, " const") == 0) {
+      name.erase(name.size() - 6);
+    }
+    if (!name.empty() && name.back() == ')') {
+      int depth = 0;
+      for (size_t i = name.size(); i-- > 0;) {
+        depth += name[i] == ')' ? 1 : name[i] == '(' ? -1 : 0;
+        if (depth == 0) {
+          name.erase(i);
+          break;
+        }
+      }
+    }
+    return name;
+  }
+
+  // Frames of the crash handlers and the C library above the fault.
+  static bool isHandlerFrame(const std::string &name) {
+    static const std::vector<std::string> exact = {
+        "raise", "abort", "gsignal", "_start", "__libc_start_main", "__libc_start_call_main", "__restore_rt",
+        "__assert_fail", "__assert_fail_base", "pthread_kill", "__pthread_kill_implementation", "fancy_abort",
+        "internal_error", "crash_signal", "???", "<unknown>"};
+    static const std::vector<std::string> parts = {"PrintStackTrace", "SignalHandler", "CrashRecoveryContext",
+                                                   "llvm_unreachable_internal", "report_fatal_error", "diagnostic_"};
+    if (std::find(exact.begin(), exact.end(), name) != exact.end()) {
+      return true;
+    }
+    return std::any_of(parts.begin(), parts.end(),
+                       [&](const std::string &part) { return name.find(part) != std::string::npos; });
+  }
+
+  static std::string family(const std::string &command, const std::string &output = "") {
+    std::string compiler = std::filesystem::path(command.substr(0, command.find(' '))).filename().string();
+    // opt and llc, also versioned (opt-14).
+    if (compiler == "opt" || compiler == "llc" || compiler.rfind("opt-", 0) == 0 || compiler.rfind("llc-", 0) == 0) {
+      return "llvm";
+    }
+    return compiler.find("clang") != std::string::npos ||
+                   (compiler.empty() && output.find("clang") != std::string::npos)
+               ? "clang"
+               : "gcc";
+  }
+
+  enum Marker { assertion, unreachable, fatalError, ice, signal };
+
+  static const PatternMatcher &markers() {
+    static const PatternMatcher matcher = [] {
+      PatternMatcher built;
+      built.addLiteral(assertion, "Assertion `");
+      built.addLiteral(unreachable, "UNREACHABLE executed");
+      built.addLiteral(fatalError, "LLVM ERROR: ");
+      built.addLiteral(ice, "internal compiler error");
+      for (const char *literal : {"Segmentation fault", "Aborted", "Illegal instruction", "Bus error",
+                                  "Floating point exception", "unable to execute command",
+                                  "frontend command failed"}) {
+        built.addLiteral(signal, literal, true);
+      }
+      built.compile();
+      return built;
+    }();
+    return matcher;
+  }
+
+public:
+  explicit CrashBuckets(const std::string &file = CacheUtils::cacheRoot() + "/crash_buckets.tsv")
+      : path(file), known(load(file)) {}
+
+  static Signature extract(const std::string &output, int exitCode, const std::string &command = "") {
+    Signature signature;
+    signature.compiler = family(command, output);
+    // Marker of the headline found so far; assertions and unreachables
+    // beat fatal errors, which beat ICE messages and bare signals.
+    int found = -1;
+    std::string previous;
+    std::string_view rest(output);
+    while (!rest.empty()) {
+      size_t newline = rest.find('\n');
+      std::string_view line = rest.substr(0, newline);
+      rest.remove_prefix(newline == std::string_view::npos ? rest.size() : newline + 1);
+
+      if (signature.frames.size() < maxFrames) {
+        std::string frame = frameName(line);
+        if (!frame.empty() && !isHandlerFrame(frame)) {
+          signature.frames.push_back(frame);
+          continue;
+        }
+      }
+      PatternMatcher::Categories hits = found == assertion || found == unreachable ? 0 : markers().scan(line);
+      for (int marker = assertion; marker <= signal && hits; marker++) {
+        if (!PatternMatcher::has(hits, marker) || (found >= 0 && found <= marker)) {
+          continue;
+        }
+        std::string text(line);
+        static const std::regex location(R"(^.*?:\d+: )");
+        switch (marker) {
+        case assertion:
+          signature.kind = "assertion";
+          signature.headline = mask(std::regex_replace(text, location, ""));
+          break;
+        case unreachable:
+          signature.kind = "unreachable";
+          signature.headline = mask(trim(previous) + " / " + text);
+          break;
+        case fatalError:
+          signature.kind = "fatal-error";
+          signature.headline = mask(text.substr(text.find("LLVM ERROR: ") + 12));
+          break;
+        case ice:
+          signature.kind = "ice";
+          signature.headline = mask(trim(text.substr(text.find("internal compiler error") + 23)));
+          if (signature.headline.rfind(": ", 0) == 0) {
+            signature.headline.erase(0, 2);
+          }
+          break;
+        default:
+          signature.kind = "signal";
+          signature.headline = mask(trim(text));
+        }
+        found = marker;
+        break;
+      }
+      if (!trim(line).empty()) {
+        previous = std::string(line);
+      }
+    }
+    if (found < 0) {
+      signature.kind = "exit";
+      signature.headline = "exit " + std::to_string(exitCode);
+    } else if (found == fatalError && signature.headline.find("Broken module found") != std::string::npos) {
+      // Every verifier failure ends in the same fatal error; the
+      // verifier's own message comes first.
+      signature.kind = "verifier";
+      size_t begin = output.find_first_not_of("\n");
+      signature.headline =
+          begin == std::string::npos ? signature.headline : mask(trim(output.substr(begin, output.find('\n', begin) - begin)));
+    }
+    return signature;
+  }
+
+  // A compile killed at its deadline leaves no output to go by, and
+  // unrelated hangs share compiler and flags, so a hang's bucket is the
+  // compiler family, the flags and the hung program's contents: only the
+  // same program hanging again is a duplicate.
+  static Signature hang(const std::string &command, const std::string &source) {
+    Signature signature;
+    signature.compiler = family(command);
+    signature.kind = "hang";
+    size_t split = command.find(' ');
+    signature.headline = "no result before the deadline with" +
+                         (split == std::string::npos ? std::string(" no flags") : command.substr(split)) +
+                         " on program " + CacheUtils::hashString(CacheUtils::readFile(source)).substr(0, 16);
+    return signature;
+  }
+
+  // Counts one crash; true when it opens a new bucket, i.e. this crash
+  // is the one to triage and reduce. seen receives the bucket's count.
+  bool record(const Signature &signature, const std::string &source, const std::string &command,
+              size_t *seen = nullptr) {
+    std::string key = signature.key();
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = known.find(key);
+    bool fresh = found == known.end();
+    if (fresh) {
+      Bucket bucket;
+      bucket.key = key;
+      bucket.source = clean(source);
+      bucket.command = clean(command);
+      bucket.kind = signature.kind;
+      bucket.headline = clean(signature.headline);
+      for (const auto &frame : signature.frames) {
+        bucket.frames += (bucket.frames.empty() ? "" : " < ") + clean(frame);
+      }
+      found = known.emplace(key, bucket).first;
+      newBuckets++;
+    } else {
+      duplicates++;
+    }
+    found->second.count++;
+    auto delta = pending.find(key);
+    if (delta == pending.end()) {
+      delta = pending.emplace(key, found->second).first;
+      delta->second.count = 0;
+    }
+    delta->second.count++;
+    if (seen) {
+      *seen = found->second.count;
+    }
+    return fresh;
+  }
+
+  // Merges this run's counts and new buckets into the index file.
+  void save() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending.empty()) {
+      return;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    auto merged = load(path);
+    for (const auto &[key, bucket] : pending) {
+      auto found = merged.find(key);
+      if (found == merged.end()) {
+        merged.emplace(key, bucket);
+      } else {
+        found->second.count += bucket.count;
+      }
+    }
+
+    std::string temp = path + ".tmp." + std::to_string(getpid());
+    {
+      std::ofstream file(temp);
+      if (!file.is_open()) {
+        std::cerr << "Failed to write crash buckets: " << temp << std::endl;
+        return;
+      }
+      for (const auto &[key, bucket] : merged) {
+        file << key << "\t" << bucket.count << "\t" << bucket.source << "\t" << bucket.command << "\t"
+             << bucket.kind << "\t" << bucket.headline << "\t" << bucket.frames << "\n";
+      }
+    }
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+      std::cerr << "Failed to write crash buckets: " << ec.message() << std::endl;
+      std::filesystem::remove(temp, ec);
+      return;
+    }
+    known = std::move(merged);
+    pending.clear();
+  }
+
+  // Buckets by decreasing crash count.
+  std::vector<Bucket> buckets() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Bucket> sorted;
+    for (const auto &entry : known) {
+      sorted.push_back(entry.second);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Bucket &a, const Bucket &b) {
+      return a.count != b.count ? a.count > b.count : a.key < b.key;
+    });
+    return sorted;
+  }
+
+  size_t getNewBuckets() const { return newBuckets; }
+  size_t getDuplicates() const { return duplicates; }
+
+  void printIndex(size_t top, std::ostream &os = std::cout) const {
+    std::vector<Bucket> sorted = buckets();
+    size_t crashes = 0;
+    for (const auto &bucket : sorted) {
+      crashes += bucket.count;
+    }
+    os << sorted.size() << " crash buckets, " << crashes << " crashes (" << path << ")" << std::endl;
+    for (size_t i = 0; i < sorted.size() && i < top; i++) {
+      const Bucket &bucket = sorted[i];
+      os << bucket.key << " " << bucket.count << "x " << bucket.kind << ": " << bucket.headline << std::endl;
+      if (!bucket.frames.empty()) {
+        os << "    " << bucket.frames << std::endl;
+      }
+      os << "    first: " << bucket.command << " " << bucket.source << std::endl;
+    }
+  }
+};
+
+#endif // CRASH_BUCKETS_HPP
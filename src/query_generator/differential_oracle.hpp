@@ -0,0 +1,147 @@
+#ifndef DIFFERENTIAL_ORACLE_HPP
+#define DIFFERENTIAL_ORACLE_HPP
+
+#include "cache_utils.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+/** Majority vote over the observable behavior of one program built by
+ * several compiler configurations. A configuration's behavior is its
+ * fingerprint: how the run ended (exit code, signal or timeout) and a
+ * hash of its stdout. When a strict majority of the configurations that
+ * ran agree, the others are divergent, i.e. suspected miscompilations.
+ *
+ * The program is expected to be sanitizer-clean, so that diverging
+ * behavior is the compilers' fault rather than undefined behavior, and
+ * deterministic, which the caller checks by running one build twice.
+ * */
+class DifferentialOracle {
+public:
+  struct Observation {
+    std::string config;
+    bool ran = false;
+    bool timedOut = false;
+    int exitCode = 0;
+    int signal = 0;
+    std::string outputHash;
+    // First bytes of stdout, for the log.
+    std::string excerpt;
+  };
+
+  enum class Outcome { Agree, Divergent, NoMajority, Unusable };
+
+  struct Verdict {
+    Outcome outcome = Outcome::Unusable;
+    std::string majority;
+    size_t voters = 0;
+    size_t majorityVotes = 0;
+    // Configurations that disagree with the majority, with their symptom.
+    std::vector<std::pair<std::string, std::string>> divergent;
+  };
+
+  static std::string fingerprint(const Observation &observation) {
+    std::string ending;
+    if (observation.timedOut) {
+      ending = "timeout";
+    } else if (observation.signal != 0) {
+      ending = "signal " + std::to_string(observation.signal);
+    } else {
+      ending = "exit " + std::to_string(observation.exitCode);
+    }
+    return ending + ", stdout " + observation.outputHash;
+  }
+
+  // Prefix of every excerpt line in the logs, so that program output
+  // cannot pass for log structure ("=== ...", "--- <command>: ...").
+  static constexpr const char *excerptPrefix = "  | ";
+
+  // The excerpt as log lines, each behind excerptPrefix.
+  static std::string quotedExcerpt(const Observation &observation) {
+    std::string quoted = excerptPrefix;
+    const std::string &excerpt = observation.excerpt;
+    for (size_t i = 0; i < excerpt.size(); i++) {
+      quoted += excerpt[i];
+      if (excerpt[i] == '\n' && i + 1 < excerpt.size()) {
+        quoted += excerptPrefix;
+      }
+    }
+    return quoted;
+  }
+
+  // From ProcessRunner::Result::outHash, which covers the whole stream
+  // even where the captured output was cut in the middle.
+  static std::string hashOutput(uint64_t streamHash) {
+    return CacheUtils::toHex(streamHash).substr(0, 16);
+  }
+
+  static Verdict vote(const std::vector<Observation> &observations) {
+    Verdict verdict;
+    std::map<std::string, size_t> votes;
+    for (const auto &observation : observations) {
+      if (observation.ran) {
+        votes[fingerprint(observation)]++;
+        verdict.voters++;
+      }
+    }
+    if (verdict.voters < 3) {
+      return verdict;
+    }
+    for (const auto &[candidate, count] : votes) {
+      if (count > verdict.majorityVotes) {
+        verdict.majority = candidate;
+        verdict.majorityVotes = count;
+      }
+    }
+    if (verdict.majorityVotes * 2 <= verdict.voters) {
+      verdict.outcome = Outcome::NoMajority;
+      verdict.majority.clear();
+      return verdict;
+    }
+    Observation reference;
+    for (const auto &observation : observations) {
+      if (observation.ran && fingerprint(observation) == verdict.majority) {
+        reference = observation;
+        break;
+      }
+    }
+    for (const auto &observation : observations) {
+      if (observation.ran && fingerprint(observation) != verdict.majority) {
+        verdict.divergent.push_back({observation.config, symptom(observation, reference)});
+      }
+    }
+    verdict.outcome = verdict.divergent.empty() ? Outcome::Agree : Outcome::Divergent;
+    return verdict;
+  }
+
+  static const char *name(Outcome outcome) {
+    switch (outcome) {
+    case Outcome::Agree:
+      return "agree";
+    case Outcome::Divergent:
+      return "divergent";
+    case Outcome::NoMajority:
+      return "no-majority";
+    case Outcome::Unusable:
+      break;
+    }
+    return "unusable";
+  }
+
+  // How observation differs from the majority's reference run.
+  static std::string symptom(const Observation &observation, const Observation &reference) {
+    if (observation.timedOut) {
+      return "timeout";
+    }
+    if (observation.signal != 0 && reference.signal == 0) {
+      return "crash (signal " + std::to_string(observation.signal) + ")";
+    }
+    if (observation.exitCode != reference.exitCode || observation.signal != reference.signal) {
+      return "exit " + std::to_string(observation.exitCode) + " instead of " +
+             std::to_string(reference.exitCode);
+    }
+    return "wrong output";
+  }
+};
+
+#endif // DIFFERENTIAL_ORACLE_HPP
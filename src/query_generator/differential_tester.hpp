@@ -8,14 +8,48 @@
 #include <vector>
 #include <map>
 #include <set>
-#include <array>
 #include <sstream>
-#include <cstdio>
-#include <regex>
-#include <sys/wait.h>  
+#include <csignal>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+#include <iomanip>
+#include "batch_compiler.hpp"
+#include "compile_cost.hpp"
+#include "crash_buckets.hpp"
+#include "differential_oracle.hpp"
+#include "driver_job_cache.hpp"
+#include "flag_matrix.hpp"
+#include "pattern_matcher.hpp"
+#include "pch_cache.hpp"
+#include "process_runner.hpp"
+#include "run_cost.hpp"
+#include "runtime_budget.hpp"
+#include "task_graph.hpp"
 
 namespace fs = std::filesystem;
 
+/** Builds every program with gcc and clang at -O0..-O3 (or, with
+ * useFlagMatrix(), with rows of a pairwise flag matrix) and looks for
+ * three kinds of compiler bugs: crashes and hangs while compiling
+ * (bugs.log, one entry per CrashBuckets bucket), miscompilations, where
+ * one build's run disagrees with the majority of the others
+ * (miscompilations.log, see DifferentialOracle), and compiles whose time
+ * or memory is an outlier for their stage (compile_outliers.log, see
+ * CompileCostOracle). With setPerfRuns(), the builds of programs they all
+ * agree on are also timed against each other for missed optimizations
+ * (missed_optimizations.log, see RunCostOracle).
+ *
+ * The builds of a file compile in parallel and its runs start as soon as
+ * they are built, while other files are still compiling. The reference
+ * build (gcc -O2) runs first; its wall time sets every other run's
+ * deadline through RuntimeBudget, and its second run among the others
+ * shows whether the program is deterministic at all. Only
+ * sanitizer-clean programs should be fed in: undefined behavior makes
+ * diverging output legitimate.
+ * */
 class DifferentialTester {
 private:
    struct CompilerConfig {
@@ -23,6 +57,58 @@ private:
        std::string command;
    };
 
+   // One program on its way through the builds, runs and the vote.
+   struct Program {
+       std::string source;
+       std::string executableBase;
+       std::vector<CompilerConfig> configs;
+       // Per configuration; char rather than bool, since the builds of a
+       // program finish on different threads.
+       std::vector<char> built;
+       std::vector<DifferentialOracle::Observation> observations;
+       // First run of the reference build.
+       DifferentialOracle::Observation reference;
+       size_t referenceConfig = 0;
+       double cleanSeconds = -1;
+       std::vector<RunCostOracle::Finding> slowBuilds;
+   };
+
+   PchCache pchCache;
+   DriverJobCache jobCache;
+   RuntimeBudget budget;
+   CrashBuckets crashBuckets;
+   CompileCostOracle compileCost;
+   std::vector<CompileCostOracle::Outlier> compileOutliers;
+   bool timeReport = false;
+   // Timed runs per build for RunCostOracle; 0 turns it off.
+   size_t perfRuns = 0;
+   std::vector<RunCostOracle::Finding> missedOptimizations;
+   std::atomic<size_t> timed{0};
+   // Per-compile deadline. A compile that misses it is retried once with
+   // hangRetryFactor times as long before it counts as a hang.
+   double compileTimeout = defaultCompileTimeout();
+   static constexpr double hangRetryFactor = 4.0;
+   size_t batchSize = 1;
+   size_t jobs = 0;
+   std::string workDir = "../test";
+   std::mutex outputMutex;
+   // With a matrix, each program gets matrixBudget builds: the reference,
+   // its own sampled flags (from promptDir) and pairwise matrix rows.
+   std::unique_ptr<FlagMatrix> matrix;
+   size_t matrixBudget = 8;
+   std::string promptDir;
+
+   std::atomic<size_t> tested{0};
+   std::atomic<size_t> agreed{0};
+   std::atomic<size_t> divergent{0};
+   std::atomic<size_t> noMajority{0};
+   std::atomic<size_t> nondeterministic{0};
+   std::atomic<size_t> unusable{0};
+   std::atomic<size_t> builds{0};
+   std::atomic<size_t> hangs{0};
+   // Compiles that missed the deadline but finished on retry.
+   std::atomic<size_t> slowCompiles{0};
+
    const std::vector<CompilerConfig> configs = {
        {"gcc-O0", "gcc -O0"},
        {"gcc-O1", "gcc -O1"},
@@ -33,7 +119,483 @@ private:
        {"clang-O2", "clang -O2"},
        {"clang-O3", "clang -O3"}
    };
-   const std::vector<std::string> crashPatterns = {
+
+   bool reportResult(const ProcessRunner::Result& result, std::string& output, int& exitCode) {
+       output = result.out;
+       exitCode = result.exitCode;
+       if (!result.started) {
+           std::cerr << "Error executing command: " << result.err;
+           return false;
+       }
+       if (result.signal != 0) {
+           int signal = result.signal;
+           std::string signalName;
+           switch (signal) {
+               case SIGSEGV: signalName = "SIGSEGV (Segmentation fault)"; break;
+               case SIGABRT: signalName = "SIGABRT (Aborted)"; break;
+               case SIGBUS: signalName = "SIGBUS (Bus error)"; break;
+               case SIGILL: signalName = "SIGILL (Illegal instruction)"; break;
+               case SIGFPE: signalName = "SIGFPE (Floating point exception)"; break;
+               default: signalName = "Signal " + std::to_string(signal); break;
+           }
+           output += "\nProcess terminated by signal: " + signalName;
+           return false;
+       }
+       return exitCode == 0;
+   }
+
+   // Reference for deadlines and the determinism check.
+   static constexpr const char* referenceName = "gcc-O2";
+
+   // Runtime budget stage of a configuration: its compiler and level, so
+   // that matrix rows share the calibration of the plain level.
+   static std::string stageOf(const CompilerConfig& config) {
+       std::istringstream words(config.command);
+       std::string compiler, level;
+       words >> compiler >> level;
+       return level.empty() ? compiler : compiler + level;
+   }
+
+   // The optimization level and flag `generate` sampled for the program,
+   // from its prompt file.
+   bool readSampledFlags(const std::string& sourcePath, std::string& optLevel, std::string& flag) const {
+       std::ifstream prompt(fs::path(promptDir) / (fs::path(sourcePath).stem().string() + ".prompt"));
+       std::string line;
+       while (std::getline(prompt, line) && line != "=== PROMPT ===") {
+           if (line.rfind("Optimization Level: ", 0) == 0) {
+               optLevel = line.substr(20);
+           } else if (line.rfind("Compiler Flag: ", 0) == 0) {
+               flag = line.substr(15);
+           }
+       }
+       return !optLevel.empty();
+   }
+
+   std::vector<CompilerConfig> configsFor(const std::string& sourcePath) {
+       if (!matrix) {
+           return configs;
+       }
+       std::vector<CompilerConfig> chosen = {{referenceName, "gcc -O2"}};
+       std::string optLevel, flag;
+       if (readSampledFlags(sourcePath, optLevel, flag)) {
+           for (const auto& compiler : matrix->getCompilers()) {
+               FlagMatrix::Row row;
+               if (matrix->sampled(compiler, optLevel, flag, row) && row.command() != chosen[0].command) {
+                   chosen.push_back({compiler + optLevel + "-own", row.command()});
+               }
+           }
+       }
+       size_t rows = matrixBudget > chosen.size() ? matrixBudget - chosen.size() : 0;
+       for (const auto& row : matrix->take(rows)) {
+           chosen.push_back({row.compiler + row.optLevel + "-r" + std::to_string(row.index), row.command()});
+       }
+       return chosen;
+   }
+
+   // The configuration's command, with the C++ driver for C++ sources.
+   static std::string commandFor(const CompilerConfig& config, const std::string& sourcePath) {
+       std::string extension = fs::path(sourcePath).extension().string();
+       if (extension != ".cpp" && extension != ".cc" && extension != ".cxx") {
+           return config.command;
+       }
+       size_t split = config.command.find(' ');
+       std::string compiler = config.command.substr(0, split);
+       std::string rest = split == std::string::npos ? "" : config.command.substr(split);
+       return (compiler == "gcc" ? "g++" : compiler == "clang" ? "clang++" : compiler) + rest;
+   }
+
+   void logBug(const std::string& sourceFile, const std::string& compiler, const std::string& output,
+               int exitCode) {
+       logFinding("COMPILER CRASH DETECTED", sourceFile, compiler,
+                  CrashBuckets::extract(output, exitCode, compiler), output);
+   }
+
+   void logHang(const std::string& sourceFile, const std::string& compiler, const std::string& configName) {
+       hangs++;
+       {
+           std::lock_guard<std::mutex> lock(outputMutex);
+           std::cout << "COMPILER HANG DETECTED for " << configName << " on file " << sourceFile << std::endl;
+       }
+       std::ostringstream output;
+       output << "Deadline: " << compileTimeout << " s" << std::endl
+              << "No result within " << compileTimeout << " s, nor within " << compileTimeout * hangRetryFactor
+              << " s on retry; the compiler's process group was killed.";
+       logFinding("COMPILER HANG DETECTED", sourceFile, compiler, CrashBuckets::hang(compiler, sourceFile), output.str());
+   }
+
+   // Only the first finding of a bucket is logged in full; later ones are
+   // counted in the bucket index and listed in crash_duplicates.tsv.
+   void logFinding(const std::string& header, const std::string& sourceFile, const std::string& compiler,
+                   const CrashBuckets::Signature& signature, const std::string& output) {
+       size_t seen = 0;
+       bool fresh = crashBuckets.record(signature, sourceFile, compiler, &seen);
+       std::lock_guard<std::mutex> lock(outputMutex);
+       if (!fresh) {
+           std::cout << "Known crash bucket " << signature.key() << " (" << seen << " crashes): "
+                     << signature.describe() << std::endl;
+           std::ofstream duplicates("crash_duplicates.tsv", std::ios::app);
+           duplicates << signature.key() << "\t" << sourceFile << "\t" << compiler << std::endl;
+           return;
+       }
+       std::ofstream logFile("bugs.log", std::ios::app);
+       if (!logFile.is_open()) {
+           std::cerr << "Failed to open bugs.log file" << std::endl;
+           return;
+       }
+       logFile << "=== " << header << " ===" << std::endl;
+       logFile << "File: " << sourceFile << std::endl;
+       logFile << "Compiler: " << compiler << std::endl;
+       logFile << "Bucket: " << signature.key() << std::endl;
+       logFile << "Signature: " << signature.describe() << std::endl;
+       for (const auto& frame : signature.frames) {
+           logFile << "Frame: " << frame << std::endl;
+       }
+       logFile << "Error output:" << std::endl;
+       logFile << output << std::endl;
+       logFile << "===============================" << std::endl << std::endl;
+       logFile.close();
+   }
+
+   // Crashes happen in the frontend or backend, so batches only need to
+   // compile (-c); BatchCompiler splits failing batches down to the file.
+   // Sources are grouped by the command they get (configsFor and
+   // commandFor), so C and C++ sources and matrix rows batch apart.
+   void processBatched(const std::vector<std::string>& sources) {
+       std::map<std::string, std::pair<std::string, std::vector<std::string>>> groups;
+       for (const auto& source : sources) {
+           for (const auto& config : configsFor(source)) {
+               auto& group = groups[commandFor(config, source)];
+               if (group.first.empty()) {
+                   group.first = config.name;
+               }
+               group.second.push_back(source);
+           }
+       }
+
+       BatchCompiler batch(batchSize);
+       size_t index = 0;
+       for (const auto& [command, group] : groups) {
+           const std::string& configName = group.first;
+           size_t split = command.find(' ');
+           std::string compiler = command.substr(0, split);
+           std::string flags = split == std::string::npos ? "" : command.substr(split + 1);
+           std::string outDir = (fs::path(workDir) / ("objects_" + std::to_string(index++))).string();
+
+           batch.setTimeout(compileTimeout);
+           for (auto result : batch.compile(compiler, flags, group.second, outDir)) {
+               if (result.timedOut) {
+                   // Rule out a loaded machine before calling it a hang;
+                   // the retry's own result is judged below.
+                   batch.setTimeout(compileTimeout * hangRetryFactor);
+                   result = batch.compile(compiler, flags, {result.source}, outDir)[0];
+                   batch.setTimeout(compileTimeout);
+                   if (result.timedOut) {
+                       logHang(result.source, command, configName);
+                       continue;
+                   }
+                   slowCompiles++;
+               }
+               if (!result.success && isCompilerCrash(result.diagnostics, result.exitCode)) {
+                   std::cout << "COMPILER CRASH DETECTED for " << configName << " on file " << result.source << std::endl;
+                   std::cout << "Exit code: " << result.exitCode << std::endl;
+                   logBug(result.source, command,
+                          "Exit code: " + std::to_string(result.exitCode) + "\n" + result.diagnostics, result.exitCode);
+               }
+           }
+           std::error_code ec;
+           fs::remove_all(outDir, ec);
+       }
+       std::cout << "Compiled " << sources.size() << " files in " << groups.size() << " configurations with "
+                 << batch.getInvocationCount() << " compiler invocations" << std::endl;
+       crashBuckets.save();
+       printCrashBuckets();
+       printHangs();
+   }
+
+   // Compiles one configuration of a program; true when the executable
+   // was produced. Compiler crashes are reported and logged here.
+   bool compileConfig(const CompilerConfig& config, const std::string& sourcePath,
+                      const std::string& executablePath) {
+       std::string command = commandFor(config, sourcePath);
+       size_t split = command.find(' ');
+       std::string compiler = command.substr(0, split);
+       std::string flags = split == std::string::npos ? "" : command.substr(split + 1);
+       std::string pchFlags = pchCache.includeFlags(compiler, flags, sourcePath);
+       // Only for the cost breakdown; logged commands leave it out.
+       std::string reportFlags = timeReport ? " -ftime-report" : "";
+       std::vector<std::string> compileCommand = ProcessRunner::splitArgs(command + reportFlags + " " + pchFlags);
+       compileCommand.insert(compileCommand.end(), {sourcePath, "-o", executablePath});
+
+       // On a timeout the compiler's whole process group is killed.
+       auto attempt = [&](double timeout) {
+           ProcessRunner::Options options;
+           options.mergeStderr = true;
+           options.timeoutSeconds = timeout;
+           ProcessRunner::Result result;
+           // Replay the cached -cc1/link jobs when the driver supports it.
+           DriverJobCache::Invocation direct;
+           if (jobCache.instantiate(compiler, flags + reportFlags + " " + pchFlags, sourcePath, executablePath, direct)) {
+               result = DriverJobCache::run(direct, options);
+               DriverJobCache::cleanup(direct);
+           } else {
+               result = ProcessRunner::run(compileCommand, options);
+           }
+           if (!result.success() && !result.timedOut && !pchFlags.empty() && PchCache::isPchFailure(result.out)) {
+               std::vector<std::string> plain = ProcessRunner::splitArgs(command + reportFlags);
+               plain.insert(plain.end(), {sourcePath, "-o", executablePath});
+               result = ProcessRunner::run(plain, options);
+           }
+           return result;
+       };
+
+       ProcessRunner::Result result = attempt(compileTimeout);
+       if (result.timedOut) {
+           // Rule out a loaded machine before calling it a hang.
+           result = attempt(compileTimeout * hangRetryFactor);
+           if (result.timedOut) {
+               logHang(sourcePath, command, config.name);
+               return false;
+           }
+           slowCompiles++;
+       }
+       std::string compileOutput;
+       int exitCode;
+       bool compileSuccess = reportResult(result, compileOutput, exitCode);
+       if (compileSuccess) {
+           std::string language = fs::path(sourcePath).extension() == ".c" ? "c" : "c++";
+           compileCost.record(stageOf(config) + " " + language, sourcePath, command, result.wallSeconds,
+                              result.usage, compileOutput);
+       }
+
+       if (!compileSuccess && isCompilerCrash(compileOutput, exitCode)) {
+           {
+               std::lock_guard<std::mutex> lock(outputMutex);
+               std::cout << "COMPILER CRASH DETECTED for " << config.name << " on file " << sourcePath << std::endl;
+               std::cout << "Exit code: " << exitCode << std::endl;
+           }
+           std::string enhancedOutput = "Exit code: " + std::to_string(exitCode) + "\n" + compileOutput;
+           logBug(sourcePath, command, enhancedOutput, exitCode);
+       }
+       return compileSuccess;
+   }
+
+   std::string executableFor(const Program& program, size_t config) const {
+       return program.executableBase + "_" + program.configs[config].name;
+   }
+
+   // The reference build's first run: a clean time for the deadlines.
+   void measureReference(Program& program) {
+       if (!program.built[program.referenceConfig]) {
+           return;
+       }
+       double seconds = 0;
+       program.reference = runBuild(executableFor(program, program.referenceConfig), referenceName,
+                                    RuntimeBudget::cleanLimit(), seconds);
+       if (program.reference.ran && !program.reference.timedOut) {
+           program.cleanSeconds = seconds;
+       }
+   }
+
+   double deadlineFor(const Program& program, size_t config) {
+       std::string stage = stageOf(program.configs[config]);
+       // Unoptimized builds are several times slower than the reference.
+       std::vector<std::string> traits;
+       if (stage.find("-O0") != std::string::npos) {
+           traits.push_back("unoptimized");
+       }
+       return budget.deadline(stage, traits, program.cleanSeconds);
+   }
+
+   void runConfig(Program& program, size_t config) {
+       // Without a clean time the program hung or did not build; there
+       // is nothing to compare against.
+       if (!program.built[config] || program.cleanSeconds < 0) {
+           return;
+       }
+       const CompilerConfig& compiler = program.configs[config];
+       double seconds = 0;
+       program.observations[config] =
+           runBuild(executableFor(program, config), compiler.name, deadlineFor(program, config), seconds);
+       budget.record(stageOf(compiler), seconds, program.cleanSeconds,
+                     program.observations[config].ran && !program.observations[config].timedOut);
+   }
+
+   // Times the builds against each other, only when every build ran and
+   // agreed: the run time of a wrong or unfinished build means nothing.
+   void timeBuilds(Program& program) {
+       if (program.cleanSeconds < 0) {
+           return;
+       }
+       const DifferentialOracle::Observation& rerun = program.observations[program.referenceConfig];
+       if (!rerun.ran || DifferentialOracle::fingerprint(rerun) != DifferentialOracle::fingerprint(program.reference) ||
+           DifferentialOracle::vote(program.observations).outcome != DifferentialOracle::Outcome::Agree) {
+           return;
+       }
+       // Only builds of stages that are compared get timed; matrix rows
+       // pair up by compiler and level.
+       std::set<std::string> stages;
+       for (const auto& config : program.configs) {
+           stages.insert(stageOf(config));
+       }
+       std::set<std::string> compared = RunCostOracle::comparedStages(stages);
+       if (compared.empty()) {
+           return;
+       }
+       std::vector<RunCostOracle::Measurement> measurements;
+       for (size_t i = 0; i < program.configs.size(); i++) {
+           if (!program.observations[i].ran || program.observations[i].timedOut) {
+               return;
+           }
+           const CompilerConfig& config = program.configs[i];
+           if (!compared.count(stageOf(config))) {
+               continue;
+           }
+           measurements.push_back(RunCostOracle::measure(executableFor(program, i), config.name,
+                                                         commandFor(config, program.source), perfRuns,
+                                                         deadlineFor(program, i)));
+           measurements.back().stage = stageOf(config);
+       }
+       timed++;
+       program.slowBuilds = RunCostOracle::compare(program.source, measurements);
+   }
+
+   void judge(Program& program) {
+       for (size_t i = 0; i < program.configs.size(); i++) {
+           std::error_code ec;
+           fs::remove(executableFor(program, i), ec);
+       }
+       tested++;
+
+       std::ostringstream report;
+       report << "Processing: " << program.source << std::endl;
+       const DifferentialOracle::Observation& rerun = program.observations[program.referenceConfig];
+       DifferentialOracle::Verdict verdict;
+       if (program.cleanSeconds < 0) {
+           unusable++;
+           report << "  Oracle: skipped (" << referenceName
+                  << (program.built[program.referenceConfig] ? " run did not finish" : " build failed") << ")"
+                  << std::endl;
+       } else if (rerun.ran && DifferentialOracle::fingerprint(rerun) !=
+                                   DifferentialOracle::fingerprint(program.reference)) {
+           nondeterministic++;
+           report << "  Oracle: skipped (nondeterministic: two " << referenceName << " runs disagree)"
+                  << std::endl;
+       } else {
+           verdict = DifferentialOracle::vote(program.observations);
+           switch (verdict.outcome) {
+           case DifferentialOracle::Outcome::Agree:
+               agreed++;
+               report << "  Oracle: " << verdict.voters << " builds agree" << std::endl;
+               for (const auto& finding : program.slowBuilds) {
+                   report << "  MISSED OPTIMIZATION SUSPECTED: " << RunCostOracle::describe(finding) << std::endl;
+               }
+               break;
+           case DifferentialOracle::Outcome::Divergent:
+               divergent++;
+               for (const auto& [config, symptom] : verdict.divergent) {
+                   report << "  MISCOMPILATION SUSPECTED for " << config << ": " << symptom << " ("
+                          << verdict.majorityVotes << " of " << verdict.voters << " builds agree)" << std::endl;
+               }
+               break;
+           case DifferentialOracle::Outcome::NoMajority:
+               noMajority++;
+               report << "  Oracle: no majority among " << verdict.voters << " builds" << std::endl;
+               break;
+           case DifferentialOracle::Outcome::Unusable:
+               unusable++;
+               report << "  Oracle: skipped (only " << verdict.voters << " builds ran)" << std::endl;
+               break;
+           }
+       }
+
+       std::lock_guard<std::mutex> lock(outputMutex);
+       std::cout << report.str();
+       missedOptimizations.insert(missedOptimizations.end(), program.slowBuilds.begin(), program.slowBuilds.end());
+       if (verdict.outcome == DifferentialOracle::Outcome::Divergent ||
+           verdict.outcome == DifferentialOracle::Outcome::NoMajority) {
+           logMiscompilation(program, verdict);
+       }
+   }
+
+   // Called with outputMutex held.
+   void logMiscompilation(const Program& program, const DifferentialOracle::Verdict& verdict) {
+       std::ofstream logFile("miscompilations.log", std::ios::app);
+       if (!logFile.is_open()) {
+           std::cerr << "Failed to open miscompilations.log file" << std::endl;
+           return;
+       }
+       logFile << "=== " << (verdict.outcome == DifferentialOracle::Outcome::Divergent
+                               ? "MISCOMPILATION SUSPECTED" : "NO MAJORITY") << " ===" << std::endl;
+       logFile << "File: " << program.source << std::endl;
+       if (!verdict.majority.empty()) {
+           logFile << "Majority (" << verdict.majorityVotes << " of " << verdict.voters << "): "
+                   << verdict.majority << std::endl;
+       }
+       for (const auto& [config, symptom] : verdict.divergent) {
+           logFile << "Divergent: " << config << " - " << symptom << std::endl;
+       }
+       for (size_t i = 0; i < program.configs.size(); i++) {
+           const DifferentialOracle::Observation& observation = program.observations[i];
+           if (!observation.ran) {
+               continue;
+           }
+           logFile << "--- " << commandFor(program.configs[i], program.source) << ": " << DifferentialOracle::fingerprint(observation)
+                   << std::endl << DifferentialOracle::quotedExcerpt(observation) << std::endl;
+       }
+       logFile << "===============================" << std::endl << std::endl;
+   }
+
+   // Per program: the builds (compile slots), the reference run, then the
+   // other runs (run slots), the timing (one program at a time) and the
+   // vote.
+   void runGraph(std::vector<std::unique_ptr<Program>>& programs) {
+       size_t cpus = TaskGraph::availableCpus();
+       TaskGraph graph;
+       size_t compile = graph.addResource(jobs ? jobs : cpus);
+       size_t running = graph.addResource(jobs ? jobs : cpus);
+       size_t timing = graph.addResource(1);
+       for (auto& entry : programs) {
+           Program* program = entry.get();
+           program->executableBase = workDir + "/" + fs::path(program->source).stem().string();
+           program->configs = configsFor(program->source);
+           size_t count = program->configs.size();
+           program->built.assign(count, 0);
+           program->observations.resize(count);
+           program->referenceConfig = 0;
+           while (program->referenceConfig < count && program->configs[program->referenceConfig].name != referenceName) {
+               program->referenceConfig++;
+           }
+           builds += count;
+           std::vector<TaskGraph::TaskId> compiled;
+           for (size_t i = 0; i < count; i++) {
+               compiled.push_back(graph.addTask(compile, [this, program, i] {
+                   program->built[i] =
+                       compileConfig(program->configs[i], program->source, executableFor(*program, i));
+               }));
+           }
+           TaskGraph::TaskId measured =
+               graph.addTask(running, [this, program] { measureReference(*program); }, compiled);
+           std::vector<TaskGraph::TaskId> runs;
+           for (size_t i = 0; i < count; i++) {
+               runs.push_back(graph.addTask(running, [this, program, i] { runConfig(*program, i); }, {measured}));
+           }
+           if (perfRuns > 0) {
+               runs = {graph.addTask(timing, [this, program] { timeBuilds(*program); }, runs)};
+           }
+           graph.addTask(compile, [this, program] { judge(*program); }, runs);
+       }
+       graph.run(jobs);
+       budget.save();
+       crashBuckets.save();
+       compileOutliers = compileCost.findOutliers();
+       CompileCostOracle::log(compileOutliers, "compile_outliers.log");
+       compileCost.save();
+       RunCostOracle::log(missedOptimizations, "missed_optimizations.log");
+   }
+
+public:
+   // Matched case-insensitively against compiler output.
+   static inline const std::vector<std::string> crashPatterns = {
        "Segmentation fault",
        "LLVM ERROR:",
        "internal compiler error",
@@ -52,21 +614,50 @@ private:
        "Aborted"
    };
 
-   bool isCompilerCrash(const std::string& output, int exitCode) {
-       for (const auto& pattern : crashPatterns) {
-           std::regex regex(pattern, std::regex::icase);
-           if (std::regex_search(output, regex)) {
-               return true;
+   // Runs one build in the sandbox; generated programs are not trusted.
+   static DifferentialOracle::Observation runBuild(const std::string& executable, const std::string& config,
+                                                   double deadline, double& wallSeconds) {
+       ProcessRunner::Options options;
+       options.timeoutSeconds = deadline;
+       options.cpuSeconds = deadline;
+       options.sandbox = Sandbox::forGeneratedBinary(false);
+       ProcessRunner::Result result = ProcessRunner::run({executable}, options);
+
+       DifferentialOracle::Observation observation;
+       observation.config = config;
+       observation.ran = result.started;
+       observation.timedOut = result.timedOut || result.cpuLimitHit;
+       observation.exitCode = result.exitCode;
+       observation.signal = result.signal;
+       observation.outputHash = DifferentialOracle::hashOutput(result.outHash);
+       observation.excerpt = result.out.substr(0, 200);
+       wallSeconds = result.wallSeconds;
+       return observation;
+   }
+
+   // All crash patterns in one automaton, built on first use.
+   static const PatternMatcher& crashMatcher() {
+       static const PatternMatcher matcher = [] {
+           PatternMatcher built;
+           for (const auto& pattern : crashPatterns) {
+               built.add(0, pattern, true);
            }
-       }
-       
-       if (WIFSIGNALED(exitCode)) {
+           built.compile();
+           return built;
+       }();
+       return matcher;
+   }
+
+   // Whether a failed compile crashed rather than rejected the program.
+   static bool isCompilerCrash(const std::string& output, int exitCode) {
+       if (crashMatcher().scan(output)) {
            return true;
        }
-       
+
        // Special case for abnormal exit codes that might indicate crashes
        // Normal compilation errors usually exit with 1
        // Exit codes >= 128 often indicate crashes or signal termination
+       // (ProcessRunner reports a signal as 128 + signal number)
        if (exitCode > 1 && exitCode != 255) {  
            return true;
        }
@@ -74,97 +665,135 @@ private:
        return false;
    }
 
-   bool executeCommand(const std::string& command, std::string& output, int& exitCode) {
-       std::array<char, 128> buffer;
-       output.clear();
-       FILE* pipe = popen((command + " 2>&1").c_str(), "r");
-       if (!pipe) {
-           std::cerr << "Error executing command" << std::endl;
-           exitCode = -1;
-           return false;
-       }
-       while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-           output += buffer.data();
-       }
-       exitCode = pclose(pipe);
-       if (WIFSIGNALED(exitCode)) {
-           int signal = WTERMSIG(exitCode);
-           std::string signalName;
-           switch (signal) {
-               case SIGSEGV: signalName = "SIGSEGV (Segmentation fault)"; break;
-               case SIGABRT: signalName = "SIGABRT (Aborted)"; break;
-               case SIGBUS: signalName = "SIGBUS (Bus error)"; break;
-               case SIGILL: signalName = "SIGILL (Illegal instruction)"; break;
-               case SIGFPE: signalName = "SIGFPE (Floating point exception)"; break;
-               default: signalName = "Signal " + std::to_string(signal); break;
-           }
-           output += "\nProcess terminated by signal: " + signalName;
-           return false;
+   // Above one, only compiler crashes and hangs are looked for, with up
+   // to `size` programs per compiler invocation.
+   void setBatchSize(size_t size) { batchSize = std::max<size_t>(size, 1); }
+   void setJobs(size_t count) { jobs = count; }
+   void setWorkDir(const std::string& dir) { workDir = dir; }
+   // Compile with -ftime-report so that compile cost outliers are
+   // bucketed by their dominant pass.
+   void setTimeReport(bool enabled) { timeReport = enabled; }
+   // Times the builds of every program they agree on, `runs` times each
+   // after a warm-up, and reports missed optimizations.
+   void setPerfRuns(size_t runs) { perfRuns = runs; }
+
+   void setCompileTimeout(double seconds) {
+       if (seconds > 0) {
+           compileTimeout = seconds;
        }
-       return exitCode == 0;
    }
 
-   void logBug(const std::string& sourceFile, const std::string& compiler, const std::string& output) {
-       std::ofstream logFile("bugs.log", std::ios::app);
-       if (!logFile.is_open()) {
-           std::cerr << "Failed to open bugs.log file" << std::endl;
-           return;
-       }
-       logFile << "=== COMPILER CRASH DETECTED ===" << std::endl;
-       logFile << "File: " << sourceFile << std::endl;
-       logFile << "Compiler: " << compiler << std::endl;
-       logFile << "Error output:" << std::endl;
-       logFile << output << std::endl;
-       logFile << "===============================" << std::endl << std::endl;
-       logFile.close();
+   // Replaces the eight fixed configurations by `perProgram` builds
+   // drawn from a pairwise flag matrix; promptDir holds the prompt files
+   // with each program's sampled flags.
+   void useFlagMatrix(size_t perProgram, const std::string& prompts, uint32_t seed = 1) {
+       matrix = std::make_unique<FlagMatrix>(std::vector<std::string>{"gcc", "clang"}, seed);
+       matrixBudget = perProgram;
+       promptDir = prompts;
+       matrix->printSummary();
    }
 
-public:
    void processSourceFile(const std::string& sourcePath) {
        if (!fs::exists(sourcePath)) {
            std::cerr << "Source file not found: " << sourcePath << std::endl;
            return;
        }
-       std::string executableBase = "../test/" + fs::path(sourcePath).stem().string();
-       
-       fs::create_directories("../test");
-
-       for (const auto& config : configs) {
-           std::string executablePath = executableBase + "_" + config.name;
-           std::string compileCommand = config.command + " " + sourcePath + " -o " + executablePath;
-
-           std::string compileOutput;
-           int exitCode;
-           bool compileSuccess = executeCommand(compileCommand, compileOutput, exitCode);
-           
-           if (!compileSuccess && isCompilerCrash(compileOutput, exitCode)) {
-               std::cout << "COMPILER CRASH DETECTED for " << config.name << " on file " << sourcePath << std::endl;
-               std::cout << "Exit code: " << exitCode << std::endl;
-               
-               std::string enhancedOutput = "Exit code: " + std::to_string(exitCode) + "\n" + compileOutput;
-               logBug(sourcePath, config.command, enhancedOutput);
-           }
-       }
+       fs::create_directories(workDir);
+       std::vector<std::unique_ptr<Program>> programs;
+       programs.push_back(std::make_unique<Program>());
+       programs.back()->source = sourcePath;
+       runGraph(programs);
    }
 
-   void processAllFiles() {
+   // Every C and C++ source in dir; with a batch size above one only
+   // compiler crashes are looked for (the batches are not linked).
+   bool processDirectory(const std::string& dir) {
        try {
            std::ofstream logFile("bugs.log", std::ios::trunc);
            logFile << "=== Compiler Crash Bug Log ===" << std::endl;
            logFile << "Date: " << __DATE__ << " " << __TIME__ << std::endl;
            logFile << "=============================\n\n";
            logFile.close();
+           std::ofstream miscompilationLog("miscompilations.log", std::ios::trunc);
+           miscompilationLog << "=== Miscompilation Log ===" << std::endl << std::endl;
+           miscompilationLog.close();
+           std::ofstream("crash_duplicates.tsv", std::ios::trunc).close();
+           std::ofstream("compile_outliers.log", std::ios::trunc).close();
+           std::ofstream("missed_optimizations.log", std::ios::trunc).close();
 
-           for (const auto& entry : fs::directory_iterator("../correct_code")) {
-               if (entry.path().extension() == ".c") {
-                   std::cout << "Processing: " << entry.path().string() << std::endl;
-                   processSourceFile(entry.path().string());
+           std::vector<std::string> sources;
+           for (const auto& entry : fs::directory_iterator(dir)) {
+               std::string extension = entry.path().extension().string();
+               if (entry.is_regular_file() && (extension == ".c" || extension == ".cpp")) {
+                   sources.push_back(entry.path().string());
                }
            }
+           std::sort(sources.begin(), sources.end());
+           fs::create_directories(workDir);
+           if (batchSize > 1) {
+               processBatched(sources);
+               std::error_code ec;
+               fs::remove(workDir, ec);  // only when empty
+               return true;
+           }
+
+           std::vector<std::unique_ptr<Program>> programs;
+           for (const auto& source : sources) {
+               programs.push_back(std::make_unique<Program>());
+               programs.back()->source = source;
+           }
+           auto start = std::chrono::steady_clock::now();
+           runGraph(programs);
+           double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+           printSummary(seconds);
+           std::error_code ec;
+           fs::remove(workDir, ec);  // only when empty
        } catch (const fs::filesystem_error& e) {
            std::cerr << "Filesystem error: " << e.what() << std::endl;
+           return false;
+       }
+       return true;
+   }
+
+   void processAllFiles() { processDirectory("../correct_code"); }
+
+   static double defaultCompileTimeout() {
+       const char* value = std::getenv("REFUZZER_COMPILE_TIMEOUT");
+       double seconds = value ? std::atof(value) : 0;
+       return seconds > 0 ? seconds : 60.0;
+   }
+
+   void printHangs() {
+       if (hangs + slowCompiles > 0) {
+           std::cout << "  compiler hangs: " << hangs << " (bugs.log), compiles that finished only on retry: "
+                     << slowCompiles << std::endl;
+       }
+   }
+
+   void printCrashBuckets() {
+       if (crashBuckets.getNewBuckets() + crashBuckets.getDuplicates() > 0) {
+           // Hangs are bucketed with the crashes.
+           std::cout << (hangs > 0 ? "  compiler crashes and hangs: " : "  compiler crashes: ")
+                     << crashBuckets.getNewBuckets() << " new buckets (bugs.log), "
+                     << crashBuckets.getDuplicates() << " in known buckets (crash_duplicates.tsv)" << std::endl;
        }
    }
+
+   void printSummary(double seconds) {
+       std::ostringstream summary;
+       summary << std::fixed << std::setprecision(1);
+       summary << "Differential testing: " << tested << " programs, " << builds << " builds in "
+               << seconds << "s (" << (seconds > 0 ? tested * 60.0 / seconds : 0) << " programs/minute)"
+               << std::endl;
+       summary << "  agree: " << agreed << ", divergent: " << divergent << ", no majority: " << noMajority
+               << ", nondeterministic: " << nondeterministic << ", skipped: " << unusable << std::endl;
+       std::cout << summary.str();
+       printCrashBuckets();
+       printHangs();
+       CompileCostOracle::printSummary(compileOutliers);
+       RunCostOracle::printSummary(missedOptimizations, timed);
+       budget.printStats();
+   }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,318 @@
+#ifndef DRIVER_JOB_CACHE_HPP
+#define DRIVER_JOB_CACHE_HPP
+
+#include "cache_utils.hpp"
+#include "process_runner.hpp"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/** Resolves the clang driver's job list (`-###`) once per (compiler,
+ * flags, language) and replays the `-cc1` and linker jobs directly for
+ * every later program, skipping the driver process and its toolchain
+ * detection. Job lists are stored on disk under a key that includes the
+ * compiler identity, so a rebuilt compiler binary gets a fresh
+ * resolution.
+ *
+ * Only lists with a `-cc1` job are used; for other drivers (gcc) callers
+ * fall back to invoking the driver.
+ * */
+class DriverJobCache {
+public:
+  struct Invocation {
+    std::vector<std::vector<std::string>> jobs;
+    std::vector<std::string> temporaries;
+  };
+
+private:
+  using JobList = std::vector<std::vector<std::string>>;
+
+  static constexpr const char *kSourceStem = "__refuzzer_src__";
+  static constexpr const char *kOutputName = "__refuzzer_out__";
+
+  std::string cacheDir;
+  std::mutex mutex;
+  std::map<std::string, JobList> resolved;
+
+  static std::string sourceExtension(const std::string &sourcePath) {
+    std::string ext = std::filesystem::path(sourcePath).extension().string();
+    return ext.empty() ? ".c" : ext;
+  }
+
+  // Splits one `-###` job line into its quoted arguments.
+  static std::vector<std::string> parseJobLine(const std::string &line) {
+    std::vector<std::string> args;
+    size_t i = 0;
+    while (i < line.size()) {
+      while (i < line.size() && line[i] == ' ') {
+        i++;
+      }
+      if (i >= line.size()) {
+        break;
+      }
+      std::string arg;
+      if (line[i] == '"') {
+        i++;
+        while (i < line.size() && line[i] != '"') {
+          if (line[i] == '\\' && i + 1 < line.size()) {
+            i++;
+          }
+          arg += line[i++];
+        }
+        i++;
+      } else {
+        while (i < line.size() && line[i] != ' ') {
+          arg += line[i++];
+        }
+      }
+      args.push_back(arg);
+    }
+    return args;
+  }
+
+  static void replaceAll(std::string &str, const std::string &from,
+                         const std::string &to) {
+    size_t pos = 0;
+    while ((pos = str.find(from, pos)) != std::string::npos) {
+      str.replace(pos, from.size(), to);
+      pos += to.size();
+    }
+  }
+
+  // Runs `compiler flags -### dummy -o out` and turns the job list into a
+  // template with @SRC@, @MAIN@, @OUT@ and @TMPn@ placeholders.
+  bool resolve(const std::string &compiler, const std::string &flags,
+               const std::string &extension, JobList &jobs) {
+    std::filesystem::path dir = std::filesystem::absolute(cacheDir);
+    std::filesystem::create_directories(dir);
+    std::string dummySource =
+        (dir / (std::string(kSourceStem) + extension)).string();
+    std::string dummyOutput = (dir / kOutputName).string();
+    std::ofstream(dummySource, std::ios::app).close();
+
+    std::vector<std::string> argv = ProcessRunner::splitArgs(flags);
+    argv.insert(argv.begin(), compiler);
+    argv.insert(argv.end(), {"-###", dummySource, "-o", dummyOutput});
+    ProcessRunner::Options options;
+    options.mergeStderr = true;
+    ProcessRunner::Result result = ProcessRunner::run(argv, options);
+    if (!result.success()) {
+      return false;
+    }
+    std::string output = result.out;
+
+    std::map<std::string, std::string> temporaries;
+    bool hasCc1 = false;
+    std::istringstream lines(output);
+    std::string line;
+    while (std::getline(lines, line)) {
+      if (line.rfind(" \"", 0) != 0) {
+        continue;
+      }
+      std::vector<std::string> args = parseJobLine(line);
+      for (auto &arg : args) {
+        hasCc1 = hasCc1 || arg == "-cc1";
+        if (arg.find(dummyOutput) != std::string::npos ||
+            arg.find(dummySource) != std::string::npos) {
+          // Also covers derived arguments such as -dumpdir <out>-.
+          replaceAll(arg, dummyOutput, "@OUT@");
+          replaceAll(arg, dummySource, "@SRC@");
+        } else if (arg == std::string(kSourceStem) + extension) {
+          arg = "@MAIN@";
+        } else if (arg.find(std::string(kSourceStem) + "-") !=
+                   std::string::npos) {
+          // Driver temporaries such as /tmp/__refuzzer_src__-1a2b3c.o.
+          if (!temporaries.count(arg)) {
+            temporaries[arg] =
+                "@TMP" + std::to_string(temporaries.size()) + "@" +
+                std::filesystem::path(arg).extension().string();
+          }
+          arg = temporaries[arg];
+        }
+      }
+      jobs.push_back(args);
+    }
+    return hasCc1 && !jobs.empty();
+  }
+
+  std::filesystem::path jobFilePath(const std::string &key) const {
+    return std::filesystem::path(cacheDir) / (key + ".jobs");
+  }
+
+  bool loadJobs(const std::string &key, JobList &jobs) {
+    std::ifstream file(jobFilePath(key));
+    if (!file.is_open()) {
+      return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+      std::vector<std::string> args;
+      std::string arg;
+      std::istringstream fields(line);
+      while (std::getline(fields, arg, '\x1f')) {
+        args.push_back(arg);
+      }
+      if (!args.empty()) {
+        jobs.push_back(args);
+      }
+    }
+    return !jobs.empty();
+  }
+
+  void saveJobs(const std::string &key, const JobList &jobs) {
+    std::string tmpPath =
+        jobFilePath(key).string() + ".tmp" + std::to_string(getpid());
+    std::ofstream file(tmpPath, std::ios::trunc);
+    for (const auto &job : jobs) {
+      for (size_t i = 0; i < job.size(); i++) {
+        file << (i ? "\x1f" : "") << job[i];
+      }
+      file << "\n";
+    }
+    file.close();
+    std::filesystem::rename(tmpPath, jobFilePath(key));
+  }
+
+  bool jobsFor(const std::string &compiler, const std::string &flags,
+               const std::string &extension, JobList &jobs) {
+    std::string key = CacheUtils::hashString(
+        CacheUtils::compilerIdentity(compiler) + "\n" + compiler + "\n" +
+        flags + "\n" + extension);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = resolved.find(key);
+    if (it != resolved.end()) {
+      jobs = it->second;
+      return !jobs.empty();
+    }
+    if (!loadJobs(key, jobs)) {
+      jobs.clear();
+      if (resolve(compiler, flags, extension, jobs)) {
+        saveJobs(key, jobs);
+      } else {
+        jobs.clear();
+      }
+    }
+    // Unusable lists are remembered too, so we do not re-run -### for
+    // every program of a gcc configuration.
+    resolved[key] = jobs;
+    return !jobs.empty();
+  }
+
+public:
+  explicit DriverJobCache(
+      const std::string &dir = CacheUtils::cacheRoot() + "/driver_jobs")
+      : cacheDir(dir) {}
+
+  static bool enabled() {
+    return std::getenv("REFUZZER_NO_DIRECT_CC1") == nullptr;
+  }
+
+  // Fills the concrete jobs for compiling and linking sourcePath into
+  // outputPath. Returns false when the driver has to be used instead.
+  bool instantiate(const std::string &compiler, const std::string &flags,
+                   const std::string &sourcePath, const std::string &outputPath,
+                   Invocation &invocation) {
+    static std::atomic<unsigned long> counter{0};
+    if (!enabled()) {
+      return false;
+    }
+    std::string extension = sourceExtension(sourcePath);
+    JobList jobs;
+    if (!jobsFor(compiler, flags, extension, jobs)) {
+      return false;
+    }
+
+    std::string absSource = std::filesystem::absolute(sourcePath).string();
+    std::string mainName = std::filesystem::path(sourcePath).filename().string();
+    std::string tmpPrefix =
+        (std::filesystem::temp_directory_path() /
+         ("refuzzer-" + std::to_string(getpid()) + "-" +
+          std::to_string(counter++) + "-"))
+            .string();
+
+    invocation.jobs.clear();
+    invocation.temporaries.clear();
+    for (auto job : jobs) {
+      for (auto &arg : job) {
+        if (arg == "@MAIN@") {
+          arg = mainName;
+        } else if (arg.rfind("@TMP", 0) == 0) {
+          size_t end = arg.find('@', 1);
+          std::string temporary =
+              tmpPrefix + arg.substr(4, end - 4) + arg.substr(end + 1);
+          bool known = false;
+          for (const auto &existing : invocation.temporaries) {
+            known = known || existing == temporary;
+          }
+          if (!known) {
+            invocation.temporaries.push_back(temporary);
+          }
+          arg = temporary;
+        } else {
+          replaceAll(arg, "@SRC@", absSource);
+          replaceAll(arg, "@OUT@", outputPath);
+        }
+      }
+      invocation.jobs.push_back(job);
+    }
+    return true;
+  }
+
+  // Runs the jobs in order and stops at the first failing one. Output of
+  // all jobs run is collected; wall time and rusage are summed. The
+  // deadline covers the whole invocation, as it does for the driver: each
+  // job gets what the jobs before it left.
+  static ProcessRunner::Result run(const Invocation &invocation,
+                                   const ProcessRunner::Options &options) {
+    ProcessRunner::Result total;
+    total.started = true;
+    total.exitCode = 0;
+    for (const auto &job : invocation.jobs) {
+      ProcessRunner::Options jobOptions = options;
+      if (options.timeoutSeconds > 0) {
+        jobOptions.timeoutSeconds = options.timeoutSeconds - total.wallSeconds;
+        if (jobOptions.timeoutSeconds <= 0) {
+          total.exitCode = -1;
+          total.timedOut = true;
+          break;
+        }
+      }
+      ProcessRunner::Result result = ProcessRunner::run(job, jobOptions);
+      total.out += result.out;
+      total.err += result.err;
+      total.wallSeconds += result.wallSeconds;
+      total.usage.ru_utime.tv_sec += result.usage.ru_utime.tv_sec;
+      total.usage.ru_utime.tv_usec += result.usage.ru_utime.tv_usec;
+      total.usage.ru_stime.tv_sec += result.usage.ru_stime.tv_sec;
+      total.usage.ru_stime.tv_usec += result.usage.ru_stime.tv_usec;
+      total.usage.ru_maxrss =
+          std::max(total.usage.ru_maxrss, result.usage.ru_maxrss);
+      if (!result.success()) {
+        total.started = result.started;
+        total.exitCode = result.exitCode;
+        total.signal = result.signal;
+        total.timedOut = result.timedOut;
+        break;
+      }
+    }
+    return total;
+  }
+
+  static void cleanup(const Invocation &invocation) {
+    std::error_code ec;
+    for (const auto &temporary : invocation.temporaries) {
+      std::filesystem::remove(temporary, ec);
+    }
+  }
+};
+
+#endif // DRIVER_JOB_CACHE_HPP
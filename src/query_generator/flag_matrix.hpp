@@ -0,0 +1,420 @@
+#ifndef FLAG_MATRIX_HPP
+#define FLAG_MATRIX_HPP
+
+#include "cache_utils.hpp"
+#include "llm_tokens_options.hpp"
+#include "process_runner.hpp"
+#include "task_graph.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/** Compiler flag combinations for differential testing, drawn from
+ * LLMTokensOption's optimization level and compiler flag tables.
+ *
+ * Each compiler gets a pairwise covering array: one factor for the
+ * optimization level and one per flag group (-finline / -fno-inline, the
+ * -fstack-protector variants, ...), whose first level leaves the flag
+ * out. Every pair of levels of two factors appears in at least one row,
+ * which catches the two-flag interactions that exhaustive sweeps cannot
+ * afford. Rows are built greedily (AETG style), so early rows cover the
+ * most pairs; take() hands them out round-robin, interleaving the
+ * compilers, so a corpus covers the whole array a few rows per program.
+ *
+ * Only code generation flags are used. Flags that change floating-point
+ * results (-ffast-math, -Ofast, ...) are left out because the oracle
+ * would report their differences as miscompilations, and so are flags
+ * that need extra inputs or only affect diagnostics. Which flags a
+ * compiler accepts is probed once per compiler build (compile and link
+ * with -Werror) and kept in <cache root>/flag_support.tsv.
+ * */
+class FlagMatrix {
+public:
+  struct Row {
+    std::string compiler;
+    std::string optLevel;
+    std::vector<std::string> flags;
+    // Position in the schedule, for naming builds.
+    size_t index = 0;
+
+    std::string command() const {
+      std::string text = compiler + " " + optLevel;
+      for (const auto &flag : flags) {
+        text += " " + flag;
+      }
+      return text;
+    }
+  };
+
+  struct Factor {
+    std::string name;
+    // Level 0 of a flag group is "" (flag left out).
+    std::vector<std::string> levels;
+  };
+
+private:
+  std::vector<std::string> compilers;
+  std::map<std::string, std::set<std::string>> supported;
+  std::map<std::string, std::vector<Factor>> factors;
+  std::map<std::string, std::vector<Row>> arrays;
+  std::map<std::string, size_t> pairCounts;
+  // Interleaved rows of all compilers and the next one to hand out.
+  std::vector<Row> schedule;
+  size_t cursor = 0;
+
+  static bool usable(const std::string &flag) {
+    static const std::vector<std::string> excluded = {
+        // Results legitimately differ.
+        "-ffast-math", "-funsafe-math-optimizations", "-ffinite-math-only",
+        // Need profiles, plugins or runtime libraries.
+        "-fsanitize", "-fprofile", "-fauto-profile", "-fcs-profile", "-fvtable-verify", "-ftest-coverage",
+        // Diagnostics, dumps and reports.
+        "-fdump", "-fdiagnostics", "-fdebug", "-fanalyzer", "-ftime-report", "-fstack-usage", "-frecord",
+        "-fverbose-asm", "-fno-verbose-asm", "-fshow-column", "-fno-show-column", "-fmax-errors",
+        "-ftree-vectorizer-verbose",
+        // Change the input language, the ABI or take placeholder values.
+        "-fdirectives-only", "-fpreprocessed", "-fleading-underscore", "-ftree-parallelize-loops",
+        "-frandom-seed", "-fwpa"};
+    if (flag.rfind("-f", 0) != 0) {
+      return false;
+    }
+    for (const auto &prefix : excluded) {
+      if (flag.rfind(prefix, 0) == 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Flags in one group are alternatives: -fX and -fno-X, -fX=a and -fX=b.
+  static std::string groupOf(std::string flag) {
+    if (flag.rfind("-fno-", 0) == 0) {
+      flag = "-f" + flag.substr(5);
+    }
+    flag = flag.substr(0, flag.find('='));
+    if (flag.rfind("-fstack-protector", 0) == 0) {
+      return "-fstack-protector";
+    }
+    return flag;
+  }
+
+  static std::string supportPath() { return CacheUtils::cacheRoot() + "/flag_support.tsv"; }
+
+  // Flags (and optimization levels) the compiler accepts without a
+  // warning, probed in parallel for those not in the support file.
+  static std::set<std::string> probe(const std::string &compiler, const std::vector<std::string> &candidates) {
+    std::string identity = CacheUtils::hashString(CacheUtils::compilerIdentity(compiler)).substr(0, 16);
+    std::map<std::string, bool> known;
+    {
+      std::ifstream file(supportPath());
+      std::string line;
+      while (std::getline(file, line)) {
+        std::stringstream fields(line);
+        std::string id, flag;
+        int accepted;
+        if (std::getline(fields, id, '\t') && std::getline(fields, flag, '\t') && fields >> accepted &&
+            id == identity) {
+          known[flag] = accepted != 0;
+        }
+      }
+    }
+
+    std::vector<std::string> missing;
+    for (const auto &flag : candidates) {
+      if (!known.count(flag)) {
+        missing.push_back(flag);
+      }
+    }
+    if (!missing.empty()) {
+      namespace fs = std::filesystem;
+      fs::path dir = fs::temp_directory_path() / ("refuzzer_flag_probe_" + std::to_string(getpid()));
+      fs::create_directories(dir);
+      std::string source = (dir / "probe.cpp").string();
+      std::ofstream(source) << "int main() { return 0; }\n";
+
+      std::mutex mutex;
+      TaskGraph graph;
+      size_t slots = graph.addResource(TaskGraph::availableCpus());
+      for (size_t i = 0; i < missing.size(); i++) {
+        graph.addTask(slots, [&, i] {
+          ProcessRunner::Options options;
+          options.mergeStderr = true;
+          options.timeoutSeconds = 60;
+          std::string output = (dir / ("probe" + std::to_string(i))).string();
+          bool accepted =
+              ProcessRunner::run({compiler, "-x", "c++", missing[i], "-Werror", source, "-o", output}, options)
+                  .success();
+          std::lock_guard<std::mutex> lock(mutex);
+          known[missing[i]] = accepted;
+        });
+      }
+      graph.run();
+      std::error_code ec;
+      fs::remove_all(dir, ec);
+
+      fs::create_directories(CacheUtils::cacheRoot(), ec);
+      std::ofstream file(supportPath(), std::ios::app);
+      if (!file.is_open()) {
+        std::cerr << "Failed to write flag support: " << supportPath() << std::endl;
+      }
+      for (const auto &flag : missing) {
+        file << identity << "\t" << flag << "\t" << (known[flag] ? 1 : 0) << "\n";
+      }
+    }
+
+    std::set<std::string> accepted;
+    for (const auto &flag : candidates) {
+      if (known[flag]) {
+        accepted.insert(flag);
+      }
+    }
+    return accepted;
+  }
+
+public:
+  // Rows of a pairwise covering array over factors with the given level
+  // counts. Each row starts from the first uncovered pair; the other
+  // factors take the level covering the most new pairs, in a random
+  // order, and the best of several candidates is kept.
+  static std::vector<std::vector<size_t>> pairwise(const std::vector<size_t> &levels, uint32_t seed) {
+    size_t count = levels.size();
+    std::vector<std::vector<size_t>> rows;
+    if (count == 0) {
+      return rows;
+    }
+    if (count == 1) {
+      for (size_t level = 0; level < levels[0]; level++) {
+        rows.push_back({level});
+      }
+      return rows;
+    }
+    // Pair (i, a, j, b), i < j, is covered[base[i][j] + a * levels[j] + b].
+    std::vector<std::vector<size_t>> base(count, std::vector<size_t>(count, 0));
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+      for (size_t j = i + 1; j < count; j++) {
+        base[i][j] = total;
+        total += levels[i] * levels[j];
+      }
+    }
+    std::vector<char> covered(total, 0);
+    auto index = [&](size_t i, size_t a, size_t j, size_t b) {
+      return i < j ? base[i][j] + a * levels[j] + b : base[j][i] + b * levels[i] + a;
+    };
+    size_t remaining = total;
+    size_t firstUncovered = 0;
+    std::mt19937 rng(seed);
+    const size_t candidates = 20;
+
+    while (remaining > 0) {
+      while (covered[firstUncovered]) {
+        firstUncovered++;
+      }
+      size_t si = 0, sj = 1;
+      while (!(firstUncovered >= base[si][sj] && firstUncovered < base[si][sj] + levels[si] * levels[sj])) {
+        if (++sj == count) {
+          si++;
+          sj = si + 1;
+        }
+      }
+      size_t offset = firstUncovered - base[si][sj];
+
+      std::vector<size_t> best;
+      size_t bestGain = 0;
+      for (size_t candidate = 0; candidate < candidates; candidate++) {
+        std::vector<size_t> row(count, 0);
+        std::vector<char> assigned(count, 0);
+        row[si] = offset / levels[sj];
+        row[sj] = offset % levels[sj];
+        assigned[si] = assigned[sj] = 1;
+        std::vector<size_t> order;
+        for (size_t f = 0; f < count; f++) {
+          if (!assigned[f]) {
+            order.push_back(f);
+          }
+        }
+        std::shuffle(order.begin(), order.end(), rng);
+        size_t gain = 1;
+        for (size_t f : order) {
+          size_t start = rng() % levels[f];
+          size_t bestLevel = start, bestNew = 0;
+          for (size_t step = 0; step < levels[f]; step++) {
+            size_t level = (start + step) % levels[f];
+            size_t fresh = 0;
+            for (size_t g = 0; g < count; g++) {
+              if (assigned[g] && !covered[index(f, level, g, row[g])]) {
+                fresh++;
+              }
+            }
+            if (fresh > bestNew) {
+              bestNew = fresh;
+              bestLevel = level;
+            }
+          }
+          row[f] = bestLevel;
+          assigned[f] = 1;
+          gain += bestNew;
+        }
+        if (gain > bestGain) {
+          bestGain = gain;
+          best = row;
+        }
+      }
+
+      for (size_t i = 0; i < count; i++) {
+        for (size_t j = i + 1; j < count; j++) {
+          char &cell = covered[index(i, best[i], j, best[j])];
+          if (!cell) {
+            cell = 1;
+            remaining--;
+          }
+        }
+      }
+      rows.push_back(best);
+    }
+    return rows;
+  }
+
+  explicit FlagMatrix(const std::vector<std::string> &compilers = {"gcc", "clang"}, uint32_t seed = 1)
+      : compilers(compilers) {
+    std::vector<std::string> candidates;
+    for (const auto &level : LLMTokensOption::optLevels()) {
+      if (level != "-Ofast") {
+        candidates.push_back(level);
+      }
+    }
+    std::set<std::string> seen;
+    for (const auto &flag : LLMTokensOption::compilerFlagTable()) {
+      if (usable(flag) && seen.insert(flag).second) {
+        candidates.push_back(flag);
+      }
+    }
+
+    for (const auto &compiler : compilers) {
+      if (CacheUtils::resolveExecutable(compiler).empty()) {
+        std::cerr << "Flag matrix: " << compiler << " not found, skipped" << std::endl;
+        continue;
+      }
+      supported[compiler] = probe(compiler, candidates);
+      const std::set<std::string> &accepted = supported[compiler];
+
+      std::vector<Factor> &compilerFactors = factors[compiler];
+      compilerFactors.push_back({"-O", {}});
+      std::map<std::string, size_t> groups;
+      for (const auto &flag : candidates) {
+        if (!accepted.count(flag)) {
+          continue;
+        }
+        if (flag.rfind("-O", 0) == 0) {
+          compilerFactors[0].levels.push_back(flag);
+          continue;
+        }
+        std::string group = groupOf(flag);
+        auto it = groups.find(group);
+        if (it == groups.end()) {
+          it = groups.emplace(group, compilerFactors.size()).first;
+          compilerFactors.push_back({group, {""}});
+        }
+        compilerFactors[it->second].levels.push_back(flag);
+      }
+      if (compilerFactors[0].levels.empty()) {
+        std::cerr << "Flag matrix: " << compiler << " accepts no optimization level, skipped" << std::endl;
+        factors.erase(compiler);
+        continue;
+      }
+
+      std::vector<size_t> levels;
+      size_t pairs = 0;
+      for (size_t i = 0; i < compilerFactors.size(); i++) {
+        levels.push_back(compilerFactors[i].levels.size());
+        for (size_t j = 0; j < i; j++) {
+          pairs += levels[i] * levels[j];
+        }
+      }
+      pairCounts[compiler] = pairs;
+      for (const auto &choice : pairwise(levels, seed)) {
+        Row row;
+        row.compiler = compiler;
+        row.optLevel = compilerFactors[0].levels[choice[0]];
+        for (size_t f = 1; f < compilerFactors.size(); f++) {
+          if (!compilerFactors[f].levels[choice[f]].empty()) {
+            row.flags.push_back(compilerFactors[f].levels[choice[f]]);
+          }
+        }
+        arrays[compiler].push_back(row);
+      }
+    }
+
+    for (size_t i = 0;; i++) {
+      bool any = false;
+      for (const auto &entry : arrays) {
+        if (i < entry.second.size()) {
+          schedule.push_back(entry.second[i]);
+          schedule.back().index = schedule.size() - 1;
+          any = true;
+        }
+      }
+      if (!any) {
+        break;
+      }
+    }
+  }
+
+  bool empty() const { return schedule.empty(); }
+  size_t size() const { return schedule.size(); }
+
+  // The next count rows, wrapping around once the array is used up.
+  std::vector<Row> take(size_t count) {
+    std::vector<Row> rows;
+    for (size_t i = 0; i < count && !schedule.empty(); i++) {
+      rows.push_back(schedule[cursor]);
+      cursor = (cursor + 1) % schedule.size();
+    }
+    return rows;
+  }
+
+  // The configuration a program was generated for (its sampled level and
+  // flag), or false when the compiler does not accept the level. A
+  // sampled flag that is not a usable code generation flag is dropped.
+  bool sampled(const std::string &compiler, const std::string &optLevel, const std::string &flag, Row &row) const {
+    auto it = supported.find(compiler);
+    if (it == supported.end() || !it->second.count(optLevel)) {
+      return false;
+    }
+    row = Row();
+    row.compiler = compiler;
+    row.optLevel = optLevel;
+    if (!flag.empty() && it->second.count(flag)) {
+      row.flags.push_back(flag);
+    }
+    return true;
+  }
+
+  const std::vector<std::string> &getCompilers() const { return compilers; }
+
+  void printSummary() const {
+    for (const auto &[compiler, rows] : arrays) {
+      double exhaustive = 1;
+      for (const auto &factor : factors.at(compiler)) {
+        exhaustive *= factor.levels.size();
+      }
+      std::ostringstream line;
+      line << "Flag matrix for " << compiler << ": " << factors.at(compiler).size() << " factors, " << rows.size()
+           << " rows cover all " << pairCounts.at(compiler) << " level pairs (exhaustive: " << std::setprecision(3)
+           << exhaustive << " combinations)";
+      std::cout << line.str() << std::endl;
+    }
+  }
+};
+
+#endif // FLAG_MATRIX_HPP
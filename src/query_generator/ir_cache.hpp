@@ -0,0 +1,90 @@
+#ifndef IR_CACHE_HPP
+#define IR_CACHE_HPP
+
+#include "artifact_cache.hpp"
+#include "process_runner.hpp"
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/** LLVM bitcode of the corpus programs, emitted once per program and
+ * compiler (and, for optimized(), per opt pipeline) and kept in the
+ * ArtifactCache, so that the opt and llc stages can run many times over a
+ * seed without compiling it again.
+ *
+ * The bitcode is unoptimized but not optnone (-O0 -Xclang
+ * -disable-O0-optnone), so that every pass still applies to it.
+ * */
+class IrCache {
+private:
+  ArtifactCache cache;
+  double timeoutSeconds;
+
+  // Looks key up, or runs argv to produce output and stores the outcome.
+  bool produce(const std::string &key, const std::vector<std::string> &argv, const std::string &output,
+               const std::string &what) {
+    ArtifactCache::Entry entry;
+    if (!cache.lookup(key, entry, output)) {
+      ProcessRunner::Options options;
+      options.mergeStderr = true;
+      options.timeoutSeconds = timeoutSeconds;
+      ProcessRunner::Result result = ProcessRunner::run(argv, options);
+      entry.success = result.success();
+      entry.exitCode = result.exitCode;
+      entry.diagnostics = !result.started ? result.err : result.timedOut ? "timed out" : result.out;
+      // A missing tool or a timeout says nothing about the program.
+      if (result.started && !result.timedOut) {
+        cache.store(key, entry, entry.success ? output : "");
+      }
+    }
+    if (!entry.success) {
+      std::cerr << "Failed to " << what << ": " << entry.diagnostics << std::endl;
+    }
+    return entry.success;
+  }
+
+public:
+  static constexpr const char *flags = "-emit-llvm -c -O0 -Xclang -disable-O0-optnone";
+
+  explicit IrCache(double timeout = 60) : timeoutSeconds(timeout) {}
+
+  // The clang driver for a source; also the one to link its objects.
+  static std::string compilerFor(const std::string &sourcePath) {
+    return std::filesystem::path(sourcePath).extension() == ".c" ? "clang" : "clang++";
+  }
+
+  // Writes the bitcode of sourcePath to output; false (with the reason
+  // on stderr) when the program does not compile. Compile errors are
+  // cached too.
+  bool emit(const std::string &sourcePath, const std::string &output) {
+    std::string compiler = compilerFor(sourcePath);
+    std::vector<std::string> argv = ProcessRunner::splitArgs(flags);
+    argv.insert(argv.begin(), compiler);
+    argv.insert(argv.end(), {sourcePath, "-o", output});
+    return produce(cache.key(compiler, flags, sourcePath, "bitcode"), argv, output, "emit bitcode for " + sourcePath);
+  }
+
+  // The bitcode after opt's default<level> pipeline (level "O1" to "O3"),
+  // cached like the unoptimized bitcode it starts from.
+  bool optimized(const std::string &sourcePath, const std::string &level, const std::string &output) {
+    std::string passes = "-passes=default<" + level + ">";
+    std::string key = cache.key(compilerFor(sourcePath), flags, sourcePath,
+                                "optimized bitcode " + passes + "\n" + CacheUtils::compilerIdentity("opt"));
+    ArtifactCache::Entry entry;
+    if (cache.lookup(key, entry, output)) {
+      return entry.success;
+    }
+    std::string unoptimized = output + ".O0.bc";
+    if (!emit(sourcePath, unoptimized)) {
+      return false;
+    }
+    bool success = produce(key, {"opt", passes, unoptimized, "-o", output}, output,
+                           "optimize bitcode for " + sourcePath);
+    std::error_code ec;
+    std::filesystem::remove(unoptimized, ec);
+    return success;
+  }
+};
+
+#endif // IR_CACHE_HPP
@@ -1,11 +1,11 @@
 #ifndef LLM_TOKENS_OPTIONS_HPP
 #define LLM_TOKENS_OPTIONS_HPP
 
-#include <array>
+#include "cache_utils.hpp"
+#include "process_runner.hpp"
+#include <algorithm>
 #include <chrono>
-#include <cstdio>
 #include <iostream>
-#include <memory>
 #include <random>
 #include <sstream>
 #include <stdexcept>
@@ -3778,9 +3778,11 @@ private:
       "z format modifier",
       "zero"};
 
-  std::vector<std::string> optLevel = {"-O0", "-O1",    "-O2", "-O3",
-                                       "-Os", "-Ofast", "-Og", "-Oz"};
-  std::vector<std::string> compilerFlags = {
+  // Static so that FlagMatrix can build flag combinations from them
+  // without enumerating the LLVM passes.
+  static inline const std::vector<std::string> optLevel = {
+      "-O0", "-O1", "-O2", "-O3", "-Os", "-Ofast", "-Og", "-Oz"};
+  static inline const std::vector<std::string> compilerFlags = {
       // Optimization
       "-ftree-vectorize", "-fno-tree-vectorize", "-foptimize-sibling-calls",
       "-fomit-frame-pointer", "-fno-omit-frame-pointer", "-ffunction-sections",
@@ -3949,19 +3951,12 @@ private:
     return parts;
   }
 
-  std::string exec(const char *cmd) {
-    std::array<char, 128> buffer;
-    std::string result;
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd, "r"), pclose);
-
-    if (!pipe) {
-      throw std::runtime_error("popen() failed!");
-    }
-
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-      result += buffer.data();
+  std::string exec(const std::vector<std::string> &argv) {
+    ProcessRunner::Result result = ProcessRunner::run(argv);
+    if (!result.started) {
+      throw std::runtime_error(result.err);
     }
-    return result;
+    return result.out;
   }
 
   /** Instead of manually filling tokens for middle-end
@@ -3976,10 +3971,9 @@ private:
     for (const auto &opt : opt_levels) {
       for (const auto &type : pass_types) {
         try {
-          std::string cmd = "opt -passes='" + type + "<" + opt +
-                            ">' "
-                            "-print-pipeline-passes /dev/null 2>/dev/null";
-          std::string result = exec(cmd.c_str());
+          std::string result =
+              exec({"opt", "-passes=" + type + "<" + opt + ">",
+                    "-print-pipeline-passes", "/dev/null"});
           auto passes = split_passes(result);
           llvmPasses.insert(llvmPasses.end(), passes.begin(), passes.end());
         } catch (const std::runtime_error &e) {
@@ -4003,18 +3997,7 @@ public:
       : rng(std::chrono::steady_clock::now().time_since_epoch().count()) {
     std::cout << "Initializing LLVM passes..." << std::endl;
 
-    FILE *pipe = popen("which opt", "r");
-    if (!pipe) {
-      std::cerr << "Error: Cannot check for opt command" << std::endl;
-      return;
-    }
-    std::array<char, 128> buffer;
-    std::string opt_path;
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-      opt_path += buffer.data();
-    }
-    pclose(pipe);
-
+    std::string opt_path = CacheUtils::resolveExecutable("opt");
     if (opt_path.empty()) {
       std::cerr << "Warning: 'opt' command not found in PATH" << std::endl;
       return;
@@ -4024,10 +4007,15 @@ public:
     initializeLLVMPasses();
   }
   std::string getRandomCompilerOpt() { return getRandomElement(llvmPasses); }
+  const std::vector<std::string> &getLLVMPasses() const { return llvmPasses; }
   std::string getRandomCompilerParts() {
     return getRandomElement(compilerParts);
   }
   std::string getRandomOptLevel() { return getRandomElement(optLevel); }
+  static const std::vector<std::string> &optLevels() { return optLevel; }
+  static const std::vector<std::string> &compilerFlagTable() {
+    return compilerFlags;
+  }
   std::string getRandomCompilerFlag() {
     return getRandomElement(compilerFlags);
   }
@@ -0,0 +1,90 @@
+#ifndef MSAN_TRIAGE_HPP
+#define MSAN_TRIAGE_HPP
+
+#include "sanitizer_report.hpp"
+#include <string>
+#include <vector>
+
+/** Sorts out MSan reports caused by the uninstrumented C++ standard
+ * library. MSan only sees stores made by instrumented code, so bytes that
+ * libstdc++.so wrote (stream extraction, number formatting, string
+ * growth) still look uninitialized when the program later reads them.
+ * Such reports are not actionable: no repair of the program removes them.
+ *
+ * A report is classified as coming from the standard library when
+ *
+ * - its origin stack (where the memory was allocated or last stored)
+ *   passes through the library's shared object, i.e. uninstrumented code
+ *   produced the bytes; or
+ * - the uninitialized value is used inside library code and the origin,
+ *   if known, was not created by a user frame first.
+ *
+ * An uninitialized user variable handed to the library keeps its user
+ * origin and stays actionable. Origins need
+ * -fsanitize-memory-track-origins; without them only the second rule
+ * applies.
+ * */
+class MsanTriage {
+public:
+  struct Verdict {
+    bool actionable = true;
+    std::string reason;
+  };
+
+  static Verdict classify(const SanitizerReport::Finding &finding) {
+    Verdict verdict;
+    if (finding.tool != "MemorySanitizer") {
+      return verdict;
+    }
+    for (const auto &frame : finding.origin) {
+      if (frame.standardLibrary && frame.location.empty() && !frame.module.empty()) {
+        verdict.actionable = false;
+        verdict.reason = "origin in uninstrumented " + moduleName(frame.module);
+        return verdict;
+      }
+    }
+    const SanitizerReport::Frame *use = firstRelevant(finding.stack);
+    const SanitizerReport::Frame *origin = firstRelevant(finding.origin);
+    if (use && use->standardLibrary && !(origin && !origin->standardLibrary)) {
+      verdict.actionable = false;
+      verdict.reason = "use inside " + (use->function.empty() ? moduleName(use->module) : use->function);
+    }
+    return verdict;
+  }
+
+  // True when the output has MSan findings and every finding in it is
+  // non-actionable; reason is the first finding's.
+  static bool onlyStandardLibrary(const std::vector<SanitizerReport::Finding> &findings,
+                                  std::string &reason) {
+    if (findings.empty()) {
+      return false;
+    }
+    for (const auto &finding : findings) {
+      Verdict verdict = classify(finding);
+      if (verdict.actionable) {
+        return false;
+      }
+      if (reason.empty()) {
+        reason = verdict.reason;
+      }
+    }
+    return true;
+  }
+
+private:
+  // The first frame of a stack outside the sanitizer runtime.
+  static const SanitizerReport::Frame *firstRelevant(const std::vector<SanitizerReport::Frame> &stack) {
+    for (const auto &frame : stack) {
+      if (frame.standardLibrary || SanitizerReport::isUserFrame(frame)) {
+        return &frame;
+      }
+    }
+    return nullptr;
+  }
+
+  static std::string moduleName(const std::string &module) {
+    return module.substr(module.find_last_of('/') + 1);
+  }
+};
+
+#endif // MSAN_TRIAGE_HPP
@@ -1,7 +1,6 @@
 #ifndef OBJECT_GENERATOR
 #define OBJECT_GENERATOR
 
-#include <array>
 #include <chrono>
 #include <cstdlib>
 #include <filesystem>
@@ -12,11 +11,17 @@
 #include <string>
 #include <cstring>
 #include <sys/stat.h>
+#include "artifact_cache.hpp"
+#include "batch_compiler.hpp"
+#include "pch_cache.hpp"
+#include "process_runner.hpp"
 
 class GenerateObject {
 private:
   std::string objectFile;
   std::string workingDir;
+  PchCache pchCache;
+  ArtifactCache artifactCache;
 
   bool createDirectory(const std::string &dir) {
     try {
@@ -115,27 +120,28 @@ private:
     return logDir + "/" + baseName + ".log";
   }
 
-  bool executeCommand(const std::string &command, std::string &output,
-                      const std::string &sourceFile, const std::string &dirName) {
-    std::array<char, 128> buffer;
-    output.clear();
-    std::string cmd = command + " 2>&1";
-    
-    std::cout << "Executing: " << command << std::endl;
-    
-    FILE *pipe = popen(cmd.c_str(), "r");
-    if (!pipe) {
-      logError("executeCommand",
-               "Failed to create pipe for command: " + command, sourceFile, dirName);
-      return false;
+  // Runs `<commandLine> <sourceFile> [-o outputFile]` without a shell.
+  bool executeCommand(const std::string &commandLine, std::string &output,
+                      const std::string &sourceFile, const std::string &dirName,
+                      const std::string &outputFile = "") {
+    std::vector<std::string> command = ProcessRunner::splitArgs(commandLine);
+    command.push_back(sourceFile);
+    if (!outputFile.empty()) {
+      command.insert(command.end(), {"-o", outputFile});
     }
+    std::cout << "Executing: " << ProcessRunner::describe(command) << std::endl;
 
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-      output += buffer.data();
+    ProcessRunner::Options options;
+    options.mergeStderr = true;
+    ProcessRunner::Result result = ProcessRunner::run(command, options);
+    output = result.out;
+    if (!result.started) {
+      logError("executeCommand",
+               "Failed to run command: " + ProcessRunner::describe(command) + "\n" + result.err,
+               sourceFile, dirName);
+      return false;
     }
-
-    int status = pclose(pipe);
-    return status == 0;
+    return result.success();
   }
 
 public:
@@ -147,6 +153,160 @@ public:
     return workingDir;
   }
 
+  // Fast first tier: parse and type-check only. Failures are logged to
+  // <dirName>/log, which is where the repair step picks them up.
+  bool checkSyntax(const std::string &filename, const std::string &dirName = "../test") {
+    std::string cacheKey = artifactCache.key("clang++", "-fsyntax-only", filename);
+    ArtifactCache::Entry cached;
+    std::string commandOutput;
+    bool passed;
+    if (artifactCache.lookup(cacheKey, cached)) {
+      passed = cached.success;
+      commandOutput = cached.diagnostics;
+    } else {
+      std::string pchFlags = pchCache.includeFlags("clang++", "", filename);
+      passed = executeCommand("clang++ -fsyntax-only " + pchFlags, commandOutput,
+                              filename, dirName);
+      if (!passed && !pchFlags.empty() && PchCache::isPchFailure(commandOutput)) {
+        passed = executeCommand("clang++ -fsyntax-only", commandOutput, filename, dirName);
+      }
+      artifactCache.store(cacheKey, {passed, passed ? 0 : 1, passed ? "ok" : "error", commandOutput});
+    }
+
+    if (!passed) {
+      logError("clang syntax check",
+               commandOutput.empty() ? "Syntax check failed with unknown error" : commandOutput,
+               filename, dirName);
+      std::cerr << "Syntax check failed for: " << filename << std::endl;
+    }
+    return passed;
+  }
+
+  // Batched first tier: checks up to batchSize programs per driver
+  // invocation. Returns one verdict per file, in input order. Verdicts are
+  // cached per file like the single-file tier's, and only files without
+  // one go into batches.
+  std::vector<bool> checkSyntax(const std::vector<std::string> &filenames,
+                                const std::string &dirName, size_t batchSize) {
+    std::vector<bool> verdicts;
+    if (batchSize <= 1) {
+      for (const auto &filename : filenames) {
+        verdicts.push_back(checkSyntax(filename, dirName));
+      }
+      return verdicts;
+    }
+
+    verdicts.assign(filenames.size(), false);
+    std::vector<std::string> pending;
+    std::vector<size_t> pendingIndex;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      ArtifactCache::Entry cached;
+      if (artifactCache.lookup(artifactCache.key("clang++", "-fsyntax-only", filenames[i]), cached)) {
+        verdicts[i] = cached.success;
+        if (!cached.success) {
+          logError("clang syntax check", cached.diagnostics, filenames[i], dirName);
+        }
+      } else {
+        pending.push_back(filenames[i]);
+        pendingIndex.push_back(i);
+      }
+    }
+    if (pending.empty()) {
+      return verdicts;
+    }
+
+    BatchCompiler batch(batchSize);
+    std::vector<BatchCompiler::Result> results =
+        batch.compile("clang++", "-fsyntax-only", pending, ensureTrailingSlash(dirName) + "object");
+    for (size_t j = 0; j < results.size(); j++) {
+      const BatchCompiler::Result &result = results[j];
+      if (!result.timedOut) {
+        artifactCache.store(artifactCache.key("clang++", "-fsyntax-only", result.source),
+                            {result.success, result.success ? 0 : 1, result.success ? "ok" : "error",
+                             result.diagnostics});
+      }
+      if (!result.success) {
+        logError("clang syntax check", result.diagnostics, result.source, dirName);
+      }
+      verdicts[pendingIndex[j]] = result.success;
+    }
+    return verdicts;
+  }
+
+  // Batched variant of generateObjectFile: compiles up to batchSize
+  // programs per `clang++ -c` invocation into <dirName>/object, then links
+  // each object on its own, so that a program that does not link fails
+  // here as it does unbatched. The linked result replaces the object, as
+  // generateObjectFile leaves it, and is cached under the same key.
+  // Returns the path per file (empty on failure), in input order.
+  std::vector<std::string> generateObjectFiles(const std::vector<std::string> &filenames,
+                                               const std::string &dirName, size_t batchSize) {
+    std::vector<std::string> objectPaths(filenames.size());
+    if (!createObjectDirectory(dirName)) {
+      return objectPaths;
+    }
+    workingDir = dirName;
+
+    std::vector<std::string> pending;
+    std::vector<size_t> pendingIndex;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      std::string objectFilePath = generateObjectFilename(filenames[i], dirName);
+      ArtifactCache::Entry cached;
+      if (artifactCache.lookup(artifactCache.key("clang++", "", filenames[i]), cached, objectFilePath)) {
+        if (cached.success) {
+          objectPaths[i] = objectFilePath;
+        } else {
+          logError("clang compilation", cached.diagnostics, filenames[i], dirName);
+        }
+      } else {
+        pending.push_back(filenames[i]);
+        pendingIndex.push_back(i);
+      }
+    }
+
+    BatchCompiler batch(batchSize);
+    std::vector<BatchCompiler::Result> results =
+        pending.empty() ? std::vector<BatchCompiler::Result>()
+                        : batch.compile("clang++", "", pending, ensureTrailingSlash(dirName) + "object");
+    for (size_t j = 0; j < results.size(); j++) {
+      const BatchCompiler::Result &result = results[j];
+      bool built = result.success;
+      std::string diagnostics = result.diagnostics;
+      if (built) {
+        std::string linked = result.objectPath + ".link";
+        built = executeCommand("clang++", diagnostics, result.objectPath, dirName, linked);
+        std::error_code ec;
+        if (built) {
+          std::filesystem::rename(linked, result.objectPath, ec);
+          built = !ec;
+        } else {
+          std::filesystem::remove(linked, ec);
+        }
+        if (!built) {
+          std::filesystem::remove(result.objectPath, ec);
+        }
+      }
+      if (!result.timedOut) {
+        artifactCache.store(artifactCache.key("clang++", "", result.source),
+                            {built, built ? 0 : 1, built ? "ok" : "error", diagnostics},
+                            built ? result.objectPath : "");
+      }
+      if (!built) {
+        logError("clang compilation", diagnostics, result.source, dirName);
+      } else {
+        std::string logFile = getLogFilePath(result.source, dirName);
+        if (std::filesystem::exists(logFile)) {
+          std::filesystem::remove(logFile);
+        }
+        objectPaths[pendingIndex[j]] = result.objectPath;
+      }
+    }
+    std::cout << "Compiled " << filenames.size() << " files in "
+              << batch.getInvocationCount() << " compiler invocations ("
+              << filenames.size() - pending.size() << " cached)" << std::endl;
+    return objectPaths;
+  }
+
   std::string generateObjectFile(const std::string &filename, const std::string &dirName = "../test") {
     if (filename.empty()) {
       logError("generateObjectFile", "Source file path is empty",
@@ -171,10 +331,29 @@ public:
     
     std::string logFile = getLogFilePath(filename, dirName);
 
-    std::string finalClangCmd = "clang++ " + filename + " -o " + objectFilePath;
+    std::string cacheKey = artifactCache.key("clang++", "", filename);
+    ArtifactCache::Entry cached;
+    if (artifactCache.lookup(cacheKey, cached, objectFilePath)) {
+      std::cout << "Cache hit for: " << filename << std::endl;
+      if (!cached.success) {
+        logError("clang compilation", cached.diagnostics, filename, dirName);
+        std::cerr << "Compilation failed for: " << filename << " (cached)" << std::endl;
+        return "";
+      }
+      return objectFilePath;
+    }
+
+    std::string pchFlags = pchCache.includeFlags("clang++", "", filename);
+    std::string finalClangCmd = "clang++ " + pchFlags;
 
     std::string commandOutput;
-    if (!executeCommand(finalClangCmd, commandOutput, filename, dirName)) {
+    bool compiled = executeCommand(finalClangCmd, commandOutput, filename, dirName, objectFilePath);
+    if (!compiled && !pchFlags.empty() && PchCache::isPchFailure(commandOutput)) {
+      compiled = executeCommand("clang++", commandOutput, filename, dirName, objectFilePath);
+    }
+    artifactCache.store(cacheKey, {compiled, compiled ? 0 : 1, compiled ? "ok" : "error", commandOutput},
+                        compiled ? objectFilePath : "");
+    if (!compiled) {
       if (!commandOutput.empty()) {
         logError("clang compilation", commandOutput, filename, dirName);
       } else {
@@ -0,0 +1,296 @@
+#ifndef PATTERN_MATCHER_HPP
+#define PATTERN_MATCHER_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** Classifies text by many patterns in one pass. Patterns are added once
+ * per category (at most 64), compiled, and then every scan() reads the
+ * text once and returns the set of categories that matched.
+ *
+ * Literal patterns, case-sensitive or not, go into one Aho-Corasick
+ * automaton whose transitions are a dense table over the byte classes
+ * that occur in the patterns, so the scan costs one lookup per byte.
+ * Regular expressions are the fallback: a regex runs over the text only
+ * when a literal it cannot match without (its anchor) was seen, or always
+ * when it has none. A scan stops as soon as every wanted category
+ * matched.
+ * */
+class PatternMatcher {
+public:
+  using Categories = uint64_t;
+  static constexpr size_t maxCategories = 64;
+
+private:
+  struct Literal {
+    std::string text;
+    size_t category;
+    bool ignoreCase;
+    // Index into gated when this literal is a regex's anchor.
+    int gate = -1;
+  };
+
+  struct Gated {
+    std::regex regex;
+    size_t category;
+  };
+
+  std::vector<Literal> literals;
+  std::vector<Gated> gated;
+  // Regexes without a usable anchor.
+  std::vector<Gated> ungated;
+  Categories registered = 0;
+
+  // Automaton over byte classes; class 0 is every byte that occurs in no
+  // pattern. Once built, table entries hold the target state's row
+  // offset (state * classes) with terminalBit set when a literal ends
+  // there.
+  static constexpr uint32_t terminalBit = 0x80000000u;
+  uint8_t byteClass[256] = {};
+  size_t classes = 1;
+  std::vector<uint32_t> table;
+  // Per state: categories reached without further checks, and whether
+  // some literal ending here needs one (case or regex gate).
+  std::vector<Categories> direct;
+  std::vector<uint8_t> needsCheck;
+  std::vector<std::vector<uint32_t>> outputs;
+  bool compiled = false;
+
+  static unsigned char fold(unsigned char c) { return static_cast<unsigned char>(std::tolower(c)); }
+
+  static bool isMeta(char c) { return std::string_view("\\^$.|?*+()[]{}").find(c) != std::string_view::npos; }
+
+  // The longest run of plain characters every match of pattern must
+  // contain, or "" when none can be found safely (alternation, or runs
+  // only inside groups and classes).
+  static std::string requiredLiteral(const std::string &pattern) {
+    if (pattern.find('|') != std::string::npos) {
+      return "";
+    }
+    std::string best, run;
+    int depth = 0;
+    auto flush = [&] {
+      if (run.size() > best.size()) {
+        best = run;
+      }
+      run.clear();
+    };
+    for (size_t i = 0; i < pattern.size(); i++) {
+      char c = pattern[i];
+      if (c == '\\') {
+        flush();
+        i++;
+      } else if (c == '[') {
+        flush();
+        while (i < pattern.size() && pattern[i] != ']') {
+          i += pattern[i] == '\\' ? 2 : 1;
+        }
+      } else if (c == '(' || c == ')') {
+        flush();
+        depth += c == '(' ? 1 : -1;
+      } else if (c == '?' || c == '*' || c == '{') {
+        // The quantified character is optional.
+        if (!run.empty()) {
+          run.pop_back();
+        }
+        flush();
+      } else if (isMeta(c)) {
+        flush();
+      } else if (depth == 0) {
+        run += c;
+      }
+    }
+    flush();
+    return best;
+  }
+
+  void build() {
+    for (const auto &literal : literals) {
+      for (unsigned char c : literal.text) {
+        unsigned char folded = fold(c);
+        if (byteClass[folded] == 0) {
+          byteClass[folded] = static_cast<uint8_t>(classes++);
+        }
+      }
+    }
+    // Upper-case bytes share the class of their lower-case form;
+    // case-sensitive literals are verified on a hit.
+    for (int c = 0; c < 256; c++) {
+      byteClass[c] = byteClass[fold(static_cast<unsigned char>(c))];
+    }
+
+    std::vector<int32_t> next(classes, -1);
+    outputs.assign(1, {});
+    for (uint32_t id = 0; id < literals.size(); id++) {
+      int32_t state = 0;
+      for (unsigned char c : literals[id].text) {
+        int32_t &target = next[state * classes + byteClass[c]];
+        if (target < 0) {
+          target = static_cast<int32_t>(outputs.size());
+          outputs.push_back({});
+          next.resize(next.size() + classes, -1);
+        }
+        state = next[state * classes + byteClass[c]];
+      }
+      outputs[state].push_back(id);
+    }
+
+    // Breadth-first: failure links, then the full transition table.
+    std::vector<int32_t> failure(outputs.size(), 0);
+    std::deque<int32_t> queue;
+    for (size_t c = 0; c < classes; c++) {
+      int32_t &target = next[c];
+      if (target < 0) {
+        target = 0;
+      } else {
+        queue.push_back(target);
+      }
+    }
+    while (!queue.empty()) {
+      int32_t state = queue.front();
+      queue.pop_front();
+      const std::vector<uint32_t> &inherited = outputs[failure[state]];
+      outputs[state].insert(outputs[state].end(), inherited.begin(), inherited.end());
+      for (size_t c = 0; c < classes; c++) {
+        int32_t &target = next[state * classes + c];
+        int32_t fallback = next[failure[state] * classes + c];
+        if (target < 0) {
+          target = fallback;
+        } else {
+          failure[target] = fallback;
+          queue.push_back(target);
+        }
+      }
+    }
+
+    direct.assign(outputs.size(), 0);
+    needsCheck.assign(outputs.size(), 0);
+    for (size_t state = 0; state < outputs.size(); state++) {
+      for (uint32_t id : outputs[state]) {
+        const Literal &literal = literals[id];
+        if (literal.ignoreCase && literal.gate < 0) {
+          direct[state] |= Categories(1) << literal.category;
+        } else {
+          needsCheck[state] = 1;
+        }
+      }
+    }
+    table.assign(next.size(), 0);
+    for (size_t i = 0; i < next.size(); i++) {
+      table[i] = static_cast<uint32_t>(next[i] * classes) | (outputs[next[i]].empty() ? 0 : terminalBit);
+    }
+    compiled = true;
+  }
+
+public:
+  // Matches literal as is (ASCII case folded with ignoreCase).
+  void addLiteral(size_t category, const std::string &literal, bool ignoreCase = false) {
+    if (category >= maxCategories || literal.empty()) {
+      std::cerr << "PatternMatcher: invalid literal pattern for category " << category << std::endl;
+      return;
+    }
+    literals.push_back({literal, category, ignoreCase});
+    registered |= Categories(1) << category;
+    compiled = false;
+  }
+
+  // An ECMAScript regex, searched like std::regex_search. Patterns
+  // without metacharacters become literals.
+  void add(size_t category, const std::string &pattern, bool ignoreCase = false) {
+    if (std::none_of(pattern.begin(), pattern.end(), isMeta)) {
+      addLiteral(category, pattern, ignoreCase);
+      return;
+    }
+    if (category >= maxCategories) {
+      std::cerr << "PatternMatcher: invalid category " << category << std::endl;
+      return;
+    }
+    auto flags = std::regex::ECMAScript | std::regex::optimize;
+    if (ignoreCase) {
+      flags |= std::regex::icase;
+    }
+    Gated entry{std::regex(pattern, flags), category};
+    std::string anchor = requiredLiteral(pattern);
+    // scan() tracks the anchors of the first 64 in one word.
+    if (anchor.size() < 2 || gated.size() == maxCategories) {
+      ungated.push_back(std::move(entry));
+    } else {
+      gated.push_back(std::move(entry));
+      literals.push_back({anchor, category, ignoreCase, static_cast<int>(gated.size() - 1)});
+    }
+    registered |= Categories(1) << category;
+    compiled = false;
+  }
+
+  void compile() {
+    if (!compiled) {
+      build();
+    }
+  }
+
+  static bool has(Categories hits, size_t category) { return (hits >> category) & 1; }
+
+  // Categories among `wanted` that match text. compile() must have been
+  // called (scan is const so that one matcher can serve many threads).
+  Categories scan(std::string_view text, Categories wanted = ~Categories(0)) const {
+    wanted &= registered;
+    Categories hits = 0;
+    if (!compiled || wanted == 0) {
+      return hits;
+    }
+    // Bit i: gated regex i had its anchor in the text.
+    uint64_t anchorSeen = 0;
+    const uint32_t *rows = table.data();
+    uint32_t entry = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+      entry = rows[(entry & ~terminalBit) + byteClass[static_cast<unsigned char>(text[i])]];
+      if (!(entry & terminalBit)) {
+        continue;
+      }
+      size_t state = (entry & ~terminalBit) / classes;
+      hits |= direct[state];
+      if (needsCheck[state]) {
+        for (uint32_t id : outputs[state]) {
+          const Literal &literal = literals[id];
+          if (has(hits, literal.category)) {
+            continue;
+          }
+          if (!literal.ignoreCase &&
+              text.compare(i + 1 - literal.text.size(), literal.text.size(), literal.text) != 0) {
+            continue;
+          }
+          if (literal.gate >= 0) {
+            anchorSeen |= uint64_t(1) << literal.gate;
+          } else {
+            hits |= Categories(1) << literal.category;
+          }
+        }
+      }
+      if ((hits & wanted) == wanted) {
+        return hits & wanted;
+      }
+    }
+
+    for (size_t i = 0; i < gated.size(); i++) {
+      if (((anchorSeen >> i) & 1) && has(wanted & ~hits, gated[i].category) &&
+          std::regex_search(text.begin(), text.end(), gated[i].regex)) {
+        hits |= Categories(1) << gated[i].category;
+      }
+    }
+    for (const auto &entry : ungated) {
+      if (has(wanted & ~hits, entry.category) && std::regex_search(text.begin(), text.end(), entry.regex)) {
+        hits |= Categories(1) << entry.category;
+      }
+    }
+    return hits & wanted;
+  }
+};
+
+#endif // PATTERN_MATCHER_HPP
@@ -0,0 +1,238 @@
+#ifndef PCH_CACHE_HPP
+#define PCH_CACHE_HPP
+
+#include "cache_utils.hpp"
+#include "process_runner.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/** Builds and reuses precompiled headers for the standard headers that
+ * generated programs include. One PCH exists per (include set, flags,
+ * compiler identity); the program is then compiled with `-include <hdr>`,
+ * which makes both clang (hdr.pch) and gcc (hdr.gch) pick it up.
+ *
+ * A program only gets a PCH when all of its angle-bracket includes come
+ * first, before any macro, conditional, quoted include or code, so that
+ * hoisting them into a prefix header cannot change what they expand to.
+ *
+ * A PCH build has a deadline. Only a compile error marks its key as
+ * failed on disk (until the compiler changes); a build that times out,
+ * is killed or cannot write its output is only given up for this run.
+ * */
+class PchCache {
+private:
+  static constexpr double buildTimeoutSeconds = 120;
+
+  std::string cacheDir;
+  std::mutex buildMutex;
+  // Keys whose build failed for a transient reason in this run.
+  std::set<std::string> failedThisRun;
+
+  static std::string trim(const std::string &str) {
+    size_t first = str.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos)
+      return "";
+    size_t last = str.find_last_not_of(" \t\r\n");
+    return str.substr(first, last - first + 1);
+  }
+
+  static std::string headerLanguage(const std::string &sourcePath) {
+    std::string ext = std::filesystem::path(sourcePath).extension().string();
+    return ext == ".c" ? "c-header" : "c++-header";
+  }
+
+  // Returns the prefix header for the key, building header and PCH on
+  // first use. Empty when the PCH could not be built.
+  std::string ensurePch(const std::string &compiler, const std::string &flags,
+                        const std::string &language,
+                        const std::vector<std::string> &includes) {
+    std::string version = CacheUtils::compilerIdentity(compiler);
+    if (version.empty()) {
+      return "";
+    }
+
+    std::string keyData = compiler + "\n" + version + "\n" + flags + "\n" +
+                          language + "\n";
+    for (const auto &include : includes) {
+      keyData += include + "\n";
+    }
+    std::string key = CacheUtils::hashString(keyData);
+
+    std::filesystem::path dir = std::filesystem::absolute(cacheDir);
+    std::string headerPath = (dir / (key + ".hpp")).string();
+    std::string pchPath =
+        headerPath + (CacheUtils::isClang(compiler) ? ".pch" : ".gch");
+    std::string failedMarker = (dir / (key + ".failed")).string();
+
+    std::lock_guard<std::mutex> lock(buildMutex);
+    if (std::filesystem::exists(pchPath)) {
+      return headerPath;
+    }
+    if (failedThisRun.count(key) || std::filesystem::exists(failedMarker)) {
+      return "";
+    }
+
+    try {
+      std::filesystem::create_directories(dir);
+    } catch (const std::filesystem::filesystem_error &e) {
+      std::cerr << "Error creating PCH cache directory: " << e.what()
+                << std::endl;
+      return "";
+    }
+
+    std::ofstream header(headerPath, std::ios::trunc);
+    if (!header.is_open()) {
+      return "";
+    }
+    for (const auto &include : includes) {
+      header << "#include <" << include << ">\n";
+    }
+    header.close();
+
+    // Build into a temporary name so concurrent runs never see a
+    // half-written PCH.
+    std::string tmpPch = pchPath + ".tmp" + std::to_string(getpid());
+    std::vector<std::string> argv = ProcessRunner::splitArgs(flags);
+    // A syntax-only compile would not write the PCH; the PCH itself is
+    // fine for syntax-only users.
+    argv.erase(std::remove(argv.begin(), argv.end(), "-fsyntax-only"),
+               argv.end());
+    argv.insert(argv.begin(), compiler);
+    argv.insert(argv.end(), {"-x", language, headerPath, "-o", tmpPch});
+    ProcessRunner::Options options;
+    options.mergeStderr = true;
+    options.timeoutSeconds = buildTimeoutSeconds;
+    ProcessRunner::Result result = ProcessRunner::run(argv, options);
+    std::error_code ec;
+    if (!result.success()) {
+      std::cerr << "PCH build failed, compiling without it: "
+                << ProcessRunner::describe(argv) << std::endl;
+      // Exit code 1 is a compile error, which a rebuild would repeat;
+      // timeouts, signals (OOM kills) and other failures may not.
+      if (result.started && !result.timedOut && result.signal == 0 &&
+          result.exitCode == 1) {
+        std::ofstream(failedMarker) << result.out;
+      } else {
+        failedThisRun.insert(key);
+      }
+      std::filesystem::remove(tmpPch, ec);
+      return "";
+    }
+    std::filesystem::rename(tmpPch, pchPath, ec);
+    if (ec) {
+      std::cerr << "PCH build produced no output, compiling without it: "
+                << ProcessRunner::describe(argv) << std::endl;
+      failedThisRun.insert(key);
+      std::filesystem::remove(tmpPch, ec);
+      return "";
+    }
+    std::cout << "Built precompiled header: " << pchPath << std::endl;
+    return headerPath;
+  }
+
+public:
+  explicit PchCache(const std::string &dir = CacheUtils::cacheRoot() + "/pch")
+      : cacheDir(dir) {}
+
+  // Collects the angle-bracket includes of a program. pchSafe is cleared
+  // when anything other than such includes, comments and blank lines
+  // precedes the last of them.
+  static std::vector<std::string> scanIncludes(const std::string &source,
+                                               bool &pchSafe) {
+    std::vector<std::string> includes;
+    pchSafe = true;
+    bool sawOther = false;
+    bool inBlockComment = false;
+
+    std::istringstream stream(source);
+    std::string line;
+    while (std::getline(stream, line)) {
+      std::string code;
+      for (size_t i = 0; i < line.size(); i++) {
+        if (inBlockComment) {
+          if (line.compare(i, 2, "*/") == 0) {
+            inBlockComment = false;
+            i++;
+          }
+        } else if (line.compare(i, 2, "/*") == 0) {
+          inBlockComment = true;
+          i++;
+        } else if (line.compare(i, 2, "//") == 0) {
+          break;
+        } else {
+          code += line[i];
+        }
+      }
+      code = trim(code);
+      if (code.empty()) {
+        continue;
+      }
+
+      if (code[0] == '#') {
+        std::string directive = trim(code.substr(1));
+        if (directive.rfind("include", 0) == 0) {
+          std::string target = trim(directive.substr(7));
+          size_t close = target.find('>');
+          if (!target.empty() && target[0] == '<' &&
+              close != std::string::npos) {
+            if (sawOther) {
+              pchSafe = false;
+            }
+            std::string name = target.substr(1, close - 1);
+            bool seen = false;
+            for (const auto &include : includes) {
+              seen = seen || include == name;
+            }
+            if (!seen) {
+              includes.push_back(name);
+            }
+            continue;
+          }
+        }
+      }
+      sawOther = true;
+    }
+    return includes;
+  }
+
+  // Extra flags (with a trailing space) that make the compile use a
+  // cached PCH, or an empty string when the program has to be compiled
+  // without one.
+  std::string includeFlags(const std::string &compiler,
+                           const std::string &flags,
+                           const std::string &sourcePath) {
+    if (std::getenv("REFUZZER_NO_PCH")) {
+      return "";
+    }
+
+    bool pchSafe = false;
+    std::vector<std::string> includes =
+        scanIncludes(CacheUtils::readFile(sourcePath), pchSafe);
+    if (!pchSafe || includes.empty()) {
+      return "";
+    }
+
+    std::string header =
+        ensurePch(compiler, flags, headerLanguage(sourcePath), includes);
+    if (header.empty()) {
+      return "";
+    }
+    return "-include \"" + header + "\" ";
+  }
+
+  // True when a failed compile should be retried without the PCH.
+  static bool isPchFailure(const std::string &output) {
+    return output.find("precompiled header") != std::string::npos ||
+           output.find("PCH file") != std::string::npos;
+  }
+};
+
+#endif // PCH_CACHE_HPP
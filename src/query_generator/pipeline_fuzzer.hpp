@@ -0,0 +1,342 @@
+#ifndef PIPELINE_FUZZER_HPP
+#define PIPELINE_FUZZER_HPP
+
+#include "crash_buckets.hpp"
+#include "differential_oracle.hpp"
+#include "differential_tester.hpp"
+#include "ir_cache.hpp"
+#include "process_runner.hpp"
+#include "runtime_budget.hpp"
+#include "task_graph.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/** Fuzzes the LLVM optimization pipeline with the corpus: every program
+ * is lowered to bitcode once (IrCache), then run through many `opt`
+ * invocations with random pass pipelines drawn from the passes of the
+ * default pipelines (LLMTokensOption::getLLVMPasses()), whole adaptor
+ * elements as well as the single passes nested in them. No model is
+ * involved, so each seed the LLM produced yields many compiler runs.
+ *
+ * Each pipeline's output is checked for
+ *  - crashes and verifier failures of opt, and crashes of llc on it,
+ *    bucketed with CrashBuckets (only the first of a bucket is logged);
+ *  - hangs: opt or llc still running at the compile deadline;
+ *  - miscompilations: the optimized program, built with llc -O0 and run
+ *    in the sandbox, ends differently or prints something else than the
+ *    unoptimized bitcode built the same way.
+ * Pipelines opt rejects (unknown pass, wrong nesting) are only counted.
+ *
+ * Findings go to pipeline_bugs.log, each with the pipeline that hit it,
+ * so `opt -passes=<pipeline>` on the seed's bitcode reproduces it.
+ * */
+class PipelineFuzzer {
+private:
+  struct Seed {
+    std::string source;
+    std::string base;
+    std::string bitcode;
+    std::vector<std::string> pipelines;
+    DifferentialOracle::Observation reference;
+    double referenceSeconds = -1;
+  };
+
+  std::vector<std::string> passes;
+  size_t perSeed;
+  size_t maxPasses;
+  size_t jobs;
+  std::mt19937 rng;
+  std::string workDir;
+  double compileTimeout = DifferentialTester::defaultCompileTimeout();
+  IrCache irCache;
+  CrashBuckets crashBuckets;
+  std::mutex logMutex;
+
+  std::atomic<size_t> seeds{0};
+  std::atomic<size_t> pipelines{0};
+  std::atomic<size_t> rejected{0};
+  std::atomic<size_t> crashes{0};
+  std::atomic<size_t> hangs{0};
+  std::atomic<size_t> miscompilations{0};
+
+  // Top-level elements of a pipeline string.
+  static std::vector<std::string> splitPipeline(const std::string &pipeline) {
+    std::vector<std::string> parts;
+    int depth = 0;
+    size_t begin = 0;
+    for (size_t i = 0; i <= pipeline.size(); i++) {
+      char c = i < pipeline.size() ? pipeline[i] : ',';
+      if (c == '(' || c == '<') {
+        depth++;
+      } else if (c == ')' || c == '>') {
+        depth--;
+      } else if (c == ',' && depth == 0) {
+        if (i > begin) {
+          parts.push_back(pipeline.substr(begin, i - begin));
+        }
+        begin = i + 1;
+      }
+    }
+    return parts;
+  }
+
+  // The single passes inside an adaptor element, each still wrapped in
+  // its adaptors: cgscc(devirt<4>(inline,function(sroa))) gives
+  // cgscc(devirt<4>(inline)) and cgscc(devirt<4>(function(sroa))).
+  static void addLeaves(const std::string &element, std::vector<std::string> &out) {
+    size_t open = element.find('(');
+    if (open == std::string::npos || element.back() != ')') {
+      out.push_back(element);
+      return;
+    }
+    std::string adaptor = element.substr(0, open);
+    for (const auto &part : splitPipeline(element.substr(open + 1, element.size() - open - 2))) {
+      std::vector<std::string> leaves;
+      addLeaves(part, leaves);
+      for (const auto &leaf : leaves) {
+        out.push_back(adaptor + "(" + leaf + ")");
+      }
+    }
+  }
+
+  std::string randomPipeline() {
+    std::uniform_int_distribution<size_t> length(1, maxPasses);
+    std::uniform_int_distribution<size_t> pick(0, passes.size() - 1);
+    std::string pipeline;
+    for (size_t i = length(rng); i > 0; i--) {
+      pipeline += (pipeline.empty() ? "" : ",") + passes[pick(rng)];
+    }
+    return pipeline;
+  }
+
+  ProcessRunner::Result tool(const std::vector<std::string> &argv) const {
+    ProcessRunner::Options options;
+    options.mergeStderr = true;
+    options.timeoutSeconds = compileTimeout;
+    return ProcessRunner::run(argv, options);
+  }
+
+  // llc -O0 and a link, so that only the pipeline under test optimizes.
+  bool build(const std::string &bitcode, const std::string &executable, const Seed &seed,
+             ProcessRunner::Result &llc) const {
+    std::string object = executable + ".o";
+    llc = tool({"llc", "-O0", "-relocation-model=pic", "-filetype=obj", bitcode, "-o", object});
+    if (!llc.success()) {
+      return false;
+    }
+    bool linked = tool({IrCache::compilerFor(seed.source), object, "-o", executable}).success();
+    std::error_code ec;
+    std::filesystem::remove(object, ec);
+    return linked;
+  }
+
+  // The unoptimized bitcode's run, twice: a program that disagrees with
+  // itself cannot show a miscompilation.
+  void prepare(Seed &seed) {
+    if (!irCache.emit(seed.source, seed.bitcode)) {
+      return;
+    }
+    std::string executable = seed.base + "_reference";
+    ProcessRunner::Result llc;
+    if (!build(seed.bitcode, executable, seed, llc)) {
+      std::cerr << "Failed to build the reference of " << seed.source << ": " << llc.out << std::endl;
+      return;
+    }
+    double seconds = 0;
+    seed.reference = DifferentialTester::runBuild(executable, "reference", RuntimeBudget::cleanLimit(), seconds);
+    double again = 0;
+    DifferentialOracle::Observation rerun =
+        DifferentialTester::runBuild(executable, "reference", RuntimeBudget::cleanLimit(), again);
+    std::error_code ec;
+    std::filesystem::remove(executable, ec);
+    if (!seed.reference.ran || seed.reference.timedOut ||
+        DifferentialOracle::fingerprint(rerun) != DifferentialOracle::fingerprint(seed.reference)) {
+      std::cerr << "Skipping " << seed.source << ": its reference run is a timeout or nondeterministic"
+                << std::endl;
+      return;
+    }
+    seed.referenceSeconds = std::max(seconds, again);
+    seeds++;
+  }
+
+  void tryPipeline(const Seed &seed, size_t index) {
+    if (seed.referenceSeconds < 0) {
+      return;
+    }
+    pipelines++;
+    const std::string &pipeline = seed.pipelines[index];
+    std::string base = seed.base + "_p" + std::to_string(index);
+    std::string optimized = base + ".bc";
+    ProcessRunner::Result opt = tool({"opt", "-passes=" + pipeline, seed.bitcode, "-o", optimized});
+    std::string deadline = "Deadline: " + std::to_string(compileTimeout) + " s";
+    if (!opt.success()) {
+      if (opt.timedOut) {
+        logFinding(seed, pipeline, "COMPILER HANG DETECTED", "opt -passes=" + pipeline,
+                   CrashBuckets::hang("opt -passes=" + pipeline, seed.source), deadline);
+      } else if (DifferentialTester::isCompilerCrash(opt.out, opt.exitCode)) {
+        logFinding(seed, pipeline, "COMPILER CRASH DETECTED", "opt -passes=" + pipeline,
+                   CrashBuckets::extract(opt.out, opt.exitCode, "opt"), opt.out);
+      } else {
+        rejected++;
+      }
+      std::error_code ec;
+      std::filesystem::remove(optimized, ec);
+      return;
+    }
+
+    ProcessRunner::Result llc;
+    std::string executable = base + "_exe";
+    bool built = build(optimized, executable, seed, llc);
+    if (!built && llc.timedOut) {
+      logFinding(seed, pipeline, "COMPILER HANG DETECTED", "llc -O0", CrashBuckets::hang("llc -O0", seed.source), deadline);
+    } else if (!built && !llc.success() && DifferentialTester::isCompilerCrash(llc.out, llc.exitCode)) {
+      logFinding(seed, pipeline, "COMPILER CRASH DETECTED", "llc -O0",
+                 CrashBuckets::extract(llc.out, llc.exitCode, "llc"), llc.out);
+    } else if (built) {
+      // Generous: the optimized program should be faster than the
+      // unoptimized reference.
+      double seconds = 0;
+      DifferentialOracle::Observation observation = DifferentialTester::runBuild(
+          executable, "pipeline", std::max(2.0, 5 * seed.referenceSeconds + 1), seconds);
+      if (observation.ran &&
+          DifferentialOracle::fingerprint(observation) != DifferentialOracle::fingerprint(seed.reference)) {
+        logMiscompilation(seed, pipeline, observation);
+      }
+    }
+    std::error_code ec;
+    std::filesystem::remove(optimized, ec);
+    std::filesystem::remove(executable, ec);
+  }
+
+  void logFinding(const Seed &seed, const std::string &pipeline, const std::string &header,
+                  const std::string &command, const CrashBuckets::Signature &signature,
+                  const std::string &output) {
+    (signature.kind == "hang" ? hangs : crashes)++;
+    if (!crashBuckets.record(signature, seed.source, command)) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(logMutex);
+    std::cout << header << " (" << signature.describe() << ") for " << seed.source << std::endl;
+    std::ofstream log("pipeline_bugs.log", std::ios::app);
+    log << "=== " << header << " ===" << std::endl;
+    log << "File: " << seed.source << std::endl;
+    log << "Pipeline: " << pipeline << std::endl;
+    log << "Compiler: " << command << std::endl;
+    log << "Bucket: " << signature.key() << std::endl;
+    log << "Signature: " << signature.describe() << std::endl;
+    log << "Error output:" << std::endl << output << std::endl;
+    log << "===============================" << std::endl << std::endl;
+  }
+
+  void logMiscompilation(const Seed &seed, const std::string &pipeline,
+                         const DifferentialOracle::Observation &observation) {
+    miscompilations++;
+    std::string symptom = DifferentialOracle::symptom(observation, seed.reference);
+    std::lock_guard<std::mutex> lock(logMutex);
+    std::cout << "MISCOMPILATION SUSPECTED (" << symptom << ") for " << seed.source << std::endl;
+    std::ofstream log("pipeline_bugs.log", std::ios::app);
+    log << "=== MISCOMPILATION SUSPECTED ===" << std::endl;
+    log << "File: " << seed.source << std::endl;
+    log << "Pipeline: " << pipeline << std::endl;
+    log << "Divergent: " << symptom << std::endl;
+    log << "--- unoptimized: " << DifferentialOracle::fingerprint(seed.reference) << std::endl
+        << DifferentialOracle::quotedExcerpt(seed.reference) << std::endl;
+    log << "--- opt -passes=<pipeline>: " << DifferentialOracle::fingerprint(observation) << std::endl
+        << DifferentialOracle::quotedExcerpt(observation) << std::endl;
+    log << "===============================" << std::endl << std::endl;
+  }
+
+public:
+  // elements: top-level elements of the default pipelines. They are
+  // drawn whole and as the single passes inside them; duplicates are
+  // dropped so that every choice is drawn equally often.
+  PipelineFuzzer(const std::vector<std::string> &elements, size_t pipelinesPerSeed = 50, size_t maxLength = 6,
+                 size_t workers = 0, uint32_t seed = 1, const std::string &work = "../test/pipeline")
+      : passes(elements), perSeed(pipelinesPerSeed), maxPasses(std::max<size_t>(1, maxLength)),
+        jobs(workers ? workers : TaskGraph::availableCpus()), rng(seed), workDir(work) {
+    for (const auto &element : elements) {
+      addLeaves(element, passes);
+    }
+    std::sort(passes.begin(), passes.end());
+    passes.erase(std::unique(passes.begin(), passes.end()), passes.end());
+  }
+
+  // Every C and C++ source in dir.
+  bool processDirectory(const std::string &dir) {
+    if (passes.empty()) {
+      std::cerr << "No LLVM passes to build pipelines from (is opt in PATH?)" << std::endl;
+      return false;
+    }
+    std::vector<std::string> sources;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+      std::string extension = entry.path().extension().string();
+      if (entry.is_regular_file() && (extension == ".c" || extension == ".cpp")) {
+        sources.push_back(entry.path().string());
+      }
+    }
+    if (ec) {
+      std::cerr << "Cannot read " << dir << ": " << ec.message() << std::endl;
+      return false;
+    }
+    std::sort(sources.begin(), sources.end());
+    std::filesystem::create_directories(workDir, ec);
+    std::ofstream("pipeline_bugs.log", std::ios::trunc) << "=== Pipeline Fuzzing Bug Log ===" << std::endl
+                                                        << std::endl;
+
+    // Pipelines are drawn up front, so a seed reproduces a campaign.
+    std::vector<std::unique_ptr<Seed>> work;
+    for (const auto &source : sources) {
+      auto seed = std::make_unique<Seed>();
+      seed->source = source;
+      seed->base = workDir + "/" + std::filesystem::path(source).stem().string();
+      seed->bitcode = seed->base + ".bc";
+      for (size_t i = 0; i < perSeed; i++) {
+        seed->pipelines.push_back(randomPipeline());
+      }
+      work.push_back(std::move(seed));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    TaskGraph graph;
+    size_t slots = graph.addResource(jobs);
+    for (auto &entry : work) {
+      Seed *seed = entry.get();
+      TaskGraph::TaskId prepared = graph.addTask(slots, [this, seed] { prepare(*seed); });
+      std::vector<TaskGraph::TaskId> tried;
+      for (size_t i = 0; i < seed->pipelines.size(); i++) {
+        tried.push_back(graph.addTask(slots, [this, seed, i] { tryPipeline(*seed, i); }, {prepared}));
+      }
+      graph.addTask(slots, [seed] {
+        std::error_code ec;
+        std::filesystem::remove(seed->bitcode, ec);
+      }, tried);
+    }
+    graph.run(jobs);
+    crashBuckets.save();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::filesystem::remove(workDir, ec);  // only when empty
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Pipeline fuzzing: " << seeds << " of " << sources.size() << " programs, " << pipelines
+              << " pipelines in " << seconds << "s (" << (seconds > 0 ? pipelines / seconds : 0)
+              << " pipelines/second on " << jobs << " workers)" << std::endl;
+    std::cout << "  rejected by opt: " << rejected << ", crashes and verifier failures: " << crashes
+              << " (" << crashBuckets.getNewBuckets() << " new buckets), hangs: " << hangs
+              << ", miscompilations: " << miscompilations << " (pipeline_bugs.log)" << std::endl;
+    return true;
+  }
+};
+
+#endif // PIPELINE_FUZZER_HPP
@@ -0,0 +1,94 @@
+#ifndef PROCESS_RUNNER_HPP
+#define PROCESS_RUNNER_HPP
+
+#include "child_supervisor.hpp"
+#include <string>
+#include <vector>
+
+/** Runs a program from an argv vector — no /bin/sh in between — and
+ * captures its stdout and stderr. Captured output is bounded: past the
+ * limit only the first and last halves are kept, which is where compiler
+ * and sanitizer reports put the interesting lines. The result carries the
+ * exit status or terminating signal, the wall time and the child's
+ * rusage.
+ *
+ * This is the blocking single-child form of ChildSupervisor; code that
+ * keeps many children in flight uses the supervisor directly.
+ * */
+class ProcessRunner {
+public:
+  using Options = ChildSupervisor::Options;
+  using Result = ChildSupervisor::Result;
+
+  static Result run(const std::vector<std::string> &argv,
+                    const Options &options) {
+    Result result;
+    ChildSupervisor supervisor;
+    supervisor.spawn(argv, options, [&result](Result &finished) {
+      result = std::move(finished);
+    });
+    supervisor.wait();
+    return result;
+  }
+
+  static Result run(const std::vector<std::string> &argv) {
+    return run(argv, Options());
+  }
+
+  // Splits a flag string such as `-O2 -include "a b.hpp"` into arguments,
+  // honouring single and double quotes and backslash escapes.
+  static std::vector<std::string> splitArgs(const std::string &line) {
+    std::vector<std::string> args;
+    std::string current;
+    bool inArg = false;
+    char quote = 0;
+    for (size_t i = 0; i < line.size(); i++) {
+      char c = line[i];
+      if (quote) {
+        if (c == quote) {
+          quote = 0;
+        } else if (c == '\\' && quote == '"' && i + 1 < line.size()) {
+          current += line[++i];
+        } else {
+          current += c;
+        }
+      } else if (c == '\'' || c == '"') {
+        quote = c;
+        inArg = true;
+      } else if (c == '\\' && i + 1 < line.size()) {
+        current += line[++i];
+        inArg = true;
+      } else if (c == ' ' || c == '\t' || c == '\n') {
+        if (inArg) {
+          args.push_back(current);
+          current.clear();
+          inArg = false;
+        }
+      } else {
+        current += c;
+        inArg = true;
+      }
+    }
+    if (inArg) {
+      args.push_back(current);
+    }
+    return args;
+  }
+
+  // Human-readable form of an argv for logs.
+  static std::string describe(const std::vector<std::string> &argv) {
+    std::string text;
+    for (const auto &arg : argv) {
+      if (!text.empty()) {
+        text += " ";
+      }
+      bool plain = !arg.empty() &&
+                   arg.find_first_of(" \t\n'\"\\$") == std::string::npos;
+      text += plain ? arg : "'" + arg + "'";
+    }
+    return text;
+  }
+
+};
+
+#endif // PROCESS_RUNNER_HPP
@@ -2,11 +2,30 @@
 #include "Parser.hpp"
 #include "PromptWriter.hpp"
 #include "TestWriter.hpp"
+#include "artifact_cache.hpp"
+#include "backend_fuzzer.hpp"
+#include "batch_compiler.hpp"
+#include "crash_buckets.hpp"
 #include "differential_tester.hpp"
+#include "driver_job_cache.hpp"
 #include "llm_tokens_options.hpp"
 #include "object_generator.hpp"
+#include "pch_cache.hpp"
+#include "pipeline_fuzzer.hpp"
+#include "process_runner.hpp"
+#include "sanitize_pipeline.hpp"
+#include "test_reducer.hpp"
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <regex>
 #include <filesystem>
 #include <iostream>
+#include <map>
 #include <string>
 #include <cstdlib>
 #include <fstream> 
@@ -39,25 +58,31 @@ void fixCFilesUsingRecompile(const std::string& modelName, const std::string& di
     return;
   }
   
-  std::string command = "~/ReFuzzer/src/model2/recompile --dir=\"" + dirName + "\" --model=" + modelName;
+  std::vector<std::string> command = {expandUserPath("~/ReFuzzer/src/model2/recompile"),
+                                      "--dir=" + dirName, "--model=" + modelName};
   
   if (!compileLogDir.empty()) {
-    command += " --compile=\"" + compileLogDir + "\"";
+    command.push_back("--compile=" + compileLogDir);
     std::cout << "- Will fix compilation errors from: " << compileLogDir << std::endl;
   }
   
   if (!sanitizeLogDir.empty()) {
-    command += " --sanitize=\"" + sanitizeLogDir + "\"";
+    command.push_back("--sanitize=" + sanitizeLogDir);
     std::cout << "- Will fix sanitizer errors from: " << sanitizeLogDir << std::endl;
   }
   
-  command += " > recompile_output.txt 2>&1";
-  
-  std::cout << "Executing: " << command << std::endl;
-  int result = std::system(command.c_str());
+  std::cout << "Executing: " << ProcessRunner::describe(command) << std::endl;
+  ProcessRunner::Options options;
+  options.mergeStderr = true;
+  // The whole log, as the shell redirect kept it; no head+tail cut.
+  options.captureLimit = SIZE_MAX;
+  ProcessRunner::Result recompile = ProcessRunner::run(command, options);
+  int result = recompile.started ? recompile.exitCode : -1;
   
+  // Kept on disk as before, for inspection after the run.
+  std::ofstream("recompile_output.txt", std::ios::trunc) << recompile.out << recompile.err;
   std::cout << "\nRecompile output:" << std::endl;
-  std::system("cat recompile_output.txt");
+  std::cout << recompile.out << recompile.err;
   
   if (result == 0) {
     std::cout << "\n✓ Recompile completed successfully." << std::endl;
@@ -66,7 +91,7 @@ void fixCFilesUsingRecompile(const std::string& modelName, const std::string& di
     std::cerr << "Make sure the 'recompile' executable exists at ~/ReFuzzer/src/model2/recompile and is executable" << std::endl;
   }
 }
-void compileCFilesInDirectory(const std::string& dirPath) {
+void compileCFilesInDirectory(const std::string& dirPath, size_t batchSize = 1) {
   
   std::string cleanDirPath = dirPath;
   if (!cleanDirPath.empty() && cleanDirPath.back() == '/')
@@ -78,40 +103,55 @@ void compileCFilesInDirectory(const std::string& dirPath) {
   fs::create_directories(resultDir + "/log");
   
   GenerateObject objectGenerator;
-  bool foundFiles = false;
   int successCount = 0;
   int failCount = 0;
   
   try {
+    std::vector<fs::path> sources;
     for (const auto& entry : fs::directory_iterator(dirPath)) {
-      if (entry.is_directory()) {
-        continue;
+      if (!entry.is_directory() && entry.path().extension() == ".cpp") {
+        sources.push_back(entry.path());
+      }
+    }
+    
+    // With --batch=K, up to K programs share one `clang++ -c` invocation.
+    std::vector<std::string> objectPaths;
+    if (batchSize > 1) {
+      std::vector<std::string> sourcePaths;
+      for (const auto& source : sources) {
+        sourcePaths.push_back(source.string());
+      }
+      std::cout << "Compiling " << sourcePaths.size() << " files in batches of " << batchSize << std::endl;
+      objectPaths = objectGenerator.generateObjectFiles(sourcePaths, resultDir, batchSize);
+    }
+    
+    for (size_t i = 0; i < sources.size(); i++) {
+      const fs::path& source = sources[i];
+      std::string filename = source.filename().string();
+      
+      std::string objectPath;
+      if (batchSize > 1) {
+        objectPath = objectPaths[i];
+      } else {
+        std::cout << "Processing: " << source.string() << std::endl;
+        objectPath = objectGenerator.generateObjectFile(source.string(), resultDir);
       }
       
-      if (entry.path().extension() == ".cpp") {
-        foundFiles = true;
-        std::string filename = entry.path().filename().string();
-        
-        std::cout << "Processing: " << entry.path().string() << std::endl;
-
-        std::string objectPath = objectGenerator.generateObjectFile(entry.path().string(), resultDir);
-        
-        if (objectPath.empty()) {
-          fs::path incorrectPath = fs::path(resultDir + "/incorrect") / filename;
-          fs::copy_file(entry.path(), incorrectPath, fs::copy_options::overwrite_existing);
-          std::cout << "Compilation failed - copied to: " << incorrectPath.string() << std::endl;
-          failCount++;
-        } else {
-          fs::path correctPath = fs::path(resultDir + "/correct") / filename;
-          fs::copy_file(entry.path(), correctPath, fs::copy_options::overwrite_existing);
-          std::cout << "Compilation successful - copied to: " << correctPath.string() << std::endl;
-          std::cout << "Object file created: " << objectPath << std::endl;
-          successCount++;
-        }
+      if (objectPath.empty()) {
+        fs::path incorrectPath = fs::path(resultDir + "/incorrect") / filename;
+        fs::copy_file(source, incorrectPath, fs::copy_options::overwrite_existing);
+        std::cout << "Compilation failed - copied to: " << incorrectPath.string() << std::endl;
+        failCount++;
+      } else {
+        fs::path correctPath = fs::path(resultDir + "/correct") / filename;
+        fs::copy_file(source, correctPath, fs::copy_options::overwrite_existing);
+        std::cout << "Compilation successful - copied to: " << correctPath.string() << std::endl;
+        std::cout << "Object file created: " << objectPath << std::endl;
+        successCount++;
       }
     }
     
-    if (!foundFiles) {
+    if (sources.empty()) {
       std::cout << "No .cpp files found in " << dirPath << " directory to process." << std::endl;
     } else {
       std::cout << "\nProcessed " << (successCount + failCount) << " files: " 
@@ -123,6 +163,127 @@ void compileCFilesInDirectory(const std::string& dirPath) {
   }
 }
 
+// Compares one compiler invocation per file with batched invocations on
+// the .cpp files of a directory. Objects go to a scratch directory.
+void benchmarkBatching(const std::string& dirPath, size_t batchSize, const std::string& flags) {
+  std::vector<std::string> sources;
+  for (const auto& entry : fs::directory_iterator(dirPath)) {
+    if (!entry.is_directory() && entry.path().extension() == ".cpp") {
+      sources.push_back(entry.path().string());
+    }
+  }
+  if (sources.empty()) {
+    std::cout << "No .cpp files found in " << dirPath << std::endl;
+    return;
+  }
+  
+  std::string scratchDir = (fs::temp_directory_path() / "refuzzer_bench_batch").string();
+  auto timeRun = [&](size_t size, int& failures, unsigned long& invocations) {
+    fs::remove_all(scratchDir);
+    BatchCompiler compiler(size);
+    auto start = std::chrono::steady_clock::now();
+    failures = 0;
+    for (const auto& result : compiler.compile("clang++", flags, sources, scratchDir)) {
+      failures += result.success ? 0 : 1;
+    }
+    invocations = compiler.getInvocationCount();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  };
+  
+  // Warm up the PCH cache so neither side pays for building it.
+  int failures = 0;
+  unsigned long invocations = 0;
+  timeRun(batchSize, failures, invocations);
+  
+  double single = timeRun(1, failures, invocations);
+  std::cout << "Per-file:  " << single << " s, " << invocations << " invocations, "
+            << failures << " failures" << std::endl;
+  double batched = timeRun(batchSize, failures, invocations);
+  std::cout << "Batch=" << batchSize << ": " << batched << " s, " << invocations << " invocations, "
+            << failures << " failures" << std::endl;
+  if (batched > 0) {
+    std::cout << "Speedup: " << single / batched << "x over " << sources.size() << " files" << std::endl;
+  }
+  fs::remove_all(scratchDir);
+}
+
+// Times the single-pass PatternMatcher classifiers against the checks
+// they replaced (one std::regex per crash pattern and call, a full parse
+// per sanitizer check) over captured outputs, repeated up to `megabytes`.
+void benchmarkMatching(const std::string& path, size_t megabytes) {
+  std::vector<std::string> outputs;
+  if (fs::is_directory(path)) {
+    for (const auto& entry : fs::recursive_directory_iterator(path)) {
+      if (entry.is_regular_file()) {
+        outputs.push_back(CacheUtils::readFile(entry.path().string()));
+      }
+    }
+  } else {
+    outputs.push_back(CacheUtils::readFile(path));
+  }
+  size_t passBytes = 0;
+  for (const auto& output : outputs) {
+    passBytes += output.size();
+  }
+  if (passBytes == 0) {
+    std::cout << "No captured output found in " << path << std::endl;
+    return;
+  }
+  size_t passes = std::max<size_t>(1, (megabytes << 20) / passBytes);
+
+  struct Classifier {
+    std::string name;
+    std::function<bool(const std::string&)> before;
+    std::function<bool(const std::string&)> after;
+  };
+  std::vector<Classifier> classifiers = {
+      {"crash",
+       [](const std::string& output) {
+         for (const auto& pattern : DifferentialTester::crashPatterns) {
+           std::regex regex(pattern, std::regex::icase);
+           if (std::regex_search(output, regex)) {
+             return true;
+           }
+         }
+         return false;
+       },
+       [](const std::string& output) { return DifferentialTester::crashMatcher().scan(output) != 0; }},
+      {"sanitizer", [](const std::string& output) { return !SanitizerReport::parse(output).empty(); },
+       [](const std::string& output) { return SanitizerReport::isViolation(output); }},
+  };
+
+  auto timeRun = [&](const std::function<bool(const std::string&)>& classify, size_t& flagged) {
+    auto start = std::chrono::steady_clock::now();
+    flagged = 0;
+    for (size_t pass = 0; pass < passes; pass++) {
+      for (const auto& output : outputs) {
+        flagged += classify(output) ? 1 : 0;
+      }
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  };
+
+  double megabytesScanned = static_cast<double>(passBytes) * passes / (1 << 20);
+  std::cout << outputs.size() << " outputs, " << passes << " passes, " << megabytesScanned << " MB per classifier"
+            << std::endl;
+  for (const auto& classifier : classifiers) {
+    size_t mismatches = 0;
+    for (const auto& output : outputs) {
+      mismatches += classifier.before(output) != classifier.after(output) ? 1 : 0;
+    }
+    size_t flaggedBefore = 0, flaggedAfter = 0;
+    double before = timeRun(classifier.before, flaggedBefore);
+    double after = timeRun(classifier.after, flaggedAfter);
+    std::cout << classifier.name << ": " << megabytesScanned / before << " MB/s before, "
+              << megabytesScanned / after << " MB/s with the matcher (" << before / after << "x), "
+              << flaggedAfter / passes << " of " << outputs.size() << " outputs flagged";
+    if (mismatches > 0) {
+      std::cout << ", " << mismatches << " DISAGREE";
+    }
+    std::cout << std::endl;
+  }
+}
+
 void displayHelp() {
   std::cout << "Usage: ./program <command> [options] [directory_path]" << std::endl;
   std::cout << "Commands:" << std::endl;
@@ -131,6 +292,19 @@ void displayHelp() {
   std::cout << "  compile       Process and compile all .c files in specified directory" << std::endl;
   std::cout << "  refuzz        Fix compilation errors, run sanitizers, and organize" << std::endl;
   std::cout << "                files into correct/incorrect subdirectories" << std::endl;
+  std::cout << "  difftest      Run gcc/clang -O0..-O3 builds of the sanitizer-clean programs in" << std::endl;
+  std::cout << "                --dir/correct and report builds whose output disagrees" << std::endl;
+  std::cout << "  reduce        Reduce the programs behind the compiler crashes in --log (bugs.log)" << std::endl;
+  std::cout << "                or the miscompilations (miscompilations.log) to minimal reproducers" << std::endl;
+  std::cout << "  optfuzz       Run random opt pass pipelines over the bitcode of the programs in" << std::endl;
+  std::cout << "                --dir/correct and report crashes, verifier failures and miscompilations" << std::endl;
+  std::cout << "  llcfuzz       Compile the optimized bitcode of the programs in --dir/correct with llc" << std::endl;
+  std::cout << "                under sampled targets, CPUs, features and codegen options, and report crashes" << std::endl;
+  std::cout << "  crash-buckets List the compiler crash buckets seen so far, largest first" << std::endl;
+  std::cout << "  bench-batch   Time per-file vs batched compiler invocations on --dir" << std::endl;
+  std::cout << "  bench-match   Time crash/sanitizer output classification on captured outputs" << std::endl;
+  std::cout << "                in --dir (a directory or one file)" << std::endl;
+  std::cout << "  cache-stats   Show artifact cache hit rate and size" << std::endl;
   std::cout << "  help          Display this help message" << std::endl;
   std::cout << std::endl;
   std::cout << "Options:" << std::endl;
@@ -138,6 +312,40 @@ void displayHelp() {
   std::cout << "                  Example: --model=llama3" << std::endl;
   std::cout << "  --clang=<path>  Path to AFL-instrumented Clang (default: /usr/local/llvm/bin/clang)" << std::endl;
   std::cout << "  --gcc=<path>    Path to AFL-instrumented GCC (default: afl-gcc)" << std::endl;
+  std::cout << "  --batch=<K>     Compile up to K programs per compiler invocation" << std::endl;
+  std::cout << "                  (compile, sanitize and bench-batch; difftest then only looks for crashes)" << std::endl;
+  std::cout << "  --flags=<flags> Compiler flags for bench-batch (default: -fsyntax-only)" << std::endl;
+  std::cout << "  --matrix        difftest with pairwise combinations of the generator's optimization" << std::endl;
+  std::cout << "                  levels and flags, plus each program's sampled flags (from --dir/prompt)" << std::endl;
+  std::cout << "  --budget=<N>    Builds per program with --matrix (default: 8)" << std::endl;
+  std::cout << "  --seed=<N>      Seed of the --matrix covering array or the optfuzz/llcfuzz sampling (default: 1)" << std::endl;
+  std::cout << "  --pipelines=<N> Pass pipelines per program for optfuzz (default: 50)" << std::endl;
+  std::cout << "  --max-passes=<N> Passes per optfuzz pipeline, at most (default: 6)" << std::endl;
+  std::cout << "  --runs=<N>      llc runs per program for llcfuzz (default: 100)" << std::endl;
+  std::cout << "  --targets=<a,b> llc targets for llcfuzz (default: x86-64, x86, aarch64, arm, riscv64," << std::endl;
+  std::cout << "                  ppc64le, systemz, mips64el, sparcv9 and wasm32, where registered)" << std::endl;
+  std::cout << "  --log=<file>    Log whose entries reduce works through (default: bugs.log)" << std::endl;
+  std::cout << "  --out=<dir>     Directory for reduced programs (default: reduced)" << std::endl;
+  std::cout << "  --file=<path>, --command=<cmd> [--reference=<cmd>]" << std::endl;
+  std::cout << "                  reduce one program that crashes <cmd> (or whose <cmd> build" << std::endl;
+  std::cout << "                  diverges from the <cmd> reference build) instead of a log" << std::endl;
+  std::cout << "  --top=<N>       Buckets listed by crash-buckets (default: 20)" << std::endl;
+  std::cout << "  --time-report   difftest compiles with -ftime-report to bucket compile cost outliers" << std::endl;
+  std::cout << "                  by their dominant pass" << std::endl;
+  std::cout << "  --perf          difftest times the builds of programs they agree on and reports" << std::endl;
+  std::cout << "                  missed optimizations (-O3 slower than -O1, clang vs gcc)" << std::endl;
+  std::cout << "  --perf-runs=<N> Timed runs per build with --perf, after a warm-up (default: 5)" << std::endl;
+  std::cout << "  --compile-timeout=<s>" << std::endl;
+  std::cout << "                  difftest compile deadline before a hang is retried and reported" << std::endl;
+  std::cout << "                  (default: $REFUZZER_COMPILE_TIMEOUT or 60)" << std::endl;
+  std::cout << "  --mb=<N>        Megabytes classified per run of bench-match (default: 8)" << std::endl;
+  std::cout << "  --jobs=<N>      Worker threads for sanitize, difftest, optfuzz, llcfuzz and reduce" << std::endl;
+  std::cout << "                  (default: available CPUs)" << std::endl;
+  std::cout << "  --compile-jobs=<N>, --run-jobs=<N>" << std::endl;
+  std::cout << "                  Concurrent sanitizer builds / runs (default: available CPUs)" << std::endl;
+  std::cout << "  --early-exit    Stop checking a file after its first failing sanitizer" << std::endl;
+  std::cout << "  --msan-libcxx=<prefix>" << std::endl;
+  std::cout << "                  Build msan against an MSan-instrumented libc++ installed in <prefix>" << std::endl;
 }
 
 std::string parseModelOption(int argc, char *argv[]) {
@@ -164,6 +372,46 @@ std::string parseOption(int argc, char *argv[], const std::string& option, const
   return defaultValue;
 }
 
+// Numeric option values. Malformed input (--jobs=abc, --jobs=-1) prints
+// the usage text and ends the program instead of an uncaught exception.
+[[noreturn]] void badOptionValue(const std::string& option, const std::string& value) {
+  std::cerr << "Error: invalid value for " << option << ": '" << value << "'" << std::endl;
+  displayHelp();
+  std::exit(1);
+}
+
+size_t parseCountOption(int argc, char *argv[], const std::string& option, const std::string& defaultValue) {
+  std::string value = parseOption(argc, argv, option, defaultValue);
+  char* end = nullptr;
+  errno = 0;
+  unsigned long long count = value.empty() || !std::isdigit(static_cast<unsigned char>(value[0]))
+                                 ? 0 : std::strtoull(value.c_str(), &end, 10);
+  if (!end || *end != '\0' || errno == ERANGE || count > SIZE_MAX) {
+    badOptionValue(option, value);
+  }
+  return static_cast<size_t>(count);
+}
+
+double parseSecondsOption(int argc, char *argv[], const std::string& option, const std::string& defaultValue) {
+  std::string value = parseOption(argc, argv, option, defaultValue);
+  char* end = nullptr;
+  double seconds = value.empty() ? 0 : std::strtod(value.c_str(), &end);
+  if (!end || *end != '\0' || !std::isfinite(seconds) || seconds < 0) {
+    badOptionValue(option, value);
+  }
+  return seconds;
+}
+
+bool hasFlag(int argc, char *argv[], const std::string& flag) {
+  for (int i = 1; i < argc; i++) {
+    if (argv[i] == flag) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 int main(int argc, char *argv[]) {
   if (argc < 2) {
     displayHelp();
@@ -222,7 +470,7 @@ int main(int argc, char *argv[]) {
     }
      PromptWriter promptWriter(promptDir);
     auto [promptPath, promptSuccess] =
-        promptWriter.savePrompt(prompt, filepath, optLevel, randomCompilerOpt,
+        promptWriter.savePrompt(prompt, filepath, optLevel, compilerFlag, randomCompilerOpt,
                                 randomCompilerParts, randomPL);
 
     if (!promptSuccess) {
@@ -251,7 +499,8 @@ int main(int argc, char *argv[]) {
       return 1;
     }
     
-    compileCFilesInDirectory(dirPath);
+    size_t batchSize = parseCountOption(argc, argv, "--batch=", "1");
+    compileCFilesInDirectory(dirPath, batchSize);
     
     std::cout << "Files copied and compilation complete." << std::endl;
     std::cout << "You can now run sanitizer checks with given option in help." << std::endl;
@@ -265,149 +514,125 @@ int main(int argc, char *argv[]) {
       return 1;
     }
   
-    std::string sanLog = dirName + "/sanitizer_log";
+    SanitizePipeline::Settings settings;
+    settings.dirName = dirName;
+    settings.batchSize = parseCountOption(argc, argv, "--batch=", "8");
+    settings.jobs = parseCountOption(argc, argv, "--jobs=", "0");
+    settings.compileJobs = parseCountOption(argc, argv, "--compile-jobs=", "0");
+    settings.runJobs = parseCountOption(argc, argv, "--run-jobs=", "0");
+    settings.earlyExit = hasFlag(argc, argv, "--early-exit");
+    settings.msanLibcxx = expandUserPath(parseOption(argc, argv, "--msan-libcxx=", ""));
+    SanitizePipeline pipeline(settings);
+    if (pipeline.run() != 0) {
+      return 1;
+    }
+} else if (command == "difftest") {
+    // Only programs that passed every sanitizer are admitted: undefined
+    // behavior would make diverging output legitimate.
+    std::string dirName = expandUserPath(parseOption(argc, argv, "--dir=", "../test"));
     std::string correctDir = dirName + "/correct";
-    std::string incorrectDir = dirName + "/incorrect";
-    std::string objectDir = dirName + "/object";
-    
-    fs::create_directories(sanLog);
-    fs::create_directories(correctDir);
-    fs::create_directories(incorrectDir);
-    fs::create_directories(objectDir);
-    
-    std::cout << "Running sanitizers on C++ files in: " << dirName << std::endl;
-    std::cout << "If directory is not provided, default ../test will be used" << std::endl;
-    std::cout << "Results will be organized inside: " << dirName << std::endl;
-    
-    int totalFiles = 0;
-    int correctFiles = 0;
-    int incorrectFiles = 0;
-    
-    try {
-      for (const auto& entry : fs::directory_iterator(dirName)) {
-        if (entry.path().extension() == ".cpp") {
-          totalFiles++;
-          std::string filename = entry.path().filename().string();
-          std::string basename = entry.path().stem().string();
-          std::string filepath = entry.path().string();
-          
-          std::cout << "\nProcessing: " << filename << std::endl;
-          
-          bool hasErrors = false;
-          std::vector<std::string> sanitizers = {"asan", "msan", "ubsan"};
-          std::vector<std::string> createdBinaries;
-          std::string logFile = sanLog + "/" + basename + ".log"; 
-          
-          for (const std::string& sanitizer : sanitizers) {
-            std::cout << "  Running " << sanitizer << "..." << std::endl;
-            
-            std::string binaryName = "./" + basename + "_" + sanitizer;
-            std::string compileCmd, runCmd;
-            
-            if (sanitizer == "asan") {
-              compileCmd = "clang++ -fsanitize=address -O0 -w -fno-omit-frame-pointer -g \"" + 
-                          filepath + "\" -o \"" + binaryName + "\" 2>/dev/null";
-              runCmd = "timeout 30s bash -c \"ASAN_OPTIONS=detect_stack_use_after_return=1 " + 
-                      binaryName + "\" 2>&1";
-            } else if (sanitizer == "msan") {
-              compileCmd = "clang++ -fsanitize=memory -fno-omit-frame-pointer -g -O0 -w \"" + 
-                          filepath + "\" -o \"" + binaryName + "\" 2>/dev/null";
-              runCmd = "timeout 30s " + binaryName + " 2>&1";
-            } else if (sanitizer == "ubsan") {
-              compileCmd = "clang++ -fsanitize=undefined -g -O1 -w \"" + 
-                          filepath + "\" -o \"" + binaryName + "\" 2>/dev/null";
-              runCmd = "timeout 30s bash -c \"UBSAN_OPTIONS=abort_on_error=1:print_stacktrace=1 " + 
-                      binaryName + "\" 2>&1";
-            }
-            
-            int compileResult = std::system(compileCmd.c_str());
-            if (compileResult != 0) {
-              std::cout << "    " << sanitizer << " compilation failed" << std::endl;
-              hasErrors = true;
-              // TODO: Add compilation error logging to the main log file
-              continue;
-            }
-            
-            createdBinaries.push_back(binaryName);
-            
-            std::string captureCmd = "(" + runCmd + ") > /tmp/" + basename + "_" + sanitizer + "_output.txt 2>&1";
-            int runResult = std::system(captureCmd.c_str());
-            
-            if (runResult == 0) {
-              std::cout << "    " << sanitizer << " - OK" << std::endl;
-              std::system(("rm -f /tmp/" + basename + "_" + sanitizer + "_output.txt").c_str());
-            } else if (runResult == 124 * 256) { 
-              std::cout << "    " << sanitizer << " - TIMEOUT" << std::endl;
-              hasErrors = true;
-
-              std::string appendCmd = "echo \"=== " + sanitizer + " START ===\" >> \"" + logFile + "\" && " +
-                                    "cat /tmp/" + basename + "_" + sanitizer + "_output.txt >> \"" + logFile + "\" && " +
-                                    "echo \"=== " + sanitizer + " END ===\" >> \"" + logFile + "\"";
-              std::system(appendCmd.c_str());
-              std::system(("rm -f /tmp/" + basename + "_" + sanitizer + "_output.txt").c_str());
-            } else {
-              std::cout << "    " << sanitizer << " - ERROR DETECTED (exit code: " << (runResult / 256) << ")" << std::endl;
-              hasErrors = true;
-
-              std::string appendCmd = "echo \"=== " + sanitizer + " START ===\" >> \"" + logFile + "\" && " +
-                                    "cat /tmp/" + basename + "_" + sanitizer + "_output.txt >> \"" + logFile + "\" && " +
-                                    "echo \"=== " + sanitizer + " END ===\" >> \"" + logFile + "\"";
-              std::system(appendCmd.c_str());
-              std::system(("rm -f /tmp/" + basename + "_" + sanitizer + "_output.txt").c_str());
-            }
-          }
-          if (!hasErrors) {
-            std::string cleanExecutable = objectDir + "/" + basename;
-            std::string createExecCmd = "clang++ -O2 \"" + filepath + "\" -o \"" + cleanExecutable + "\" 2>/dev/null";
-            
-            int execResult = std::system(createExecCmd.c_str());
-            if (execResult == 0) {
-              std::cout << "  Clean executable created: " << cleanExecutable << std::endl;
-            } else {
-              std::cout << "  Warning: Failed to create clean executable" << std::endl;
-            }
-            fs::path correctPath = fs::path(correctDir) / filename;
-            try {
-              fs::copy_file(filepath, correctPath, fs::copy_options::overwrite_existing);
-              correctFiles++;
-              std::cout << "  Result: NO ISSUES - moved to correct/, executable in object/" << std::endl;
-            } catch (const fs::filesystem_error& e) {
-              std::cerr << "  Error copying file to correct/: " << e.what() << std::endl;
-            }
-          } else {
-            fs::path incorrectPath = fs::path(incorrectDir) / filename;
-            try {
-              fs::copy_file(filepath, incorrectPath, fs::copy_options::overwrite_existing);
-              incorrectFiles++;
-              std::cout << "  Result: ERRORS DETECTED - moved to incorrect/" << std::endl;
-            } catch (const fs::filesystem_error& e) {
-              std::cerr << "  Error copying file to incorrect/: " << e.what() << std::endl;
-            }
-          }
-          for (const std::string& binary : createdBinaries) {
-            std::system(("rm -f \"" + binary + "\"").c_str());
-          }
-        }
+    if (!fs::exists(correctDir) || !fs::is_directory(correctDir)) {
+      std::cerr << "Error: " << correctDir << " not found; run sanitize --dir=" << dirName << " first" << std::endl;
+      return 1;
+    }
+    DifferentialTester tester;
+    tester.setJobs(parseCountOption(argc, argv, "--jobs=", "0"));
+    tester.setWorkDir(dirName + "/difftest");
+    if (hasFlag(argc, argv, "--matrix")) {
+      tester.useFlagMatrix(parseCountOption(argc, argv, "--budget=", "8"), dirName + "/prompt",
+                           static_cast<uint32_t>(parseCountOption(argc, argv, "--seed=", "1")));
+    }
+    tester.setBatchSize(parseCountOption(argc, argv, "--batch=", "1"));
+    tester.setTimeReport(hasFlag(argc, argv, "--time-report"));
+    if (hasFlag(argc, argv, "--perf")) {
+      tester.setPerfRuns(parseCountOption(argc, argv, "--perf-runs=", "5"));
+    }
+    if (!parseOption(argc, argv, "--compile-timeout=", "").empty()) {
+      tester.setCompileTimeout(parseSecondsOption(argc, argv, "--compile-timeout=", ""));
+    }
+    if (!tester.processDirectory(correctDir)) {
+      return 1;
+    }
+} else if (command == "reduce") {
+    std::vector<TestReducer::Case> cases;
+    std::string file = expandUserPath(parseOption(argc, argv, "--file=", ""));
+    if (!file.empty()) {
+      TestReducer::Case single;
+      single.source = file;
+      single.command = parseOption(argc, argv, "--command=", "");
+      single.reference = parseOption(argc, argv, "--reference=", "");
+      single.kind = single.reference.empty() ? TestReducer::Kind::Crash : TestReducer::Kind::Miscompile;
+      if (single.command.empty()) {
+        std::cerr << "Error: --file needs --command=<compiler and flags>" << std::endl;
+        return 1;
       }
-      
-      if (totalFiles == 0) {
-        std::cout << "No .cpp files found in " << dirName << " directory." << std::endl;
-      } else {
-        std::cout << "\n=== SANITIZER SUMMARY ===" << std::endl;
-        std::cout << "Total files processed: " << totalFiles << std::endl;
-        std::cout << "Files with no issues: " << correctFiles << std::endl;
-        std::cout << "Files with errors detected: " << incorrectFiles << std::endl;
-        std::cout << "\nResults organized in:" << std::endl;
-        std::cout << "  " << correctDir << "/ - Clean source files" << std::endl;
-        std::cout << "  " << objectDir << "/ - Clean executables" << std::endl;
-        std::cout << "  " << incorrectDir << "/ - Files with detected errors" << std::endl;
-        std::cout << "  " << sanLog << "/ - Error logs" << std::endl;
+      cases.push_back(single);
+    } else {
+      cases = TestReducer::readLog(expandUserPath(parseOption(argc, argv, "--log=", "bugs.log")));
+    }
+    TestReducer reducer(parseCountOption(argc, argv, "--jobs=", "0"),
+                        expandUserPath(parseOption(argc, argv, "--out=", "reduced")));
+    reducer.reduceAll(cases);
+} else if (command == "optfuzz") {
+    std::string dirName = expandUserPath(parseOption(argc, argv, "--dir=", "../test"));
+    std::string correctDir = dirName + "/correct";
+    if (!fs::exists(correctDir) || !fs::is_directory(correctDir)) {
+      std::cerr << "Error: " << correctDir << " not found; run sanitize --dir=" << dirName << " first" << std::endl;
+      return 1;
+    }
+    LLMTokensOption tokens;
+    PipelineFuzzer fuzzer(tokens.getLLVMPasses(), parseCountOption(argc, argv, "--pipelines=", "50"),
+                          parseCountOption(argc, argv, "--max-passes=", "6"),
+                          parseCountOption(argc, argv, "--jobs=", "0"),
+                          static_cast<uint32_t>(parseCountOption(argc, argv, "--seed=", "1")),
+                          dirName + "/pipeline");
+    if (!fuzzer.processDirectory(correctDir)) {
+      return 1;
+    }
+} else if (command == "llcfuzz") {
+    std::string dirName = expandUserPath(parseOption(argc, argv, "--dir=", "../test"));
+    std::string correctDir = dirName + "/correct";
+    if (!fs::exists(correctDir) || !fs::is_directory(correctDir)) {
+      std::cerr << "Error: " << correctDir << " not found; run sanitize --dir=" << dirName << " first" << std::endl;
+      return 1;
+    }
+    std::vector<std::string> targets;
+    std::stringstream targetList(parseOption(argc, argv, "--targets=", ""));
+    std::string target;
+    while (std::getline(targetList, target, ',')) {
+      if (!target.empty()) {
+        targets.push_back(target);
       }
-      
-    } catch (const fs::filesystem_error& e) {
-      std::cerr << "Filesystem error: " << e.what() << std::endl;
+    }
+    BackendFuzzer fuzzer(targets, parseCountOption(argc, argv, "--runs=", "100"),
+                         parseCountOption(argc, argv, "--jobs=", "0"),
+                         static_cast<uint32_t>(parseCountOption(argc, argv, "--seed=", "1")),
+                         dirName + "/backend");
+    if (!fuzzer.processDirectory(correctDir)) {
+      return 1;
+    }
+} else if (command == "crash-buckets") {
+    CrashBuckets buckets;
+    buckets.printIndex(parseCountOption(argc, argv, "--top=", "20"));
+} else if (command == "bench-batch") {
+    std::string dirName = expandUserPath(parseOption(argc, argv, "--dir=", "../test"));
+    size_t batchSize = parseCountOption(argc, argv, "--batch=", "8");
+    std::string flags = parseOption(argc, argv, "--flags=", "-fsyntax-only");
+    if (!fs::exists(dirName) || !fs::is_directory(dirName)) {
+      std::cerr << "Error: " << dirName << " is not a valid directory" << std::endl;
+      return 1;
+    }
+    benchmarkBatching(dirName, batchSize, flags);
+} else if (command == "bench-match") {
+    std::string path = expandUserPath(parseOption(argc, argv, "--dir=", "../sanitizer_log"));
+    if (!fs::exists(path)) {
+      std::cerr << "Error: " << path << " does not exist" << std::endl;
       return 1;
     }
+    benchmarkMatching(path, parseCountOption(argc, argv, "--mb=", "8"));
+} else if (command == "cache-stats") {
+    ArtifactCache artifactCache;
+    artifactCache.printStats();
 } else if (command == "refuzz" || command == "rf") {
     std::string modelName = parseModelOption(argc, argv);
     std::string dirName = parseOption(argc, argv, "--dir=", "../test");
@@ -0,0 +1,364 @@
+#ifndef RUN_COST_HPP
+#define RUN_COST_HPP
+
+#include "process_runner.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <elf.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+/** Run time and code size as a missed-optimization oracle: the builds of
+ * one program that agreed on its output are timed against each other, and
+ * a build that is much slower than one that should not beat it is
+ * reported. Compared are -O3 against -O1 of the same compiler, and gcc
+ * against clang (both ways) at the same level.
+ *
+ * Each build runs once to warm up and then `runs` times. A run is counted
+ * by perf_event_open counters on the calling thread that the child
+ * inherits, in user space only, so perf_event_paranoid 2 is enough: CPU
+ * cycles (and instructions) where the hardware counters are available,
+ * else the task clock, else the rusage user time. Counting the program's
+ * own CPU work keeps concurrent compiles from skewing it much.
+ *
+ * A pair is flagged when the medians differ by at least minRatio, the
+ * difference is noiseFactor times the larger relative spread (MAD over
+ * median) of the two, the runs do not overlap at all, and both builds
+ * cost more than a floor, so that startup-dominated programs (whose
+ * fork, exec and sandbox setup the task clock also counts) are left out.
+ * The .text size of both builds goes with every finding.
+ *
+ * Builds are paired by stage (compiler and -O level), not by name, so
+ * flag matrix rows take part too: each build of a stage is held against
+ * the fastest build of the stage it should not lose to.
+ * */
+class RunCostOracle {
+public:
+  struct Measurement {
+    std::string config;
+    // Compiler and level, e.g. gcc-O3.
+    std::string stage;
+    std::string command;
+    bool valid = false;
+    // "cycles", "task clock" (seconds) or "user time" (seconds).
+    std::string metric;
+    std::vector<double> samples;
+    double median = 0;
+    // Median; 0 without hardware counters.
+    double instructions = 0;
+    uint64_t textBytes = 0;
+
+    // MAD over median.
+    double spread() const {
+      if (samples.empty() || median <= 0) {
+        return 0;
+      }
+      std::vector<double> deviations;
+      for (double sample : samples) {
+        deviations.push_back(std::fabs(sample - median));
+      }
+      return RunCostOracle::median(deviations) / median;
+    }
+  };
+
+  struct Finding {
+    std::string source;
+    std::string comparison;
+    Measurement slow;
+    Measurement fast;
+    double ratio = 0;
+  };
+
+private:
+  static constexpr double minRatio = 1.5;
+  static constexpr double noiseFactor = 3.0;
+  static constexpr double minCycles = 1e8;
+  static constexpr double minTaskClock = 0.05;
+  static constexpr double minUserTime = 0.05;
+
+  // Counters of the calling thread and of the children it starts while
+  // they exist. Children fold their counts in when they exit; reads are
+  // deltas, since PERF_EVENT_IOC_RESET leaves those folded counts alone.
+  class Counters {
+    int cyclesFd = -1;
+    int instructionsFd = -1;
+    int clockFd = -1;
+    uint64_t cyclesStart = 0;
+    uint64_t instructionsStart = 0;
+    uint64_t clockStart = 0;
+
+    static int open(uint32_t type, uint64_t config) {
+      struct perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = type;
+      attr.config = config;
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    }
+
+    static uint64_t read(int fd) {
+      uint64_t value = 0;
+      if (fd < 0 || ::read(fd, &value, sizeof(value)) != sizeof(value)) {
+        return 0;
+      }
+      return value;
+    }
+
+  public:
+    Counters() {
+      cyclesFd = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+      if (cyclesFd >= 0) {
+        instructionsFd = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+      } else {
+        clockFd = open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+      }
+    }
+
+    ~Counters() {
+      for (int fd : {cyclesFd, instructionsFd, clockFd}) {
+        if (fd >= 0) {
+          close(fd);
+        }
+      }
+    }
+
+    Counters(const Counters &) = delete;
+    Counters &operator=(const Counters &) = delete;
+
+    std::string metric() const {
+      return cyclesFd >= 0 ? "cycles" : clockFd >= 0 ? "task clock" : "user time";
+    }
+
+    void start() {
+      cyclesStart = read(cyclesFd);
+      instructionsStart = read(instructionsFd);
+      clockStart = read(clockFd);
+    }
+
+    // The metric since start(); the user time of `usage` without
+    // counters.
+    double stop(const struct rusage &usage, double &instructions) const {
+      instructions = static_cast<double>(read(instructionsFd) - instructionsStart);
+      if (cyclesFd >= 0) {
+        return static_cast<double>(read(cyclesFd) - cyclesStart);
+      }
+      if (clockFd >= 0) {
+        // Nanoseconds.
+        return (read(clockFd) - clockStart) / 1e9;
+      }
+      return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    }
+  };
+
+  static double median(std::vector<double> values) {
+    if (values.empty()) {
+      return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+  }
+
+  static double floorFor(const std::string &metric) {
+    return metric == "cycles" ? minCycles : metric == "task clock" ? minTaskClock : minUserTime;
+  }
+
+  static std::string format(const Measurement &measurement) {
+    std::ostringstream text;
+    if (measurement.metric == "cycles") {
+      text << std::fixed << std::setprecision(0) << measurement.median << " cycles";
+      if (measurement.instructions > 0) {
+        text << ", " << measurement.instructions << " instructions";
+      }
+    } else {
+      text << std::fixed << std::setprecision(4) << measurement.median << " s " << measurement.metric;
+    }
+    text << std::setprecision(1) << " (spread " << measurement.spread() * 100 << "%), .text "
+         << measurement.textBytes << " bytes";
+    return text.str();
+  }
+
+public:
+  // Size of the .text section of an ELF64 file; 0 when there is none.
+  static uint64_t textBytes(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    Elf64_Ehdr header;
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_ident[EI_CLASS] != ELFCLASS64 ||
+        header.e_shentsize != sizeof(Elf64_Shdr) || header.e_shstrndx >= header.e_shnum) {
+      return 0;
+    }
+    std::vector<Elf64_Shdr> sections(header.e_shnum);
+    file.seekg(header.e_shoff);
+    if (!file.read(reinterpret_cast<char *>(sections.data()), sections.size() * sizeof(Elf64_Shdr))) {
+      return 0;
+    }
+    const Elf64_Shdr &names = sections[header.e_shstrndx];
+    std::string table(names.sh_size, '\0');
+    file.seekg(names.sh_offset);
+    if (!file.read(&table[0], table.size())) {
+      return 0;
+    }
+    for (const auto &section : sections) {
+      if (section.sh_name < table.size() && std::strcmp(table.c_str() + section.sh_name, ".text") == 0) {
+        return section.sh_size;
+      }
+    }
+    return 0;
+  }
+
+  // One warm-up and `runs` counted runs of a build in the sandbox;
+  // invalid when any run fails or misses the deadline.
+  static Measurement measure(const std::string &executable, const std::string &config,
+                             const std::string &command, size_t runs, double deadline) {
+    Measurement measurement;
+    measurement.config = config;
+    measurement.command = command;
+    measurement.textBytes = textBytes(executable);
+    ProcessRunner::Options options;
+    options.timeoutSeconds = deadline;
+    options.cpuSeconds = deadline;
+    options.sandbox = Sandbox::forGeneratedBinary(false);
+
+    Counters counters;
+    measurement.metric = counters.metric();
+    std::vector<double> instructions;
+    for (size_t run = 0; run <= runs; run++) {
+      counters.start();
+      ProcessRunner::Result result = ProcessRunner::run({executable}, options);
+      double counted = 0;
+      double value = counters.stop(result.usage, counted);
+      if (!result.started || result.timedOut || result.cpuLimitHit || result.signal != 0) {
+        return measurement;
+      }
+      if (run > 0) {
+        measurement.samples.push_back(value);
+        instructions.push_back(counted);
+      }
+    }
+    measurement.median = median(measurement.samples);
+    measurement.instructions = median(instructions);
+    measurement.valid = true;
+    return measurement;
+  }
+
+  struct Pair {
+    std::string slowStage;
+    std::string fastStage;
+    std::string comparison;
+  };
+
+  // The stages a build should not be slower than: -O3 against -O1 of the
+  // same compiler, and gcc against clang at the same level.
+  static std::vector<Pair> pairs() {
+    std::vector<Pair> result;
+    for (const std::string compiler : {"gcc", "clang"}) {
+      result.push_back({compiler + "-O3", compiler + "-O1", "-O3 slower than -O1 (" + compiler + ")"});
+    }
+    for (const std::string level : {"-O1", "-O2", "-O3"}) {
+      result.push_back({"clang" + level, "gcc" + level, "clang slower than gcc at " + level});
+      result.push_back({"gcc" + level, "clang" + level, "gcc slower than clang at " + level});
+    }
+    return result;
+  }
+
+  // The stages among `stages` that some pair compares; builds of other
+  // stages need not be timed.
+  static std::set<std::string> comparedStages(const std::set<std::string> &stages) {
+    std::set<std::string> compared;
+    for (const auto &pair : pairs()) {
+      if (stages.count(pair.slowStage) && stages.count(pair.fastStage)) {
+        compared.insert({pair.slowStage, pair.fastStage});
+      }
+    }
+    return compared;
+  }
+
+  // Findings among one program's measurements; stages without a valid
+  // build are skipped.
+  static std::vector<Finding> compare(const std::string &source, const std::vector<Measurement> &measurements) {
+    std::vector<Finding> findings;
+    for (const auto &pair : pairs()) {
+      const Measurement *fastest = nullptr;
+      for (const auto &measurement : measurements) {
+        if (measurement.stage == pair.fastStage && measurement.valid && measurement.median > 0 &&
+            (!fastest || measurement.median < fastest->median)) {
+          fastest = &measurement;
+        }
+      }
+      if (!fastest) {
+        continue;
+      }
+      const Measurement &b = *fastest;
+      for (const auto &a : measurements) {
+        if (a.stage != pair.slowStage || !a.valid || a.metric != b.metric) {
+          continue;
+        }
+        double ratio = a.median / b.median;
+        double noise = std::max(a.spread(), b.spread());
+        bool separated = *std::min_element(a.samples.begin(), a.samples.end()) >
+                         *std::max_element(b.samples.begin(), b.samples.end());
+        if (ratio >= minRatio && ratio - 1 >= noiseFactor * noise && separated && b.median >= floorFor(b.metric)) {
+          findings.push_back({source, pair.comparison, a, b, ratio});
+        }
+      }
+    }
+    return findings;
+  }
+
+  static std::string describe(const Finding &finding) {
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(2) << finding.slow.config << " takes " << finding.ratio << "x the "
+         << finding.slow.metric << " of " << finding.fast.config;
+    return text.str();
+  }
+
+  static void log(const std::vector<Finding> &findings, const std::string &file) {
+    std::ofstream output(file, std::ios::app);
+    if (!output.is_open()) {
+      std::cerr << "Failed to open " << file << std::endl;
+      return;
+    }
+    for (const auto &finding : findings) {
+      output << "=== MISSED OPTIMIZATION SUSPECTED ===" << std::endl;
+      output << "File: " << finding.source << std::endl;
+      output << "Bucket: " << finding.comparison << std::endl;
+      output << "Finding: " << describe(finding) << std::endl;
+      output << "Slow: " << finding.slow.command << ": " << format(finding.slow) << std::endl;
+      output << "Fast: " << finding.fast.command << ": " << format(finding.fast) << std::endl;
+      output << "===============================" << std::endl << std::endl;
+    }
+  }
+
+  static void printSummary(const std::vector<Finding> &findings, size_t measured) {
+    if (measured == 0) {
+      return;
+    }
+    std::map<std::string, size_t> buckets;
+    for (const auto &finding : findings) {
+      buckets[finding.comparison]++;
+    }
+    std::cout << "  missed optimizations: " << findings.size() << " in " << measured
+              << " timed programs (missed_optimizations.log)" << std::endl;
+    for (const auto &[bucket, count] : buckets) {
+      std::cout << "    " << count << "x " << bucket << std::endl;
+    }
+  }
+};
+
+#endif // RUN_COST_HPP
@@ -0,0 +1,249 @@
+#ifndef RUNTIME_BUDGET_HPP
+#define RUNTIME_BUDGET_HPP
+
+#include "cache_utils.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+/** Deadlines for running generated programs, derived from the wall time
+ * of the program's clean -O2 build instead of a fixed 10 or 30 seconds.
+ *
+ *   deadline = clamp(headroom * (startup + clean * slowdown), floor, cap)
+ *
+ * The slowdown of a stage (a sanitizer build, another compiler's binary)
+ * and its startup cost start from per-sanitizer defaults and are
+ * calibrated from (clean, stage) wall-time pairs of earlier runs kept in
+ * <cache root>/runtime_stats.tsv: the slowdown is the p90 ratio of
+ * programs that ran long enough to measure one, the startup the p90 time
+ * of programs whose clean run was negligible.
+ *
+ * A program whose clean run hits cleanLimit() is treated as hanging; its
+ * other runs get hangDeadline(), enough for a sanitizer to report the
+ * undefined behavior that may have made the optimized build loop.
+ * REFUZZER_TIMEOUT_CAP sets the cap in seconds (default 30).
+ * */
+class RuntimeBudget {
+public:
+  struct Percentiles {
+    size_t samples = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+  };
+
+private:
+  static constexpr double headroom = 3.0;
+  static constexpr double floorSeconds = 2.0;
+  // Pairs kept per stage in the stats file.
+  static constexpr size_t keptPairs = 500;
+  // Clean runs below this are dominated by process startup.
+  static constexpr double negligibleSeconds = 0.01;
+  static constexpr double measurableSeconds = 0.05;
+  static constexpr size_t minCalibrationSamples = 20;
+
+  std::string path;
+  std::mutex mutex;
+  // stage -> (clean seconds, stage seconds), loaded and this run's.
+  std::map<std::string, std::vector<std::pair<double, double>>> pairs;
+  std::map<std::string, std::vector<std::pair<double, double>>> pending;
+  // stage -> wall times of this run, for the summary.
+  std::map<std::string, std::vector<double>> wallTimes;
+
+  static std::map<std::string, std::vector<std::pair<double, double>>> load(const std::string &path) {
+    std::map<std::string, std::vector<std::pair<double, double>>> loaded;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+      std::stringstream fields(line);
+      std::string stage;
+      double clean, seconds;
+      if (std::getline(fields, stage, '\t') && fields >> clean >> seconds) {
+        loaded[stage].push_back({clean, seconds});
+      }
+    }
+    return loaded;
+  }
+
+  static double percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) {
+      return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+    return values[std::min(index, values.size() - 1)];
+  }
+
+  // Default slowdown and startup seconds of a build with these
+  // sanitizers; several in one build multiply. "unoptimized" is an -O0
+  // build compared with the -O2 one.
+  static std::pair<double, double> defaults(const std::vector<std::string> &kinds) {
+    static const std::map<std::string, std::pair<double, double>> table = {
+        {"address", {3.0, 0.2}}, {"undefined", {1.5, 0.05}}, {"memory", {4.0, 0.2}},
+        {"thread", {15.0, 0.5}}, {"leak", {1.5, 0.2}}, {"unoptimized", {5.0, 0.05}},
+    };
+    double slowdown = 1.0, startup = 0.05;
+    for (const auto &kind : kinds) {
+      auto it = table.find(kind);
+      if (it != table.end()) {
+        slowdown *= it->second.first;
+        startup = std::max(startup, it->second.second);
+      }
+    }
+    return {slowdown, startup};
+  }
+
+public:
+  explicit RuntimeBudget(const std::string &path = CacheUtils::cacheRoot() + "/runtime_stats.tsv")
+      : path(path), pairs(load(path)) {}
+
+  ~RuntimeBudget() { save(); }
+
+  RuntimeBudget(const RuntimeBudget &) = delete;
+  RuntimeBudget &operator=(const RuntimeBudget &) = delete;
+
+  static double cap() {
+    const char *value = std::getenv("REFUZZER_TIMEOUT_CAP");
+    double seconds = value ? std::atof(value) : 0;
+    return seconds > 0 ? seconds : 30;
+  }
+
+  // Limit for the clean -O2 run itself.
+  static double cleanLimit() { return std::min(cap(), 10.0); }
+
+  static double hangDeadline() { return std::min(cap(), 5.0); }
+
+  // Deadline in seconds for running `stage` (built with `kinds`) of a
+  // program whose clean run took cleanSeconds; negative when unknown.
+  double deadline(const std::string &stage, const std::vector<std::string> &kinds,
+                  double cleanSeconds) {
+    if (cleanSeconds < 0) {
+      return cap();
+    }
+    if (cleanSeconds >= cleanLimit()) {
+      return hangDeadline();
+    }
+    auto [slowdown, startup] = defaults(kinds);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      std::vector<double> ratios, startups;
+      for (const auto &[clean, seconds] : pairs[stage]) {
+        if (clean >= measurableSeconds) {
+          ratios.push_back(seconds / clean);
+        } else if (clean < negligibleSeconds) {
+          startups.push_back(seconds);
+        }
+      }
+      if (ratios.size() >= minCalibrationSamples) {
+        slowdown = std::max(1.0, percentile(ratios, 0.9));
+      }
+      if (startups.size() >= minCalibrationSamples) {
+        startup = percentile(startups, 0.9);
+      }
+    }
+    double predicted = startup + cleanSeconds * slowdown;
+    // Tenths of a second are plenty and keep the log readable.
+    double seconds = std::ceil(headroom * predicted * 10) / 10;
+    return std::min(cap(), std::max(floorSeconds, seconds));
+  }
+
+  // Wall time of one run of `stage`. Completed runs with a known clean
+  // time also calibrate later deadlines.
+  void record(const std::string &stage, double seconds, double cleanSeconds = -1,
+              bool completed = true) {
+    std::lock_guard<std::mutex> lock(mutex);
+    wallTimes[stage].push_back(seconds);
+    if (completed && cleanSeconds >= 0 && cleanSeconds < cleanLimit()) {
+      pairs[stage].push_back({cleanSeconds, seconds});
+      pending[stage].push_back({cleanSeconds, seconds});
+    }
+  }
+
+  Percentiles percentiles(const std::string &stage) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const std::vector<double> &values = wallTimes[stage];
+    Percentiles result;
+    result.samples = values.size();
+    result.p50 = percentile(values, 0.5);
+    result.p90 = percentile(values, 0.9);
+    result.p99 = percentile(values, 0.99);
+    result.max = values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+    return result;
+  }
+
+  void printStats() {
+    std::vector<std::string> stages;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (const auto &entry : wallTimes) {
+        stages.push_back(entry.first);
+      }
+    }
+    if (stages.empty()) {
+      return;
+    }
+    std::ostringstream table;
+    table << "Run times (p50 / p90 / p99 / max seconds):" << std::endl << std::fixed << std::setprecision(3);
+    for (const auto &stage : stages) {
+      Percentiles stats = percentiles(stage);
+      table << "  " << std::left << std::setw(12) << stage << std::right << stats.p50 << " / " << stats.p90
+            << " / " << stats.p99 << " / " << stats.max << "  (" << stats.samples << " runs)" << std::endl;
+    }
+    std::cout << table.str();
+  }
+
+  // Adds this run's pairs to the file, keeping the newest keptPairs per
+  // stage.
+  void save() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending.empty()) {
+      return;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    auto merged = load(path);
+    for (const auto &[stage, values] : pending) {
+      auto &target = merged[stage];
+      target.insert(target.end(), values.begin(), values.end());
+      if (target.size() > keptPairs) {
+        target.erase(target.begin(), target.end() - keptPairs);
+      }
+    }
+
+    std::string temp = path + ".tmp." + std::to_string(getpid());
+    {
+      std::ofstream file(temp);
+      if (!file.is_open()) {
+        std::cerr << "Failed to write runtime stats: " << temp << std::endl;
+        return;
+      }
+      for (const auto &[stage, values] : merged) {
+        for (const auto &[clean, seconds] : values) {
+          file << stage << "\t" << clean << "\t" << seconds << "\n";
+        }
+      }
+    }
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+      std::cerr << "Failed to write runtime stats: " << ec.message() << std::endl;
+      std::filesystem::remove(temp, ec);
+      return;
+    }
+    pairs = std::move(merged);
+    pending.clear();
+  }
+};
+
+#endif // RUNTIME_BUDGET_HPP
@@ -0,0 +1,589 @@
+#ifndef SANITIZE_PIPELINE_HPP
+#define SANITIZE_PIPELINE_HPP
+
+#include "artifact_cache.hpp"
+#include "driver_job_cache.hpp"
+#include "msan_triage.hpp"
+#include "object_generator.hpp"
+#include "pch_cache.hpp"
+#include "process_runner.hpp"
+#include "runtime_budget.hpp"
+#include "sandbox.hpp"
+#include "sanitizer_history.hpp"
+#include "sanitizer_planner.hpp"
+#include "sanitizer_report.hpp"
+#include "symbolizer.hpp"
+#include "task_graph.hpp"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/** The `sanitize` command: checks every .cpp file of a directory under
+ * asan, msan and ubsan and sorts it into correct/ (with a clean -O2
+ * executable in object/) or incorrect/ (with its reports in
+ * sanitizer_log/).
+ *
+ * After a batched syntax-only tier, the work is a task graph with one
+ * build and one run node per (file, sanitizer) and a final node per file
+ * that depends on that file's runs. The clean -O2 executable is built
+ * and timed first; RuntimeBudget derives each sanitizer run's deadline
+ * from that time, so a hanging program is killed after a few seconds.
+ * Such a timeout depends on the machine's load and is not cached. Builds
+ * and runs are separate resource classes of the pool, so their
+ * concurrency is limited independently.
+ * Each file's console report is printed in one piece when it finishes.
+ *
+ * SanitizerPlanner decides the builds per file: asan and ubsan share one
+ * binary, and sanitizers that cannot fire on a program are skipped. The
+ * decisions are appended to sanitizer_log/plan.tsv. Each file's builds
+ * are ordered by their failure probability from SanitizerHistory; with
+ * earlyExit they also run one after the other, and the rest are skipped
+ * as soon as one sanitizer has condemned the file.
+ *
+ * Runs use the fast-run profile (no online symbolization); a failing
+ * binary is kept until finish(), which symbolizes the file's failure
+ * reports in one batch before logging and caching them. The findings
+ * of each report are parsed and their signatures recorded in
+ * sanitizer_log/signatures.tsv, so repeats of a known bug are marked.
+ *
+ * msan links against the uninstrumented system C++ library unless
+ * msanLibcxx names an MSan-instrumented libc++. Without one (msanLibcxx
+ * empty), reports that MsanTriage attributes to the library do not
+ * condemn the file. They are kept in sanitizer_log/msan_stdlib/ and
+ * counted in the summary. With an instrumented libc++ every msan report
+ * condemns the file.
+ * */
+class SanitizePipeline {
+public:
+  struct Settings {
+    std::string dirName = "../test";
+    size_t batchSize = 8;
+    // 0 picks the number of available CPUs.
+    size_t jobs = 0;
+    size_t compileJobs = 0;
+    size_t runJobs = 0;
+    // Stop checking a file after its first failing sanitizer.
+    bool earlyExit = false;
+    // Install prefix of an MSan-instrumented libc++; empty builds msan
+    // against the system library and triages its reports.
+    std::string msanLibcxx;
+  };
+
+private:
+  struct SanitizerJob {
+    std::string name;
+    std::string flags;
+    std::vector<std::string> env;
+    std::vector<std::string> kinds;
+    std::string binary;
+    std::string cacheKey;
+    bool built = false;
+    bool skipped = false;
+    bool hasErrors = false;
+    // Report for sanitizer_log/<file>.log, when logged is set.
+    bool logged = false;
+    std::string logOutput;
+    std::string report;
+    // Failed run whose report is logged and cached by finish().
+    bool failedRun = false;
+    // Killed at its deadline, which depends on the machine's load; such
+    // a run is not cached.
+    bool timedOut = false;
+    std::string verdict;
+    int exitCode = 0;
+    // Report attributed to the uninstrumented standard library.
+    bool triaged = false;
+  };
+
+  struct FileJob {
+    std::string filename;
+    std::string basename;
+    std::string filepath;
+    SanitizerPlanner::Plan plan;
+    std::vector<std::string> tags;
+    std::vector<SanitizerJob> sanitizers;
+    std::string cleanExecutable;
+    bool cleanBuilt = false;
+    // Wall time of the clean run; negative when unknown.
+    double cleanSeconds = -1;
+  };
+
+  Settings settings;
+  std::string sanLog;
+  std::string correctDir;
+  std::string incorrectDir;
+  std::string objectDir;
+
+  PchCache pchCache;
+  ArtifactCache artifactCache;
+  DriverJobCache jobCache;
+  SanitizerHistory history;
+  RuntimeBudget budget;
+  Symbolizer symbolizer;
+  std::mutex outputMutex;
+  // Guarded by outputMutex.
+  std::unique_ptr<SignatureIndex> signatures;
+  std::atomic<int> skippedBuilds{0};
+  std::atomic<int> correctFiles{0};
+  std::atomic<int> incorrectFiles{0};
+  std::atomic<int> msanTriaged{0};
+  std::atomic<int> repairsAvoided{0};
+
+  static void appendSanitizerLog(const std::string &logFile,
+                                 const std::string &sanitizer,
+                                 const std::string &output) {
+    std::ofstream log(logFile, std::ios::app);
+    if (!log.is_open()) {
+      std::cerr << "Failed to open log file: " << logFile << std::endl;
+      return;
+    }
+    log << "=== " << sanitizer << " START ===" << std::endl;
+    log << output;
+    log << "=== " << sanitizer << " END ===" << std::endl;
+  }
+
+  std::vector<SanitizerPlanner::Sanitizer> requestedSanitizers() const {
+    // Origins let MsanTriage see where uninitialized bytes came from.
+    std::string msanFlags = "-fno-omit-frame-pointer -g -O0 -w -fsanitize-memory-track-origins";
+    if (!settings.msanLibcxx.empty()) {
+      const std::string &prefix = settings.msanLibcxx;
+      msanFlags += " -stdlib=libc++ -nostdinc++ -isystem " + prefix + "/include/c++/v1 -L" + prefix +
+                   "/lib -Wl,-rpath," + prefix + "/lib";
+    }
+    return {
+        {"asan", "address", "-O0 -w -fno-omit-frame-pointer -g",
+         {"ASAN_OPTIONS=detect_stack_use_after_return=1"}},
+        {"msan", "memory", msanFlags, {}},
+        {"ubsan", "undefined", "-g -O1 -w",
+         {"UBSAN_OPTIONS=abort_on_error=1:print_stacktrace=1"}},
+    };
+  }
+
+  static std::vector<SanitizerJob> sanitizersFor(const FileJob &file) {
+    std::vector<SanitizerJob> jobs;
+    for (const auto &step : file.plan.steps) {
+      SanitizerJob job;
+      job.name = step.name;
+      job.flags = step.flags;
+      job.env = step.env;
+      job.kinds = step.kinds;
+      job.binary = "./" + file.basename + "_" + step.name;
+      jobs.push_back(std::move(job));
+    }
+    return jobs;
+  }
+
+  void buildSanitized(const FileJob &file, SanitizerJob &job) {
+    // With early exit the previous sanitizers have finished by now.
+    if (settings.earlyExit) {
+      for (const auto &previous : file.sanitizers) {
+        if (&previous == &job) {
+          break;
+        }
+        if (previous.hasErrors) {
+          job.skipped = true;
+          job.report = "    " + job.name + " - skipped (verdict already decided)\n";
+          skippedBuilds++;
+          return;
+        }
+      }
+    }
+
+    std::ostringstream report;
+    report << "  Running " << job.name << "..." << std::endl;
+
+    job.cacheKey = artifactCache.key(
+        "clang++", job.flags, file.filepath,
+        "sanitize:" + job.name + "\n" +
+            Sandbox::cacheContext(SanitizerPlanner::mergeEnv(job.env, Sandbox::sanitizerLimits()), true));
+    ArtifactCache::Entry cached;
+    if (artifactCache.lookup(job.cacheKey, cached)) {
+      if (cached.verdict == "ok") {
+        report << "    " << job.name << " - OK (cached)" << std::endl;
+      } else if (cached.verdict == "compile-error") {
+        report << "    " << job.name << " compilation failed (cached)" << std::endl;
+        job.hasErrors = true;
+      } else {
+        report << "    " << job.name << " - " << cached.verdict << " (cached)" << std::endl;
+        job.logged = true;
+        job.logOutput = cached.diagnostics;
+        job.hasErrors = true;
+      }
+      job.report = report.str();
+      triageMemoryReport(file, job);
+      return;
+    }
+
+    std::string pchFlags = pchCache.includeFlags("clang++", job.flags, file.filepath);
+    ProcessRunner::Options compileOptions;
+    compileOptions.mergeStderr = true;
+    ProcessRunner::Result compiled;
+    DriverJobCache::Invocation direct;
+    if (jobCache.instantiate("clang++", job.flags + " " + pchFlags, file.filepath, job.binary, direct)) {
+      compiled = DriverJobCache::run(direct, compileOptions);
+      DriverJobCache::cleanup(direct);
+    } else {
+      std::vector<std::string> compileCmd = ProcessRunner::splitArgs("clang++ " + job.flags + " " + pchFlags);
+      compileCmd.insert(compileCmd.end(), {file.filepath, "-o", job.binary});
+      compiled = ProcessRunner::run(compileCmd, compileOptions);
+    }
+    if (!compiled.success() && !pchFlags.empty() && PchCache::isPchFailure(compiled.out)) {
+      std::vector<std::string> compileCmd = ProcessRunner::splitArgs("clang++ " + job.flags);
+      compileCmd.insert(compileCmd.end(), {file.filepath, "-o", job.binary});
+      compiled = ProcessRunner::run(compileCmd, compileOptions);
+    }
+    if (!compiled.success()) {
+      report << "    " << job.name << " compilation failed" << std::endl;
+      job.hasErrors = true;
+      history.record(file.tags, job.name, true);
+      artifactCache.store(job.cacheKey, {false, compiled.exitCode, "compile-error", compiled.out});
+      // TODO: Add compilation error logging to the main log file
+    } else {
+      job.built = true;
+    }
+    job.report = report.str();
+  }
+
+  void runSanitized(const FileJob &file, SanitizerJob &job) {
+    if (!job.built) {
+      return;
+    }
+    std::ostringstream report;
+    double deadline = budget.deadline(job.name, job.kinds, file.cleanSeconds);
+    ProcessRunner::Options runOptions;
+    runOptions.env = SanitizerPlanner::mergeEnv(job.env, Sandbox::sanitizerLimits());
+    runOptions.timeoutSeconds = deadline;
+    runOptions.cpuSeconds = deadline;
+    runOptions.mergeStderr = true;
+    // Sanitizer runtimes reserve far more address space than RLIMIT_AS
+    // could allow; their RSS limit comes from sanitizerLimits().
+    runOptions.sandbox = Sandbox::forGeneratedBinary(true);
+    ProcessRunner::Result result = ProcessRunner::run({job.binary}, runOptions);
+    budget.record(job.name, result.wallSeconds, file.cleanSeconds, result.success());
+
+    if (result.success()) {
+      std::error_code ec;
+      std::filesystem::remove(job.binary, ec);
+      report << "    " << job.name << " - OK" << std::endl;
+      artifactCache.store(job.cacheKey, {true, 0, "ok", ""});
+    } else {
+      // The binary stays for the symbolizer; finish() removes it.
+      job.verdict = result.timedOut ? "TIMEOUT" : "ERROR DETECTED";
+      if (result.timedOut) {
+        report << "    " << job.name << " - TIMEOUT (" << deadline << "s)" << std::endl;
+      } else {
+        report << "    " << job.name << " - ERROR DETECTED (exit code: " << result.exitCode << ")" << std::endl;
+      }
+      job.hasErrors = true;
+      job.logged = true;
+      job.failedRun = true;
+      job.timedOut = result.timedOut || result.cpuLimitHit;
+      job.exitCode = result.exitCode;
+      job.logOutput = result.out;
+    }
+    job.report += report.str();
+    if (job.failedRun) {
+      triageMemoryReport(file, job);
+    }
+    history.record(file.tags, job.name, job.hasErrors);
+  }
+
+  // Clears the verdict of an msan report that only blames the
+  // uninstrumented standard library; the report is kept for inspection
+  // in sanitizer_log/msan_stdlib/.
+  void triageMemoryReport(const FileJob &file, SanitizerJob &job) {
+    if (!settings.msanLibcxx.empty() ||
+        std::find(job.kinds.begin(), job.kinds.end(), "memory") == job.kinds.end()) {
+      return;
+    }
+    // Early exit needs the verdict before finish(), so this report is
+    // symbolized now rather than in the file's batch.
+    if (job.failedRun && Symbolizer::hasRawFrames(job.logOutput)) {
+      job.logOutput = symbolizer.symbolize(job.logOutput);
+    }
+    std::vector<SanitizerReport::Finding> findings = SanitizerReport::parse(job.logOutput);
+    std::string reason;
+    if (!MsanTriage::onlyStandardLibrary(findings, reason)) {
+      return;
+    }
+    job.hasErrors = false;
+    job.logged = false;
+    job.triaged = true;
+    job.report += "      not actionable: " + reason + " (uninstrumented standard library)\n";
+    msanTriaged++;
+
+    std::lock_guard<std::mutex> lock(outputMutex);
+    std::error_code ec;
+    std::filesystem::create_directories(sanLog + "/msan_stdlib", ec);
+    appendSanitizerLog(sanLog + "/msan_stdlib/" + file.basename + ".log", job.name, job.logOutput);
+    std::ofstream tsv(sanLog + "/msan_triage.tsv", std::ios::app);
+    tsv << file.filename << "\t" << findings.front().signature << "\t" << reason << "\n";
+  }
+
+  // Symbolizes the file's failure reports in one batch, then caches them
+  // (all but timeouts) and removes the binaries that were kept for it.
+  void symbolizeFailures(FileJob &file) {
+    std::vector<SanitizerJob *> failed;
+    std::vector<std::string> reports;
+    for (auto &job : file.sanitizers) {
+      if (job.failedRun) {
+        failed.push_back(&job);
+        reports.push_back(job.logOutput);
+      }
+    }
+    if (failed.empty()) {
+      return;
+    }
+    std::vector<std::string> symbolized = symbolizer.symbolizeAll(reports);
+    for (size_t i = 0; i < failed.size(); i++) {
+      SanitizerJob &job = *failed[i];
+      job.logOutput = symbolized[i];
+      if (!job.timedOut) {
+        artifactCache.store(job.cacheKey, {false, job.exitCode, job.verdict, job.logOutput});
+      }
+      std::error_code ec;
+      std::filesystem::remove(job.binary, ec);
+    }
+  }
+
+  // Builds the clean -O2 executable that later stages run.
+  bool buildCleanExecutable(const FileJob &file, const std::string &cleanExecutable) {
+    std::string cleanKey = artifactCache.key("clang++", "-O2", file.filepath);
+    ArtifactCache::Entry cachedClean;
+    if (artifactCache.lookup(cleanKey, cachedClean, cleanExecutable) && cachedClean.success) {
+      return true;
+    }
+    std::string pchFlags = pchCache.includeFlags("clang++", "-O2", file.filepath);
+    std::vector<std::string> createExecCmd = ProcessRunner::splitArgs("clang++ -O2 " + pchFlags);
+    createExecCmd.insert(createExecCmd.end(), {file.filepath, "-o", cleanExecutable});
+
+    ProcessRunner::Options compileOptions;
+    compileOptions.mergeStderr = true;
+    ProcessRunner::Result built = ProcessRunner::run(createExecCmd, compileOptions);
+    if (!built.success() && !pchFlags.empty() && PchCache::isPchFailure(built.out)) {
+      built = ProcessRunner::run({"clang++", "-O2", file.filepath, "-o", cleanExecutable}, compileOptions);
+    }
+    int execResult = built.exitCode;
+    artifactCache.store(cleanKey, {execResult == 0, execResult, execResult == 0 ? "ok" : "error", built.out},
+                        execResult == 0 ? cleanExecutable : "");
+    return execResult == 0;
+  }
+
+  void buildClean(FileJob &file) {
+    file.cleanBuilt = buildCleanExecutable(file, file.cleanExecutable);
+  }
+
+  // One run of the clean executable; its wall time sets the deadlines of
+  // the file's sanitizer runs.
+  void measureClean(FileJob &file) {
+    if (!file.cleanBuilt) {
+      return;
+    }
+    ProcessRunner::Options runOptions;
+    runOptions.timeoutSeconds = RuntimeBudget::cleanLimit();
+    runOptions.cpuSeconds = RuntimeBudget::cleanLimit();
+    runOptions.sandbox = Sandbox::forGeneratedBinary(false);
+    ProcessRunner::Result result = ProcessRunner::run({file.cleanExecutable}, runOptions);
+    file.cleanSeconds = result.timedOut || result.cpuLimitHit ? RuntimeBudget::cleanLimit() : result.wallSeconds;
+    budget.record("clean", result.wallSeconds);
+  }
+
+  void finish(FileJob &file) {
+    std::ostringstream report;
+    report << "\nProcessing: " << file.filename << std::endl;
+    for (const auto &skipped : file.plan.skipped) {
+      report << "  Skipped " << skipped << std::endl;
+    }
+
+    symbolizeFailures(file);
+    bool hasErrors = false;
+    bool triaged = false;
+    std::string logFile = sanLog + "/" + file.basename + ".log";
+    for (auto &job : file.sanitizers) {
+      report << job.report;
+      hasErrors = hasErrors || job.hasErrors;
+      triaged = triaged || job.triaged;
+      if (job.logged) {
+        appendSanitizerLog(logFile, job.name, job.logOutput);
+        std::vector<SanitizerReport::Finding> findings = SanitizerReport::parse(job.logOutput);
+        std::lock_guard<std::mutex> lock(outputMutex);
+        for (const auto &finding : findings) {
+          std::string firstSeen = signatures->add(finding, file.filename);
+          report << "      " << finding.kind << " at " << finding.location << " [" << finding.signature
+                 << "] " << (firstSeen.empty() ? "new" : "also in " + firstSeen) << std::endl;
+        }
+      }
+    }
+
+    if (!hasErrors && triaged) {
+      // Without triage this file would have gone to incorrect/ and into
+      // an LLM repair round.
+      repairsAvoided++;
+    }
+    if (file.cleanSeconds >= RuntimeBudget::cleanLimit()) {
+      report << "  Clean run did not finish within " << RuntimeBudget::cleanLimit() << "s" << std::endl;
+    }
+    if (!hasErrors) {
+      if (file.cleanBuilt) {
+        report << "  Clean executable created: " << file.cleanExecutable << std::endl;
+      } else {
+        report << "  Warning: Failed to create clean executable" << std::endl;
+      }
+    } else if (file.cleanBuilt) {
+      std::error_code ec;
+      std::filesystem::remove(file.cleanExecutable, ec);
+    }
+    std::filesystem::path target =
+        std::filesystem::path(hasErrors ? incorrectDir : correctDir) / file.filename;
+    try {
+      std::filesystem::copy_file(file.filepath, target,
+                                 std::filesystem::copy_options::overwrite_existing);
+      if (hasErrors) {
+        incorrectFiles++;
+        report << "  Result: ERRORS DETECTED - moved to incorrect/" << std::endl;
+      } else {
+        correctFiles++;
+        report << "  Result: NO ISSUES - moved to correct/, executable in object/" << std::endl;
+      }
+    } catch (const std::filesystem::filesystem_error &e) {
+      report << "  Error copying file to " << (hasErrors ? "incorrect/" : "correct/")
+             << ": " << e.what() << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(outputMutex);
+    std::cout << report.str() << std::flush;
+  }
+
+public:
+  explicit SanitizePipeline(const Settings &settings)
+      : settings(settings), sanLog(settings.dirName + "/sanitizer_log"),
+        correctDir(settings.dirName + "/correct"),
+        incorrectDir(settings.dirName + "/incorrect"),
+        objectDir(settings.dirName + "/object") {}
+
+  // Returns the process exit status for the command.
+  int run() {
+    namespace fs = std::filesystem;
+    fs::create_directories(sanLog);
+    fs::create_directories(correctDir);
+    fs::create_directories(incorrectDir);
+    fs::create_directories(objectDir);
+    std::error_code ec;
+    fs::remove(sanLog + "/plan.tsv", ec);
+    fs::remove(sanLog + "/msan_triage.tsv", ec);
+    fs::remove_all(sanLog + "/msan_stdlib", ec);
+    signatures = std::make_unique<SignatureIndex>(sanLog + "/signatures.tsv");
+
+    std::cout << "Running sanitizers on C++ files in: " << settings.dirName << std::endl;
+    std::cout << "If directory is not provided, default ../test will be used" << std::endl;
+    std::cout << "Results will be organized inside: " << settings.dirName << std::endl;
+
+    int totalFiles = 0;
+    try {
+      // First tier for the whole directory, batchSize programs per
+      // -fsyntax-only invocation.
+      std::vector<std::string> candidates;
+      for (const auto &entry : fs::directory_iterator(settings.dirName)) {
+        if (entry.path().extension() == ".cpp") {
+          candidates.push_back(entry.path().string());
+        }
+      }
+      GenerateObject syntaxChecker;
+      std::vector<bool> parses = syntaxChecker.checkSyntax(candidates, settings.dirName, settings.batchSize);
+
+      std::vector<FileJob> files;
+      for (size_t i = 0; i < candidates.size(); i++) {
+        totalFiles++;
+        fs::path path(candidates[i]);
+        // Programs that do not even parse go straight to the repair queue
+        // (<dir>/log) instead of failing three sanitizer builds in a row.
+        if (!parses[i]) {
+          std::cout << "\nProcessing: " << path.filename().string() << std::endl;
+          try {
+            fs::copy_file(path, fs::path(incorrectDir) / path.filename(), fs::copy_options::overwrite_existing);
+            incorrectFiles++;
+            std::cout << "  Result: SYNTAX ERRORS - moved to incorrect/, diagnostics in log/" << std::endl;
+          } catch (const fs::filesystem_error &e) {
+            std::cerr << "  Error copying file to incorrect/: " << e.what() << std::endl;
+          }
+          continue;
+        }
+        FileJob file;
+        file.filename = path.filename().string();
+        file.basename = path.stem().string();
+        file.filepath = candidates[i];
+        file.plan = SanitizerPlanner::planFile(file.filepath, requestedSanitizers());
+        SanitizerPlanner::record(sanLog + "/plan.tsv", file.filepath, file.plan);
+        SanitizerPlanner::useFastRunProfile(file.plan);
+        file.tags = SanitizerHistory::tags(file.plan.features);
+        history.order(file.plan.steps, file.tags);
+        file.sanitizers = sanitizersFor(file);
+        file.cleanExecutable = objectDir + "/" + file.basename;
+        files.push_back(std::move(file));
+      }
+
+      size_t cpus = TaskGraph::availableCpus();
+      TaskGraph graph;
+      size_t compile = graph.addResource(settings.compileJobs ? settings.compileJobs : cpus);
+      size_t running = graph.addResource(settings.runJobs ? settings.runJobs : cpus);
+      for (auto &file : files) {
+        TaskGraph::TaskId cleanBuilt = graph.addTask(compile, [this, &file] { buildClean(file); });
+        TaskGraph::TaskId measured = graph.addTask(running, [this, &file] { measureClean(file); }, {cleanBuilt});
+        std::vector<TaskGraph::TaskId> runs = {measured};
+        for (auto &job : file.sanitizers) {
+          // Early exit chains the file's builds behind the previous run.
+          std::vector<TaskGraph::TaskId> after;
+          if (settings.earlyExit && runs.size() > 1) {
+            after.push_back(runs.back());
+          }
+          TaskGraph::TaskId built = graph.addTask(compile, [this, &file, &job] { buildSanitized(file, job); }, after);
+          runs.push_back(graph.addTask(running, [this, &file, &job] { runSanitized(file, job); }, {built, measured}));
+        }
+        graph.addTask(compile, [this, &file] { finish(file); }, runs);
+      }
+      std::cout << "Scheduling " << graph.size() << " tasks for " << files.size() << " files on "
+                << (settings.jobs ? settings.jobs : cpus) << " workers" << std::endl;
+      graph.run(settings.jobs);
+      history.save();
+      budget.save();
+      signatures->save();
+    } catch (const fs::filesystem_error &e) {
+      std::cerr << "Filesystem error: " << e.what() << std::endl;
+      return 1;
+    }
+
+    artifactCache.printStats();
+    budget.printStats();
+    if (totalFiles == 0) {
+      std::cout << "No .cpp files found in " << settings.dirName << " directory." << std::endl;
+    } else {
+      std::cout << "\n=== SANITIZER SUMMARY ===" << std::endl;
+      std::cout << "Total files processed: " << totalFiles << std::endl;
+      std::cout << "Files with no issues: " << correctFiles << std::endl;
+      std::cout << "Files with errors detected: " << incorrectFiles << std::endl;
+      if (settings.earlyExit) {
+        std::cout << "Sanitizer builds skipped by early exit: " << skippedBuilds << std::endl;
+      }
+      if (settings.msanLibcxx.empty()) {
+        std::cout << "MSan reports from the uninstrumented standard library: " << msanTriaged
+                  << " (repairs avoided: " << repairsAvoided << ")" << std::endl;
+      }
+      std::cout << "\nResults organized in:" << std::endl;
+      std::cout << "  " << correctDir << "/ - Clean source files" << std::endl;
+      std::cout << "  " << objectDir << "/ - Clean executables" << std::endl;
+      std::cout << "  " << incorrectDir << "/ - Files with detected errors" << std::endl;
+      std::cout << "  " << sanLog << "/ - Error logs (" << signatures->size() << " distinct signatures)" << std::endl;
+    }
+    return 0;
+  }
+};
+
+#endif // SANITIZE_PIPELINE_HPP
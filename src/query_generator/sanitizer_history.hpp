@@ -0,0 +1,147 @@
+#ifndef SANITIZER_HISTORY_HPP
+#define SANITIZER_HISTORY_HPP
+
+#include "cache_utils.hpp"
+#include "sanitizer_planner.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+/** Campaign history of sanitizer verdicts, kept per program feature in
+ * <cache root>/sanitizer_history.tsv. Runs are ordered by the estimated
+ * probability that they fail for a program with the given features, so
+ * that with early exit the deciding sanitizer tends to run first.
+ *
+ * The estimate is the Laplace-smoothed failure rate (failures + 1) /
+ * (runs + 2) of every feature tag the program has, averaged; an unseen
+ * sanitizer starts at 0.5. New counts are merged into the file on save,
+ * so concurrent campaigns lose at most each other's last few updates.
+ * */
+class SanitizerHistory {
+private:
+  struct Counts {
+    uint64_t runs = 0;
+    uint64_t failures = 0;
+  };
+
+  std::string path;
+  // "<tag>\t<sanitizer>" -> counts, loaded and not yet saved.
+  std::map<std::string, Counts> counts;
+  std::map<std::string, Counts> pending;
+  std::mutex mutex;
+
+  static std::map<std::string, Counts> load(const std::string &path) {
+    std::map<std::string, Counts> loaded;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+      std::stringstream fields(line);
+      std::string tag, sanitizer;
+      Counts entry;
+      if (std::getline(fields, tag, '\t') && std::getline(fields, sanitizer, '\t') &&
+          fields >> entry.runs >> entry.failures) {
+        loaded[tag + "\t" + sanitizer] = entry;
+      }
+    }
+    return loaded;
+  }
+
+public:
+  explicit SanitizerHistory(const std::string &path = CacheUtils::cacheRoot() + "/sanitizer_history.tsv")
+      : path(path), counts(load(path)) {}
+
+  ~SanitizerHistory() { save(); }
+
+  SanitizerHistory(const SanitizerHistory &) = delete;
+  SanitizerHistory &operator=(const SanitizerHistory &) = delete;
+
+  static std::vector<std::string> tags(const SanitizerPlanner::Features &features) {
+    return {"any",
+            features.threads ? "threads" : "no-threads",
+            features.dynamicAllocation ? "alloc" : "no-alloc",
+            features.pointersOrArrays ? "pointers" : "no-pointers"};
+  }
+
+  double failureProbability(const std::vector<std::string> &tags,
+                            const std::string &sanitizer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    double sum = 0;
+    for (const auto &tag : tags) {
+      Counts entry = counts[tag + "\t" + sanitizer];
+      sum += (entry.failures + 1.0) / (entry.runs + 2.0);
+    }
+    return tags.empty() ? 0.5 : sum / tags.size();
+  }
+
+  // Most likely failure first; ties keep the planner's order.
+  void order(std::vector<SanitizerPlanner::Step> &steps,
+             const std::vector<std::string> &tags) {
+    std::vector<std::pair<double, SanitizerPlanner::Step>> scored;
+    for (auto &step : steps) {
+      scored.push_back({failureProbability(tags, step.name), std::move(step)});
+    }
+    std::stable_sort(scored.begin(), scored.end(),
+                     [](const auto &a, const auto &b) { return a.first > b.first; });
+    for (size_t i = 0; i < steps.size(); i++) {
+      steps[i] = std::move(scored[i].second);
+    }
+  }
+
+  void record(const std::vector<std::string> &tags, const std::string &sanitizer,
+              bool failed) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &tag : tags) {
+      for (auto *table : {&counts, &pending}) {
+        Counts &entry = (*table)[tag + "\t" + sanitizer];
+        entry.runs++;
+        entry.failures += failed ? 1 : 0;
+      }
+    }
+  }
+
+  // Adds the new counts to whatever is on disk now and replaces the file.
+  void save() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending.empty()) {
+      return;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    std::map<std::string, Counts> merged = load(path);
+    for (const auto &[key, entry] : pending) {
+      merged[key].runs += entry.runs;
+      merged[key].failures += entry.failures;
+    }
+
+    std::string temp = path + ".tmp." + std::to_string(getpid());
+    {
+      std::ofstream file(temp);
+      if (!file.is_open()) {
+        std::cerr << "Failed to write sanitizer history: " << temp << std::endl;
+        return;
+      }
+      for (const auto &[key, entry] : merged) {
+        file << key << "\t" << entry.runs << "\t" << entry.failures << "\n";
+      }
+    }
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+      std::cerr << "Failed to write sanitizer history: " << ec.message() << std::endl;
+      std::filesystem::remove(temp, ec);
+      return;
+    }
+    counts = std::move(merged);
+    pending.clear();
+  }
+};
+
+#endif // SANITIZER_HISTORY_HPP
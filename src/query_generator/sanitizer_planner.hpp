@@ -0,0 +1,366 @@
+#ifndef SANITIZER_PLANNER_HPP
+#define SANITIZER_PLANNER_HPP
+
+#include "process_runner.hpp"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/** Decides which sanitizer builds a program needs. A cheap scan of the
+ * source finds the features that make a sanitizer applicable (threads
+ * for tsan, heap allocation for lsan, pointers or arrays for asan), and
+ * compatible sanitizers are merged into a single instrumented binary:
+ * address, undefined and leak share one build, while memory and thread
+ * each need their own. LeakSanitizer is part of AddressSanitizer on
+ * Linux, so a requested leak check rides along with asan when both
+ * apply.
+ * */
+class SanitizerPlanner {
+public:
+  struct Sanitizer {
+    // Short name, e.g. "asan".
+    std::string name;
+    // The -fsanitize= value, e.g. "address" or "address,undefined".
+    std::string kind;
+    // Remaining compile flags (optimization, debug info, ...).
+    std::string flags;
+    // KEY=opt1=v:opt2=v entries for the run environment.
+    std::vector<std::string> env;
+  };
+
+  struct Features {
+    bool threads = false;
+    bool dynamicAllocation = false;
+    bool pointersOrArrays = false;
+  };
+
+  struct Step {
+    // Joined names, e.g. "asan+ubsan".
+    std::string name;
+    // Full compile flags including the merged -fsanitize=.
+    std::string flags;
+    // The -fsanitize= values of the build.
+    std::vector<std::string> kinds;
+    std::vector<std::string> env;
+    std::vector<std::string> covers;
+  };
+
+  struct Plan {
+    Features features;
+    std::vector<Step> steps;
+    // "<name>: <reason>" for every requested sanitizer that was dropped.
+    std::vector<std::string> skipped;
+  };
+
+  // Source text without comments and string/char literal contents, so
+  // that e.g. a printf("thread") does not count as thread usage.
+  static std::string stripCommentsAndLiterals(const std::string &source) {
+    std::string code;
+    code.reserve(source.size());
+    for (size_t i = 0; i < source.size(); i++) {
+      char c = source[i];
+      if (c == '/' && i + 1 < source.size() && source[i + 1] == '/') {
+        while (i < source.size() && source[i] != '\n') {
+          i++;
+        }
+        code += '\n';
+      } else if (c == '/' && i + 1 < source.size() && source[i + 1] == '*') {
+        size_t end = source.find("*/", i + 2);
+        i = end == std::string::npos ? source.size() : end + 1;
+        code += ' ';
+      } else if (c == '"' || c == '\'') {
+        // Keep the quotes so #include "..." stays recognizable.
+        code += c;
+        for (i++; i < source.size() && source[i] != c; i++) {
+          if (source[i] == '\\') {
+            i++;
+          }
+        }
+        code += c;
+      } else {
+        code += c;
+      }
+    }
+    return code;
+  }
+
+  static bool hasWord(const std::string &code, const std::string &word) {
+    size_t pos = 0;
+    while ((pos = code.find(word, pos)) != std::string::npos) {
+      bool startOk = pos == 0 || !(std::isalnum(static_cast<unsigned char>(code[pos - 1])) ||
+                                   code[pos - 1] == '_');
+      size_t end = pos + word.size();
+      bool endOk = end >= code.size() || !(std::isalnum(static_cast<unsigned char>(code[end])) ||
+                                           code[end] == '_');
+      if (startOk && endOk) {
+        return true;
+      }
+      pos = end;
+    }
+    return false;
+  }
+
+  static Features scan(const std::string &source) {
+    std::string code = stripCommentsAndLiterals(source);
+    auto any = [&code](const std::vector<std::string> &words) {
+      for (const auto &word : words) {
+        if (hasWord(code, word)) {
+          return true;
+        }
+      }
+      return false;
+    };
+
+    Features features;
+    features.threads =
+        code.find("<thread>") != std::string::npos ||
+        code.find("<atomic>") != std::string::npos ||
+        code.find("<pthread.h>") != std::string::npos ||
+        code.find("<future>") != std::string::npos ||
+        code.find("<stdatomic.h>") != std::string::npos ||
+        code.find("<threads.h>") != std::string::npos ||
+        any({"pthread_create", "thread", "jthread", "async", "atomic", "_Atomic",
+             "thrd_create"}) ||
+        code.find("#pragma omp") != std::string::npos;
+    features.dynamicAllocation =
+        any({"malloc", "calloc", "realloc", "aligned_alloc", "strdup", "strndup",
+             "new", "posix_memalign", "make_unique", "make_shared"});
+    features.pointersOrArrays =
+        features.dynamicAllocation ||
+        code.find('[') != std::string::npos ||
+        code.find("->") != std::string::npos ||
+        any({"memcpy", "memset", "memmove", "strcpy", "strcat", "vector",
+             "string", "array"}) ||
+        code.find('*') != std::string::npos;
+    return features;
+  }
+
+  static Plan plan(const Features &features,
+                   const std::vector<Sanitizer> &requested) {
+    Plan result;
+    result.features = features;
+    std::vector<const Sanitizer *> applicable;
+    bool addressApplies = false;
+    for (const auto &sanitizer : requested) {
+      if (sanitizer.kind == "thread" && !features.threads) {
+        result.skipped.push_back(sanitizer.name + ": no threads or atomics");
+      } else if (sanitizer.kind == "leak" && !features.dynamicAllocation) {
+        result.skipped.push_back(sanitizer.name + ": no dynamic allocation");
+      } else if (sanitizer.kind == "address" && !features.pointersOrArrays) {
+        result.skipped.push_back(sanitizer.name + ": no pointers, arrays or allocation");
+      } else {
+        applicable.push_back(&sanitizer);
+        addressApplies = addressApplies || hasKind(sanitizer.kind, "address");
+      }
+    }
+
+    // address, undefined and leak go into one build; the others alone.
+    Step shared;
+    std::vector<std::string> sharedKinds;
+    bool leakMerged = false;
+    for (const Sanitizer *sanitizer : applicable) {
+      bool combinable = true;
+      for (const auto &kind : kinds(sanitizer->kind)) {
+        combinable = combinable && (kind == "address" || kind == "undefined" || kind == "leak");
+      }
+      if (!combinable) {
+        result.steps.push_back(single(*sanitizer));
+        continue;
+      }
+      shared.name += (shared.name.empty() ? "" : "+") + sanitizer->name;
+      shared.covers.push_back(sanitizer->name);
+      if (sanitizer->kind == "leak" && addressApplies) {
+        leakMerged = true;
+      } else {
+        for (const auto &kind : kinds(sanitizer->kind)) {
+          if (std::find(sharedKinds.begin(), sharedKinds.end(), kind) == sharedKinds.end()) {
+            sharedKinds.push_back(kind);
+          }
+        }
+      }
+      shared.flags = mergeFlags(shared.flags, sanitizer->flags);
+      shared.env = mergeEnv(shared.env, sanitizer->env);
+    }
+    if (!shared.covers.empty()) {
+      std::string joined;
+      for (const auto &kind : sharedKinds) {
+        joined += (joined.empty() ? "" : ",") + kind;
+      }
+      shared.flags = "-fsanitize=" + joined + (shared.flags.empty() ? "" : " " + shared.flags);
+      shared.kinds = sharedKinds;
+      if (leakMerged) {
+        shared.env = mergeEnv(shared.env, {"ASAN_OPTIONS=detect_leaks=1"});
+      }
+      result.steps.insert(result.steps.begin(), shared);
+    }
+    return result;
+  }
+
+  static Plan planFile(const std::string &sourcePath,
+                       const std::vector<Sanitizer> &requested) {
+    std::ifstream file(sourcePath);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return plan(scan(buffer.str()), requested);
+  }
+
+  // Runtime options tuned for throughput instead of debugging: no online
+  // symbolization (Symbolizer does that later for the failures), short
+  // allocation stacks with the fast unwinder, and no leak check in asan
+  // when the program cannot leak or a separate leak build covers it. The
+  // options a sanitizer was configured with still take precedence.
+  static void useFastRunProfile(Plan &plan) {
+    auto has = [](const Step &step, const std::string &kind) {
+      return std::find(step.kinds.begin(), step.kinds.end(), kind) != step.kinds.end();
+    };
+    for (auto &step : plan.steps) {
+      std::vector<std::string> profile;
+      if (has(step, "address")) {
+        std::string asan = "ASAN_OPTIONS=symbolize=0:malloc_context_size=5:fast_unwind_on_malloc=1";
+        bool separateLeakBuild = false;
+        for (const auto &other : plan.steps) {
+          separateLeakBuild = separateLeakBuild || (&other != &step && has(other, "leak"));
+        }
+        if (!plan.features.dynamicAllocation || separateLeakBuild) {
+          asan += ":detect_leaks=0";
+        }
+        profile.push_back(asan);
+      } else if (has(step, "leak")) {
+        profile.push_back("LSAN_OPTIONS=symbolize=0:malloc_context_size=5:fast_unwind_on_malloc=1");
+      }
+      if (has(step, "undefined")) {
+        profile.push_back("UBSAN_OPTIONS=symbolize=0");
+      }
+      if (has(step, "memory")) {
+        profile.push_back("MSAN_OPTIONS=symbolize=0");
+      }
+      if (has(step, "thread")) {
+        profile.push_back("TSAN_OPTIONS=symbolize=0");
+      }
+      step.env = mergeEnv(profile, step.env);
+    }
+  }
+
+  // Appends "<file>\t<steps>\t<skipped>" to the plan log.
+  static void record(const std::string &logPath, const std::string &sourcePath,
+                     const Plan &plan) {
+    std::ofstream log(logPath, std::ios::app);
+    if (!log.is_open()) {
+      std::cerr << "Failed to open sanitizer plan log: " << logPath << std::endl;
+      return;
+    }
+    log << sourcePath << "\t";
+    for (size_t i = 0; i < plan.steps.size(); i++) {
+      log << (i ? " " : "") << plan.steps[i].name;
+    }
+    log << "\t";
+    for (size_t i = 0; i < plan.skipped.size(); i++) {
+      log << (i ? "; " : "") << "skip " << plan.skipped[i];
+    }
+    log << "\n";
+  }
+
+private:
+  static std::vector<std::string> kinds(const std::string &kind) {
+    std::vector<std::string> result;
+    std::stringstream stream(kind);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+      result.push_back(item);
+    }
+    return result;
+  }
+
+  static bool hasKind(const std::string &kind, const std::string &wanted) {
+    std::vector<std::string> all = kinds(kind);
+    return std::find(all.begin(), all.end(), wanted) != all.end();
+  }
+
+  static Step single(const Sanitizer &sanitizer) {
+    Step step;
+    step.name = sanitizer.name;
+    step.flags = "-fsanitize=" + sanitizer.kind +
+                 (sanitizer.flags.empty() ? "" : " " + sanitizer.flags);
+    step.env = sanitizer.env;
+    step.kinds = kinds(sanitizer.kind);
+    step.covers = {sanitizer.name};
+    return step;
+  }
+
+  // Union of two flag strings; for -O levels the lowest one wins, since
+  // the address checks are most precise without optimization.
+  static std::string mergeFlags(const std::string &base, const std::string &extra) {
+    std::vector<std::string> flags = ProcessRunner::splitArgs(base);
+    for (const auto &flag : ProcessRunner::splitArgs(extra)) {
+      bool present = false;
+      for (auto &existing : flags) {
+        if (existing == flag) {
+          present = true;
+        } else if (existing.rfind("-O", 0) == 0 && flag.rfind("-O", 0) == 0) {
+          existing = std::min(existing, flag);
+          present = true;
+        }
+      }
+      if (!present) {
+        flags.push_back(flag);
+      }
+    }
+    std::string merged;
+    for (const auto &flag : flags) {
+      merged += (merged.empty() ? "" : " ") + flag;
+    }
+    return merged;
+  }
+
+public:
+  // Merges KEY=a=1:b=2 entries by variable and option; later values win.
+  static std::vector<std::string> mergeEnv(const std::vector<std::string> &base,
+                                           const std::vector<std::string> &extra) {
+    std::vector<std::string> order;
+    std::map<std::string, std::vector<std::pair<std::string, std::string>>> options;
+    for (const auto *list : {&base, &extra}) {
+      for (const auto &entry : *list) {
+        size_t eq = entry.find('=');
+        std::string variable = entry.substr(0, eq);
+        if (!options.count(variable)) {
+          order.push_back(variable);
+          options[variable];
+        }
+        std::stringstream values(eq == std::string::npos ? "" : entry.substr(eq + 1));
+        std::string option;
+        while (std::getline(values, option, ':')) {
+          if (option.empty()) {
+            continue;
+          }
+          std::string key = option.substr(0, option.find('='));
+          bool replaced = false;
+          for (auto &existing : options[variable]) {
+            if (existing.first == key) {
+              existing.second = option;
+              replaced = true;
+            }
+          }
+          if (!replaced) {
+            options[variable].push_back({key, option});
+          }
+        }
+      }
+    }
+    std::vector<std::string> merged;
+    for (const auto &variable : order) {
+      std::string entry = variable + "=";
+      for (size_t i = 0; i < options[variable].size(); i++) {
+        entry += (i ? ":" : "") + options[variable][i].second;
+      }
+      merged.push_back(entry);
+    }
+    return merged;
+  }
+};
+
+#endif // SANITIZER_PLANNER_HPP
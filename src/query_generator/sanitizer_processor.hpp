@@ -5,26 +5,31 @@
 #include <fstream>
 #include <iostream>
 #include <string>
-#include <array>
 #include <sstream>
-#include <cstdio>
 #include <vector>
-#include <chrono>
-#include <thread>
-#include <sys/wait.h>
-#include <signal.h>
-#include <unistd.h>
-#include <fcntl.h>
+#include "artifact_cache.hpp"
+#include "child_supervisor.hpp"
+#include "driver_job_cache.hpp"
+#include "pattern_matcher.hpp"
+#include "process_runner.hpp"
+#include "runtime_budget.hpp"
+#include "sandbox.hpp"
+#include "sanitizer_history.hpp"
+#include "sanitizer_planner.hpp"
+#include "sanitizer_report.hpp"
+#include "symbolizer.hpp"
 
 namespace fs = std::filesystem;
 
 class SanitizerProcessor {
 private:
-    struct SanitizerConfig {
-        std::string name;
-        std::string flags;
-        std::string envVars;
-    };
+    ArtifactCache artifactCache;
+    DriverJobCache jobCache;
+    SanitizerHistory history;
+    RuntimeBudget budget;
+    Symbolizer symbolizer;
+    // Stop after the first failing sanitizer; see processSourceFile.
+    bool earlyExit;
 
     // Create suppression file if it doesn't exist
     void ensureSuppressionFile() {
@@ -71,17 +76,22 @@ private:
         }
     }
 
-    const std::vector<SanitizerConfig> configs = {
-        {"asan_ubsan", 
-         "-fsanitize=address,undefined -fsanitize-address-use-after-scope -fsanitize=function", 
-         "ASAN_OPTIONS=detect_odr_violation=0:detect_leaks=0 "
-         "UBSAN_OPTIONS=print_stacktrace=1"},
-        {"tsan", 
-         "-fsanitize=thread", 
-         "TSAN_OPTIONS=ignore_noninstrumented_modules=1"},
-        {"leak", 
-         "-fsanitize=leak", 
-         "LSAN_OPTIONS="}
+    // SanitizerPlanner drops tsan and leak for programs that cannot trigger
+    // them and folds leak into the asan_ubsan build when both apply.
+    const std::vector<SanitizerPlanner::Sanitizer> configs = {
+        {"asan_ubsan",
+         "address,undefined",
+         "-fsanitize-address-use-after-scope -fsanitize=function",
+         {"ASAN_OPTIONS=detect_odr_violation=0:detect_leaks=0",
+          "UBSAN_OPTIONS=print_stacktrace=1"}},
+        {"tsan",
+         "thread",
+         "",
+         {"TSAN_OPTIONS=ignore_noninstrumented_modules=1"}},
+        {"leak",
+         "leak",
+         "",
+         {"LSAN_OPTIONS="}}
     };
 
     bool createDirectory(const std::string& path) {
@@ -97,147 +107,126 @@ private:
         }
     }
 
+    // Builds and runs the clean -O2 program once; its wall time sets the
+    // deadlines of the sanitizer runs. Negative when it does not build.
+    double measureCleanRun(const std::string& sourcePath, const std::string& baseFilename) {
+        std::string executablePath = baseFilename + "_clean";
+        ProcessRunner::Options compileOptions;
+        compileOptions.timeoutSeconds = 30;
+        compileOptions.mergeStderr = true;
+        if (!ProcessRunner::run({"clang", "-O2", "-w", sourcePath, "-o", executablePath}, compileOptions).success()) {
+            return -1;
+        }
+        ProcessRunner::Options runOptions;
+        runOptions.timeoutSeconds = RuntimeBudget::cleanLimit();
+        runOptions.cpuSeconds = RuntimeBudget::cleanLimit();
+        runOptions.sandbox = Sandbox::forGeneratedBinary(false);
+        ProcessRunner::Result result = ProcessRunner::run({"./" + executablePath}, runOptions);
+        std::error_code ec;
+        fs::remove(executablePath, ec);
+        budget.record("clean", result.wallSeconds);
+        if (result.timedOut || result.cpuLimitHit) {
+            std::cout << "Clean run did not finish within " << RuntimeBudget::cleanLimit() << "s" << std::endl;
+            return RuntimeBudget::cleanLimit();
+        }
+        return result.wallSeconds;
+    }
+
     std::string getFileName(const std::string& objectPath) {
         fs::path path(objectPath);
         std::string filename = path.filename().string();
         return filename.substr(0, filename.find_last_of('.'));
     }
 
-    bool executeCommand(const std::string& command, std::string& output, int timeoutSeconds = 30) {
-        std::cout << "Running command with timeout (" << timeoutSeconds << "s): " << command << std::endl;
-        
-        // Create pipes for capturing output
-        int outpipe[2];
-        if (pipe(outpipe) != 0) {
-            std::cerr << "Failed to create pipe" << std::endl;
+    bool executeCommand(const std::vector<std::string>& command, const std::vector<std::string>& env,
+                        std::string& output, int timeoutSeconds = 30) {
+        std::cout << "Running command with timeout (" << timeoutSeconds << "s): "
+                  << ProcessRunner::describe(command) << std::endl;
+
+        ProcessRunner::Options options;
+        options.env = env;
+        options.timeoutSeconds = timeoutSeconds;
+        options.mergeStderr = true;
+        ProcessRunner::Result result = ProcessRunner::run(command, options);
+        return checkResult(result, output, timeoutSeconds);
+    }
+
+    bool checkResult(const ProcessRunner::Result& result, std::string& output, double timeoutSeconds) {
+        output = result.out;
+        if (!result.started) {
+            std::cerr << "Failed to run command: " << result.err;
+            output += result.err;
             return false;
         }
-        
-        // Make read end non-blocking
-        fcntl(outpipe[0], F_SETFL, O_NONBLOCK);
-        
-        pid_t pid = fork();
-        
-        if (pid == -1) {
-            // Fork failed
-            close(outpipe[0]);
-            close(outpipe[1]);
-            std::cerr << "Fork failed" << std::endl;
+
+        if (result.timedOut) {
+            std::cout << "Command timed out after " << timeoutSeconds << " seconds" << std::endl;
+            std::ostringstream note;
+            note << "\n[COMMAND TIMED OUT AFTER " << timeoutSeconds << " SECONDS]\n";
+            output += note.str();
             return false;
-        } 
-        else if (pid == 0) {
-            // Child process
-            close(outpipe[0]); // Close read end
-            
-            // Redirect stdout and stderr to our pipe
-            dup2(outpipe[1], STDOUT_FILENO);
-            dup2(outpipe[1], STDERR_FILENO);
-            close(outpipe[1]);
-            
-            // Execute the command
-            execl("/bin/sh", "sh", "-c", command.c_str(), NULL);
-            
-            // If execl returns, it failed
-            _exit(127);
-        } 
-        else {
-            // Parent process
-            close(outpipe[1]); // Close write end
-            
-            output.clear();
-            auto startTime = std::chrono::steady_clock::now();
-            bool timedOut = false;
-            int status;
-            
-            // Buffer for reading
-            char buffer[4096];
-            
-            // Loop until process exits or timeout occurs
-            while (true) {
-                // Check if process has exited
-                pid_t result = waitpid(pid, &status, WNOHANG);
-                if (result == pid) {
-                    // Process has exited
-                    break;
-                }
-                else if (result == -1) {
-                    // waitpid error
-                    std::cerr << "waitpid error" << std::endl;
-                    kill(pid, SIGKILL);
-                    close(outpipe[0]);
-                    return false;
-                }
-                
-                // Read available output
-                ssize_t bytesRead = read(outpipe[0], buffer, sizeof(buffer) - 1);
-                if (bytesRead > 0) {
-                    buffer[bytesRead] = '\0';
-                    output += buffer;
-                }
-                
-                // Check for timeout
-                auto currentTime = std::chrono::steady_clock::now();
-                auto elapsedSeconds = 
-                    std::chrono::duration_cast<std::chrono::seconds>(currentTime - startTime).count();
-                    
-                if (elapsedSeconds > timeoutSeconds) {
-                    std::cout << "Command timed out after " << timeoutSeconds << " seconds" << std::endl;
-                    kill(pid, SIGKILL);
-                    timedOut = true;
-                    break;
-                }
-                
-                // Small sleep to prevent CPU hogging
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            }
-            
-            // Read any remaining output
-            while (true) {
-                ssize_t bytesRead = read(outpipe[0], buffer, sizeof(buffer) - 1);
-                if (bytesRead <= 0) break;
-                buffer[bytesRead] = '\0';
-                output += buffer;
-            }
-            
-            close(outpipe[0]);
-            
-            if (timedOut) {
-                output += "\n[COMMAND TIMED OUT AFTER " + std::to_string(timeoutSeconds) + " SECONDS]\n";
-                // Wait for the killed process to be reaped
-                waitpid(pid, &status, 0);
-                return false;
-            }
-            
-            // Special case for leak sanitizer - treat "detected memory leaks" in Objective-C as a false positive
-            if (output.find("LeakSanitizer: detected memory leaks") != std::string::npos && 
-                (output.find("libobjc.A.dylib") != std::string::npos || 
-                 output.find("CoreFoundation") != std::string::npos ||
-                 output.find("Foundation") != std::string::npos)) {
-                std::cout << "Detected macOS system library leak - treating as success" << std::endl;
-                return true;
-            }
-            
-            return WIFEXITED(status) && WEXITSTATUS(status) == 0;
         }
+
+        // Special case for leak sanitizer - treat "detected memory leaks" in Objective-C as a false positive
+        const PatternMatcher::Categories leakSignals = (1 << leakReport) | (1 << objcRuntime);
+        if (systemMatcher().scan(output, leakSignals) == leakSignals) {
+            std::cout << "Detected macOS system library leak - treating as success" << std::endl;
+            return true;
+        }
+
+        return result.success();
     }
     
     bool isSanitizerViolation(const std::string& error) {
-        return error.find("runtime error:") != std::string::npos ||
-               error.find("AddressSanitizer:") != std::string::npos ||
-               error.find("LeakSanitizer:") != std::string::npos ||
-               error.find("ThreadSanitizer:") != std::string::npos ||
-               error.find("UndefinedBehaviorSanitizer:") != std::string::npos;
+        return SanitizerReport::isViolation(error);
+    }
+
+    // Categories of systemMatcher().
+    enum SystemSignal { macOSLibrary, nanoZone, leakReport, objcRuntime };
+
+    // Text that marks macOS system code or its known false positives,
+    // all found in one pass over a run's output.
+    static const PatternMatcher& systemMatcher() {
+        static const PatternMatcher matcher = [] {
+            PatternMatcher built;
+            for (const char* library : {"libobjc.A.dylib", "CoreFoundation", "Foundation", "_CF", "libdispatch",
+                                        "_dispatch_"}) {
+                built.addLiteral(macOSLibrary, library);
+            }
+            built.addLiteral(nanoZone, "nano zone abandoned");
+            built.addLiteral(leakReport, "LeakSanitizer: detected memory leaks");
+            for (const char* runtime : {"libobjc.A.dylib", "CoreFoundation", "Foundation"}) {
+                built.addLiteral(objcRuntime, runtime);
+            }
+            built.compile();
+            return built;
+        }();
+        return matcher;
+    }
+
+    static bool isMacOSLibrary(const std::string& text) {
+        return systemMatcher().scan(text, 1 << macOSLibrary) != 0;
     }
 
-    // Check if error is likely to be a macOS false positive
+    // A macOS false positive is a finding whose frames all lie in system
+    // frameworks; output without parsable findings falls back to a plain
+    // text check.
     bool isMacOSFalsePositive(const std::string& error) {
-        return error.find("libobjc.A.dylib") != std::string::npos ||
-               error.find("CoreFoundation") != std::string::npos ||
-               error.find("Foundation") != std::string::npos ||
-               error.find("nano zone abandoned") != std::string::npos ||
-               error.find("_CF") != std::string::npos ||
-               error.find("libdispatch") != std::string::npos ||
-               error.find("_dispatch_") != std::string::npos;
+        std::vector<SanitizerReport::Finding> findings = SanitizerReport::parse(error);
+        if (findings.empty()) {
+            return systemMatcher().scan(error, (1 << macOSLibrary) | (1 << nanoZone)) != 0;
+        }
+        for (const auto& finding : findings) {
+            if (finding.frames.empty()) {
+                return false;
+            }
+            for (const auto& frame : finding.frames) {
+                if (!isMacOSLibrary(frame.function) && !isMacOSLibrary(frame.module)) {
+                    return false;
+                }
+            }
+        }
+        return true;
     }
 
     void logError(const std::string& objectFile, const std::string& sanitizerName, const std::string& error) {
@@ -261,9 +250,21 @@ private:
                 std::cerr << "Failed to open log file: " << logFile << std::endl;
                 return;
             }
+            // Signatures go into the corpus-wide index; recompile3 turns
+            // the raw report below into the compact prompt form.
+            SignatureIndex signatures("../sanitizer_log/signatures.tsv");
+            std::string signatureLines;
+            for (const auto& finding : SanitizerReport::parse(error)) {
+                std::string firstSeen = signatures.add(finding, objectFile);
+                signatureLines += "Signature: " + finding.signature + " " + finding.kind +
+                                  (firstSeen.empty() ? " (new)" : " (also in " + firstSeen + ")") + "\n";
+            }
+            signatures.save();
+
             log << "\n=== New Sanitizer Violation Report ===\n";
             log << "Object File: " << objectFile << "\n";
             log << "Sanitizer: " << sanitizerName << "\n";
+            log << signatureLines;
             log << "Sanitizer Violation:\n" << error << "\n";
             log << "=====================================\n";
             log.close();
@@ -305,6 +306,10 @@ private:
     }
 
 public:
+    // With earlyExit the sanitizers are built and run one at a time, most
+    // likely failure first, and the rest are skipped once one fails.
+    explicit SanitizerProcessor(bool earlyExit = false) : earlyExit(earlyExit) {}
+
     void processSourceFile(const std::string& objectPath) {
         // Ensure suppression file exists
         ensureSuppressionFile();
@@ -334,39 +339,80 @@ public:
 
         std::cout << "Found source file: " << sourcePath << std::endl;
 
-        bool allChecksPassed = true;
-        for (const auto& config : configs) {
-            std::string executablePath = baseFilename + "_" + config.name;
-            
-            // Add suppression environment variables to the compile command
-            std::string compileCommand = config.envVars + " clang " + config.flags +
-                                " -fno-omit-frame-pointer"
-                                " -fno-optimize-sibling-calls"
-                                " -O1 -g " +
-                                sourcePath + " -o " + executablePath;
+        SanitizerPlanner::Plan plan = SanitizerPlanner::planFile(sourcePath, configs);
+        if (createDirectory("../sanitizer_log")) {
+            SanitizerPlanner::record("../sanitizer_log/plan.tsv", sourcePath, plan);
+        }
+        for (const auto& skipped : plan.skipped) {
+            std::cout << "Skipping sanitizer " << skipped << std::endl;
+        }
+        SanitizerPlanner::useFastRunProfile(plan);
+        double cleanSeconds = measureCleanRun(sourcePath, baseFilename);
+        std::vector<std::string> tags = SanitizerHistory::tags(plan.features);
+        history.order(plan.steps, tags);
 
-            std::string compileOutput;
-            bool compileSuccess = executeCommand(compileCommand, compileOutput, 30);
+        struct PendingRun {
+            std::string name;
+            const SanitizerPlanner::Step* step;
+            std::string cacheKey;
+            std::string executablePath;
+        };
+        std::vector<PendingRun> pendingRuns;
 
-            if (!compileSuccess) {
-                std::cout << "Sanitizer compilation (" << config.name << ") failed for: " << sourcePath << std::endl;
-                
-                // Truncate long error messages to prevent overflow
-                if (compileOutput.length() > 4096) {
-                    compileOutput = compileOutput.substr(0, 4096) + "...\n[Output truncated due to length]";
+        bool allChecksPassed = true;
+        // Without early exit all sanitized builds run at once under one
+        // supervisor; each gets the wall time and CPU time RuntimeBudget
+        // derives from the clean run, with its env vars (the fast-run
+        // profile plus the configured options), inside the sandbox with its
+        // RSS bounded by the sanitizer runtime.
+        auto runPending = [&]() {
+            std::vector<ProcessRunner::Result> runResults(pendingRuns.size());
+            std::vector<double> deadlines(pendingRuns.size());
+            ChildSupervisor supervisor;
+            for (size_t i = 0; i < pendingRuns.size(); i++) {
+                const SanitizerPlanner::Step& step = *pendingRuns[i].step;
+                deadlines[i] = budget.deadline(step.name, step.kinds, cleanSeconds);
+                ProcessRunner::Options options;
+                options.env = SanitizerPlanner::mergeEnv(step.env, Sandbox::sanitizerLimits());
+                options.timeoutSeconds = deadlines[i];
+                options.cpuSeconds = deadlines[i];
+                options.mergeStderr = true;
+                options.sandbox = Sandbox::forGeneratedBinary(true);
+                std::cout << "Running " << pendingRuns[i].executablePath << " (" << step.name
+                          << ", timeout " << deadlines[i] << "s)" << std::endl;
+                supervisor.spawn({"./" + pendingRuns[i].executablePath}, options,
+                                 [&runResults, i](ProcessRunner::Result& result) { runResults[i] = std::move(result); });
+            }
+            supervisor.wait();
+            for (size_t i = 0; i < runResults.size(); i++) {
+                budget.record(pendingRuns[i].step->name, runResults[i].wallSeconds, cleanSeconds,
+                              runResults[i].success());
+            }
+
+            // Runs go without online symbolization; symbolize the failures
+            // in one batch while their binaries still exist.
+            std::vector<size_t> failed;
+            std::vector<std::string> reports;
+            for (size_t i = 0; i < runResults.size(); i++) {
+                if ((!runResults[i].success() || isSanitizerViolation(runResults[i].out)) &&
+                    Symbolizer::hasRawFrames(runResults[i].out)) {
+                    failed.push_back(i);
+                    reports.push_back(runResults[i].out);
                 }
-                
-                logError(executablePath, config.name, compileOutput);
-                allChecksPassed = false;
-                continue;
-            } else {
-                std::cout << "Sanitizer compilation (" << config.name << ") succeeded for: " << sourcePath << std::endl;
-                
-                // Use shorter timeout for running the executable (10 seconds) and include env vars
+            }
+            std::vector<std::string> symbolized = symbolizer.symbolizeAll(reports);
+            for (size_t i = 0; i < failed.size(); i++) {
+                runResults[failed[i]].out = symbolized[i];
+            }
+
+            for (size_t i = 0; i < pendingRuns.size(); i++) {
+                const std::string& name = pendingRuns[i].name;
+                const std::string& cacheKey = pendingRuns[i].cacheKey;
+                const std::string& executablePath = pendingRuns[i].executablePath;
+
                 std::string runOutput;
-                std::string runCommand = config.envVars + " ./" + executablePath;
-                bool runSuccess = executeCommand(runCommand, runOutput, 10);
-                
+                bool runSuccess = checkResult(runResults[i], runOutput, deadlines[i]);
+            
                 // Clean up executable regardless of result
                 if (fs::exists(executablePath)) {
                     try {
@@ -375,30 +421,113 @@ public:
                         std::cerr << "Error removing executable: " << e.what() << std::endl;
                     }
                 }
-                
+            
                 if (!runSuccess || isSanitizerViolation(runOutput)) {
                     // Skip macOS false positives
                     if (isMacOSFalsePositive(runOutput)) {
                         std::cout << "Detected macOS false positive, treating as success" << std::endl;
+                        artifactCache.store(cacheKey, {true, 0, "false-positive", ""});
+                        history.record(tags, pendingRuns[i].step->name, false);
                         continue;
                     }
-                    
-                    std::cout << "Sanitizer check (" << config.name << ") failed during execution for: " << sourcePath << std::endl;
-                    
+                
+                    std::cout << "Sanitizer check (" << name << ") failed during execution for: " << sourcePath << std::endl;
+                
                     // Truncate long error messages to prevent overflow
                     if (runOutput.length() > 4096) {
                         runOutput = runOutput.substr(0, 4096) + "...\n[Output truncated due to length]";
                     }
-                    
-                    logError(sourcePath, config.name, runOutput);
+                
+                    logError(sourcePath, name, runOutput);
+                    // The deadline follows the machine's load, so a
+                    // timeout is not a verdict to keep.
+                    if (!runResults[i].timedOut && !runResults[i].cpuLimitHit) {
+                        artifactCache.store(cacheKey, {false, 1, "violation", runOutput});
+                    }
+                    history.record(tags, pendingRuns[i].step->name, true);
                     allChecksPassed = false;
-                    continue;
                 } else {
-                    std::cout << "Sanitizer check (" << config.name << ") passed for: " << sourcePath << std::endl;
+                    std::cout << "Sanitizer check (" << name << ") passed for: " << sourcePath << std::endl;
+                    artifactCache.store(cacheKey, {true, 0, "ok", ""});
+                    history.record(tags, pendingRuns[i].step->name, false);
+                }
+            }
+            pendingRuns.clear();
+        };
+
+        for (const auto& step : plan.steps) {
+            if (earlyExit && !allChecksPassed) {
+                std::cout << "Early exit: skipping " << step.name << ", verdict already decided" << std::endl;
+                continue;
+            }
+            // Reports keep the name of the first sanitizer the build covers,
+            // so the asan_ubsan logs stay where recompile3 looks for them.
+            const std::string& name = step.covers.front();
+            std::string executablePath = baseFilename + "_" + name;
+            std::string buildFlags = step.flags +
+                                " -fno-omit-frame-pointer"
+                                " -fno-optimize-sibling-calls"
+                                " -O1 -g";
+
+            // With the merged run environment and the sandbox policy, as
+            // the run below gets them.
+            std::string cacheKey = artifactCache.key(
+                "clang", buildFlags, sourcePath,
+                "sanitizer:" + step.name + "\n" +
+                    Sandbox::cacheContext(SanitizerPlanner::mergeEnv(step.env, Sandbox::sanitizerLimits()), true));
+            ArtifactCache::Entry cached;
+            if (artifactCache.lookup(cacheKey, cached)) {
+                std::cout << "Sanitizer verdict (" << name << ") for " << sourcePath
+                          << " from cache: " << cached.verdict << std::endl;
+                if (cached.verdict == "compile-error") {
+                    logError(executablePath, name, cached.diagnostics);
+                    allChecksPassed = false;
+                } else if (cached.verdict == "violation") {
+                    logError(sourcePath, name, cached.diagnostics);
+                    allChecksPassed = false;
+                }
+                continue;
+            }
+            
+            std::vector<std::string> compileCommand = ProcessRunner::splitArgs("clang " + buildFlags);
+            compileCommand.insert(compileCommand.end(), {sourcePath, "-o", executablePath});
+
+            std::string compileOutput;
+            bool compileSuccess;
+            DriverJobCache::Invocation direct;
+            if (jobCache.instantiate("clang", buildFlags, sourcePath, executablePath, direct)) {
+                ProcessRunner::Options options;
+                options.timeoutSeconds = 30;
+                options.mergeStderr = true;
+                compileSuccess = checkResult(DriverJobCache::run(direct, options), compileOutput, 30);
+                DriverJobCache::cleanup(direct);
+            } else {
+                compileSuccess = executeCommand(compileCommand, {}, compileOutput, 30);
+            }
+
+            if (!compileSuccess) {
+                std::cout << "Sanitizer compilation (" << name << ") failed for: " << sourcePath << std::endl;
+                
+                // Truncate long error messages to prevent overflow
+                if (compileOutput.length() > 4096) {
+                    compileOutput = compileOutput.substr(0, 4096) + "...\n[Output truncated due to length]";
                 }
+                
+                logError(executablePath, name, compileOutput);
+                artifactCache.store(cacheKey, {false, 1, "compile-error", compileOutput});
+                history.record(tags, step.name, true);
+                allChecksPassed = false;
+                continue;
+            }
+            std::cout << "Sanitizer compilation (" << name << ") succeeded for: " << sourcePath << std::endl;
+            pendingRuns.push_back({name, &step, cacheKey, executablePath});
+            if (earlyExit) {
+                runPending();
             }
         }
 
+        runPending();
+
         if (allChecksPassed) {
             try {
                 std::string destPath = "../test/correct/" + fs::path(sourcePath).filename().string();
@@ -0,0 +1,503 @@
+#ifndef SANITIZER_REPORT_HPP
+#define SANITIZER_REPORT_HPP
+
+#include "cache_utils.hpp"
+#include "pattern_matcher.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/** Parser for ASan, UBSan, MSan, TSan and LSan output. Each report
+ * becomes a Finding with its kind (heap-use-after-free, signed-integer-
+ * overflow, data-race, ...), source location, access, the top frames of
+ * the primary stack and one line for each related stack (where memory was
+ * freed or allocated, the previous racing access, the origin of an
+ * uninitialized value).
+ *
+ * The signature hashes the tool, the kind and the function names of the
+ * top user frames, so the same bug found in many programs of a corpus
+ * gets the same signature. compact() renders findings in a short
+ * normalized form for repair prompts: one block per distinct signature,
+ * no addresses, no runtime frames, no shadow memory dumps.
+ * */
+class SanitizerReport {
+public:
+  struct Frame {
+    std::string function;
+    // file:line[:col], empty when only the module is known.
+    std::string location;
+    std::string module;
+    // In the sanitizer runtime, a system header or a shared library.
+    bool system = false;
+    // In the C++ standard library, its headers or its shared object.
+    bool standardLibrary = false;
+  };
+
+  struct Finding {
+    std::string tool;
+    std::string kind;
+    std::string location;
+    // "READ of size 4", "4 byte(s) in 1 object(s)", ...
+    std::string access;
+    // UBSan's runtime error text.
+    std::string message;
+    std::vector<Frame> frames;
+    // "freed: main uaf.cpp:2:39", ...
+    std::vector<std::string> related;
+    std::string signature;
+    // The whole primary stack and, for MSan, the origin stacks, runtime
+    // frames included (at most maxStack frames each).
+    std::vector<Frame> stack;
+    std::vector<Frame> origin;
+  };
+
+  static const size_t maxFrames = 5;
+  static const size_t maxStack = 64;
+
+  static std::vector<Finding> parse(const std::string &output) {
+    static const std::regex header(
+        R"((AddressSanitizer|MemorySanitizer|ThreadSanitizer|LeakSanitizer|UndefinedBehaviorSanitizer): ?(.*)$)");
+    static const std::regex runtimeError(R"(^(.*?):(\d+):(\d+): runtime error: (.*)$)");
+    static const std::regex leak(R"(^(Direct|Indirect) leak of (.*) allocated from:)");
+    static const std::regex accessLine(
+        R"(^\s*(READ|WRITE|Read|Write|Atomic read|Atomic write) of size (\d+))");
+    static const std::regex frameLine(R"(^\s*#\d+\s+(?:0x[0-9a-fA-F]+\s+)?(?:in\s+)?(.*?)\s*$)");
+
+    std::vector<Finding> findings;
+    Finding *current = nullptr;
+    std::string section;
+    bool sectionHasFrame = false;
+    bool primaryDone = false;
+
+    auto begin = [&](const std::string &tool, const std::string &kind) {
+      findings.push_back(Finding());
+      current = &findings.back();
+      current->tool = tool;
+      current->kind = kind;
+      section.clear();
+      sectionHasFrame = false;
+      primaryDone = false;
+    };
+
+    std::stringstream lines(output);
+    std::string line;
+    std::smatch match;
+    while (std::getline(lines, line)) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      if (std::regex_search(line, match, runtimeError) &&
+          line.find("SUMMARY:") == std::string::npos) {
+        begin("UndefinedBehaviorSanitizer", classifyRuntimeError(match[4]));
+        current->location = shortPath(match[1]) + ":" + match[2].str() + ":" + match[3].str();
+        current->message = match[4];
+        continue;
+      }
+      if (std::regex_search(line, match, leak)) {
+        begin("LeakSanitizer", match[1] == "Direct" ? "direct-leak" : "indirect-leak");
+        current->access = match[2];
+        continue;
+      }
+      if ((line.find("ERROR:") != std::string::npos || line.find("WARNING:") != std::string::npos) &&
+          std::regex_search(line, match, header)) {
+        std::string rest = match[2];
+        if (match[1] == "LeakSanitizer") {
+          // The leak blocks that follow are the findings.
+          current = nullptr;
+          continue;
+        }
+        std::string kind = rest.substr(0, rest.find(" ("));
+        if (match[1] != "ThreadSanitizer") {
+          kind = kind.substr(0, kind.find(' '));
+        }
+        begin(match[1], slug(kind));
+        continue;
+      }
+      if (!current || line.find("SUMMARY:") != std::string::npos) {
+        if (line.find("SUMMARY:") != std::string::npos) {
+          current = nullptr;
+        }
+        continue;
+      }
+
+      if (std::regex_search(line, match, accessLine) && current->access.empty()) {
+        current->access = match[1].str() + " of size " + match[2].str();
+      }
+      std::string label = sectionLabel(line);
+      if (!label.empty()) {
+        section = label;
+        sectionHasFrame = false;
+        primaryDone = true;
+        continue;
+      }
+      if (line.find_first_not_of(" \t") == std::string::npos) {
+        if (!current->frames.empty()) {
+          primaryDone = true;
+        }
+        continue;
+      }
+      if (line.find('#') == std::string::npos || !std::regex_match(line, match, frameLine)) {
+        continue;
+      }
+      Frame frame = parseFrame(match[1]);
+      if (section == "origin" && current->origin.size() < maxStack) {
+        current->origin.push_back(frame);
+      }
+      if (!primaryDone && section.empty()) {
+        current->frames.push_back(frame);
+        if (current->stack.size() < maxStack) {
+          current->stack.push_back(frame);
+        }
+      } else if (!section.empty() && !sectionHasFrame && isUserFrame(frame)) {
+        current->related.push_back(section + ": " + describe(frame));
+        sectionHasFrame = true;
+      }
+    }
+
+    for (auto &finding : findings) {
+      std::vector<Frame> user;
+      for (const auto &frame : finding.frames) {
+        if (isUserFrame(frame) && user.size() < maxFrames) {
+          user.push_back(frame);
+        }
+      }
+      if (!user.empty()) {
+        finding.frames = user;
+      } else if (finding.frames.size() > maxFrames) {
+        finding.frames.resize(maxFrames);
+      }
+      if (finding.location.empty()) {
+        for (const auto &frame : finding.frames) {
+          if (!frame.location.empty()) {
+            finding.location = frame.location;
+            break;
+          }
+        }
+      }
+      finding.signature = signature(finding);
+    }
+    return findings;
+  }
+
+  static bool isUserFrame(const Frame &frame) {
+    static const std::vector<std::string> runtime = {
+        "__interceptor_", "__asan", "__sanitizer", "__ubsan", "__tsan", "__msan",
+        "__lsan", "__libc_start", "_start", "operator new", "operator delete"};
+    if (frame.function.empty() || frame.system) {
+      return false;
+    }
+    for (const auto &prefix : runtime) {
+      if (frame.function.rfind(prefix, 0) == 0) {
+        return false;
+      }
+    }
+    return !frame.location.empty() || frame.module.find(".so") == std::string::npos;
+  }
+
+  // Most outputs have no report at all; they are told apart by one scan
+  // for the literals every report header contains, before parsing.
+  static bool isViolation(const std::string &output) {
+    static const PatternMatcher headers = [] {
+      PatternMatcher matcher;
+      for (const char *literal : {"Sanitizer", " runtime error: ", "Direct leak of ", "Indirect leak of "}) {
+        matcher.addLiteral(0, literal);
+      }
+      matcher.compile();
+      return matcher;
+    }();
+    return headers.scan(output) && !parse(output).empty();
+  }
+
+  // tool, kind and the top three function names; line numbers and file
+  // names are left out so that the same bug in different programs of the
+  // corpus matches.
+  static std::string signature(const Finding &finding) {
+    std::string key = finding.tool + "\n" + finding.kind;
+    for (size_t i = 0; i < finding.frames.size() && i < 3; i++) {
+      key += "\n" + finding.frames[i].function;
+    }
+    return CacheUtils::hashString(key).substr(0, 12);
+  }
+
+  static std::string compact(const std::vector<Finding> &findings) {
+    std::ostringstream out;
+    std::set<std::string> seen;
+    for (const auto &finding : findings) {
+      if (!seen.insert(finding.signature).second) {
+        continue;
+      }
+      out << finding.tool << ": " << finding.kind;
+      if (!finding.access.empty()) {
+        out << ", " << finding.access;
+      }
+      if (!finding.location.empty()) {
+        out << " at " << finding.location;
+      }
+      out << " [" << finding.signature << "]\n";
+      if (!finding.message.empty()) {
+        out << "  " << finding.message << "\n";
+      }
+      for (size_t i = 0; i < finding.frames.size(); i++) {
+        out << "  #" << i << " " << describe(finding.frames[i]) << "\n";
+      }
+      for (const auto &related : finding.related) {
+        out << "  " << related << "\n";
+      }
+    }
+    return out.str();
+  }
+
+  // The compact form when the output has findings, else the output.
+  static std::string compactOrRaw(const std::string &output) {
+    std::vector<Finding> findings = parse(output);
+    return findings.empty() ? output : compact(findings);
+  }
+
+private:
+  static std::string slug(const std::string &text) {
+    std::string result;
+    for (char c : text) {
+      if (std::isalnum(static_cast<unsigned char>(c))) {
+        result += std::tolower(static_cast<unsigned char>(c));
+      } else if (!result.empty() && result.back() != '-') {
+        result += '-';
+      }
+    }
+    while (!result.empty() && result.back() == '-') {
+      result.pop_back();
+    }
+    return result;
+  }
+
+  static std::string classifyRuntimeError(const std::string &message) {
+    static const std::vector<std::pair<std::regex, std::string>> kinds = {
+        {std::regex("signed integer overflow"), "signed-integer-overflow"},
+        {std::regex("index .* out of bounds"), "out-of-bounds-index"},
+        {std::regex("shift exponent|left shift"), "shift-out-of-bounds"},
+        {std::regex("division by zero"), "division-by-zero"},
+        {std::regex("null pointer"), "null-pointer-use"},
+        {std::regex("misaligned address"), "misaligned-access"},
+        {std::regex("not a valid value"), "invalid-value-load"},
+        {std::regex("pointer overflow|applying .* offset"), "pointer-overflow"},
+        {std::regex("outside the range of representable values"), "float-cast-overflow"},
+        {std::regex("end of a value-returning function"), "missing-return"},
+        {std::regex("unreachable"), "unreachable"},
+        {std::regex("negation of"), "negation-overflow"},
+        {std::regex("implicit conversion"), "implicit-conversion"},
+        {std::regex("variable length array bound"), "vla-bound"},
+        {std::regex("insufficient space"), "insufficient-object-size"},
+    };
+    for (const auto &[pattern, kind] : kinds) {
+      if (std::regex_search(message, pattern)) {
+        return kind;
+      }
+    }
+    // Otherwise the words before the first ':', minus numbers and
+    // addresses.
+    std::stringstream words(message.substr(0, message.find(':')));
+    std::string word, kept;
+    for (int count = 0; words >> word && count < 6;) {
+      if (word.find_first_of("0123456789") == std::string::npos) {
+        kept += (kept.empty() ? "" : " ") + word;
+        count++;
+      }
+    }
+    return slug(kept);
+  }
+
+  static std::string sectionLabel(const std::string &line) {
+    if (line.find("freed by thread") != std::string::npos) {
+      return "freed";
+    }
+    if (line.find("allocated by thread") != std::string::npos) {
+      return "allocated";
+    }
+    if (line.find("Previous ") != std::string::npos && line.find(" of size ") != std::string::npos) {
+      return "previous access";
+    }
+    if (line.find("Uninitialized value was created") != std::string::npos ||
+        line.find("Uninitialized value was stored") != std::string::npos) {
+      return "origin";
+    }
+    if (line.find("Thread T") != std::string::npos && line.find(" created by ") != std::string::npos) {
+      return "thread created";
+    }
+    return "";
+  }
+
+  static std::string shortPath(const std::string &path) {
+    return std::filesystem::path(path).filename().string();
+  }
+
+  // "<function> <file:line:col> (<module>+<offset>)" in any combination.
+  static Frame parseFrame(std::string text) {
+    Frame frame;
+    size_t open = text.rfind(" (");
+    size_t plus = text.rfind('+');
+    if (!text.empty() && text.back() == ')' && open != std::string::npos &&
+        plus != std::string::npos && plus > open) {
+      frame.module = text.substr(open + 2, plus - open - 2);
+      text = text.substr(0, open);
+    } else if (!text.empty() && text.front() == '(' && text.back() == ')' &&
+               plus != std::string::npos) {
+      frame.module = text.substr(1, plus - 1);
+      frame.standardLibrary = isStandardLibrary(frame.module);
+      return frame;
+    }
+    // TSan prints "<null>" for a missing location.
+    const std::string missing = " <null>";
+    if (text.size() > missing.size() &&
+        text.compare(text.size() - missing.size(), missing.size(), missing) == 0) {
+      text.resize(text.size() - missing.size());
+    }
+    static const std::regex location(R"(^(.*) (\S+:\d+(?::\d+)?)$)");
+    std::smatch match;
+    if (std::regex_match(text, match, location)) {
+      frame.function = match[1];
+      std::string where = match[2];
+      frame.system = where.find("libsanitizer") != std::string::npos ||
+                     where.find("compiler-rt") != std::string::npos ||
+                     where.rfind("/usr/", 0) == 0;
+      frame.standardLibrary = isStandardLibrary(where.substr(0, where.find(':')));
+      size_t colon = where.find(':');
+      frame.location = shortPath(where.substr(0, colon)) + where.substr(colon);
+    } else {
+      frame.function = text;
+    }
+    frame.standardLibrary = frame.standardLibrary || isStandardLibrary(frame.module);
+    return frame;
+  }
+
+  // libstdc++/libc++ headers and shared objects.
+  static bool isStandardLibrary(const std::string &path) {
+    std::string name = shortPath(path);
+    return path.find("/include/c++/") != std::string::npos ||
+           path.find("/c++/v1/") != std::string::npos ||
+           name.rfind("libstdc++", 0) == 0 || name.rfind("libc++", 0) == 0;
+  }
+
+  static std::string describe(const Frame &frame) {
+    std::string text = frame.function.empty() ? "??" : frame.function;
+    if (!frame.location.empty()) {
+      text += " " + frame.location;
+    } else if (!frame.module.empty()) {
+      text += " (" + shortPath(frame.module) + ")";
+    }
+    return text;
+  }
+};
+
+/** Corpus-wide index of finding signatures in a TSV file:
+ * signature, times seen, tool, kind, location and first file. Used to
+ * tell new bugs from repeats of one already in the corpus.
+ *
+ * add() only touches memory; save() merges this run's counts into the
+ * file as it is then and replaces it through a rename, like CrashBuckets,
+ * so concurrent sanitize and recompile3 runs keep each other's counts.
+ * */
+class SignatureIndex {
+private:
+  struct Entry {
+    uint64_t count = 0;
+    std::string tool;
+    std::string kind;
+    std::string location;
+    std::string firstFile;
+  };
+
+  std::string path;
+  std::map<std::string, Entry> entries;
+  // This run's findings per signature, merged into the file by save().
+  std::map<std::string, Entry> pending;
+
+  static std::map<std::string, Entry> load(const std::string &path) {
+    std::map<std::string, Entry> loaded;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+      std::stringstream fields(line);
+      std::string signature, count;
+      Entry entry;
+      if (std::getline(fields, signature, '\t') && std::getline(fields, count, '\t') &&
+          std::getline(fields, entry.tool, '\t') && std::getline(fields, entry.kind, '\t') &&
+          std::getline(fields, entry.location, '\t') && std::getline(fields, entry.firstFile)) {
+        entry.count = std::strtoull(count.c_str(), nullptr, 10);
+        loaded[signature] = entry;
+      }
+    }
+    return loaded;
+  }
+
+public:
+  explicit SignatureIndex(const std::string &path) : path(path), entries(load(path)) {}
+
+  // Records the finding and returns the file it was first seen in, or ""
+  // when it is new.
+  std::string add(const SanitizerReport::Finding &finding, const std::string &file) {
+    Entry &entry = entries[finding.signature];
+    std::string first = entry.count ? entry.firstFile : "";
+    if (!entry.count) {
+      entry.tool = finding.tool;
+      entry.kind = finding.kind;
+      entry.location = finding.location;
+      entry.firstFile = file;
+    }
+    entry.count++;
+    Entry &added = pending[finding.signature];
+    if (!added.count) {
+      added = entry;
+      added.count = 0;
+    }
+    added.count++;
+    return first;
+  }
+
+  size_t size() const { return entries.size(); }
+
+  void save() {
+    if (pending.empty()) {
+      return;
+    }
+    std::map<std::string, Entry> merged = load(path);
+    for (const auto &[signature, entry] : pending) {
+      auto found = merged.find(signature);
+      if (found == merged.end()) {
+        merged.emplace(signature, entry);
+      } else {
+        found->second.count += entry.count;
+      }
+    }
+
+    std::string temp = path + ".tmp." + std::to_string(getpid());
+    {
+      std::ofstream file(temp);
+      if (!file.is_open()) {
+        std::cerr << "Failed to write signature index: " << temp << std::endl;
+        return;
+      }
+      for (const auto &[signature, entry] : merged) {
+        file << signature << "\t" << entry.count << "\t" << entry.tool << "\t" << entry.kind
+             << "\t" << entry.location << "\t" << entry.firstFile << "\n";
+      }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+      std::cerr << "Failed to write signature index: " << ec.message() << std::endl;
+      std::filesystem::remove(temp, ec);
+      return;
+    }
+    entries = std::move(merged);
+    pending.clear();
+  }
+};
+
+#endif // SANITIZER_REPORT_HPP
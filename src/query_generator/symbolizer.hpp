@@ -0,0 +1,293 @@
+#ifndef SYMBOLIZER_HPP
+#define SYMBOLIZER_HPP
+
+#include "cache_utils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <regex>
+#include <spawn.h>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+extern char **environ;
+
+/** Offline symbolization of sanitizer reports. Sanitized programs run
+ * with symbolize=0, which prints raw frames such as
+ *
+ *     #0 0x559c8f6c6229  (/tmp/a.out+0x1229)
+ *
+ * and skips the online symbolizer for the clean runs that make up most
+ * of a campaign. The failing reports are symbolized here afterwards:
+ * every distinct (module, offset) of a batch is sent to one long-lived
+ * llvm-symbolizer process, results are memoized, and the frames are
+ * rewritten to the usual "#0 0x... in main /src/a.cpp:2:54" form.
+ *
+ * The symbolizer is REFUZZER_SYMBOLIZER, else llvm-symbolizer from PATH.
+ * Without one the reports are returned unchanged.
+ * */
+class Symbolizer {
+private:
+  std::string tool;
+  pid_t pid = -1;
+  int toChild = -1;
+  FILE *fromChild = nullptr;
+  bool broken = false;
+  std::mutex mutex;
+  // "<module> <offset>" -> "function\tfile:line:col" per (inlined) frame.
+  std::map<std::string, std::vector<std::pair<std::string, std::string>>> resolved;
+
+  static const std::regex &rawFrame() {
+    static const std::regex pattern(
+        R"(^(\s*#\d+ 0x[0-9a-fA-F]+)\s+\((.+)\+(0x[0-9a-fA-F]+)\)\s*$)");
+    return pattern;
+  }
+
+  static std::string findTool() {
+    if (const char *tool = std::getenv("REFUZZER_SYMBOLIZER")) {
+      if (*tool) {
+        return tool;
+      }
+    }
+    return CacheUtils::resolveExecutable("llvm-symbolizer");
+  }
+
+  bool start() {
+    if (pid > 0) {
+      return true;
+    }
+    if (broken || tool.empty()) {
+      return false;
+    }
+    int in[2], out[2];
+    if (pipe2(in, O_CLOEXEC) != 0) {
+      broken = true;
+      return false;
+    }
+    if (pipe2(out, O_CLOEXEC) != 0) {
+      close(in[0]);
+      close(in[1]);
+      broken = true;
+      return false;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    std::vector<std::string> argv = {tool, "--inlining", "--demangle", "--functions=linkage"};
+    std::vector<char *> args;
+    for (auto &arg : argv) {
+      args.push_back(const_cast<char *>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+    int error = posix_spawnp(&pid, args[0], &actions, nullptr, args.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(in[0]);
+    close(out[1]);
+    if (error != 0) {
+      close(in[1]);
+      close(out[0]);
+      pid = -1;
+      broken = true;
+      std::cerr << "Failed to start symbolizer " << tool << std::endl;
+      return false;
+    }
+    toChild = in[1];
+    fromChild = fdopen(out[0], "r");
+    return true;
+  }
+
+  void stop() {
+    if (pid <= 0) {
+      return;
+    }
+    close(toChild);
+    fclose(fromChild);
+    int status;
+    waitpid(pid, &status, 0);
+    pid = -1;
+    toChild = -1;
+    fromChild = nullptr;
+  }
+
+  // Writes all of `data` with SIGPIPE blocked, so a dead symbolizer
+  // yields an error instead of killing us.
+  bool writeAll(const std::string &data) {
+    sigset_t pipeSignal, previous;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, &previous);
+    size_t offset = 0;
+    while (offset < data.size()) {
+      ssize_t bytes = write(toChild, data.data() + offset, data.size() - offset);
+      if (bytes < 0 && errno == EINTR) {
+        continue;
+      }
+      if (bytes <= 0) {
+        struct timespec zero = {0, 0};
+        sigtimedwait(&pipeSignal, nullptr, &zero);
+        break;
+      }
+      offset += bytes;
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+    return offset == data.size();
+  }
+
+  // One response: pairs of function and location lines, ended by an
+  // empty line.
+  bool readResponse(std::vector<std::pair<std::string, std::string>> &frames) {
+    char *line = nullptr;
+    size_t capacity = 0;
+    std::string function;
+    bool haveFunction = false;
+    bool complete = false;
+    while (getline(&line, &capacity, fromChild) > 0) {
+      std::string text(line);
+      if (!text.empty() && text.back() == '\n') {
+        text.pop_back();
+      }
+      if (text.empty()) {
+        complete = true;
+        break;
+      }
+      if (!haveFunction) {
+        function = text;
+        haveFunction = true;
+      } else {
+        frames.push_back({function, text});
+        haveFunction = false;
+      }
+    }
+    free(line);
+    return complete;
+  }
+
+  // Resolves the given queries, a bounded number in flight at a time so
+  // neither pipe can fill up while the other side waits.
+  void resolve(const std::vector<std::string> &queries) {
+    const size_t window = 64;
+    for (size_t begin = 0; begin < queries.size(); begin += window) {
+      size_t end = std::min(queries.size(), begin + window);
+      if (!start()) {
+        return;
+      }
+      std::string request;
+      for (size_t i = begin; i < end; i++) {
+        request += queries[i] + "\n";
+      }
+      if (!writeAll(request)) {
+        stop();
+        broken = true;
+        return;
+      }
+      for (size_t i = begin; i < end; i++) {
+        std::vector<std::pair<std::string, std::string>> frames;
+        if (!readResponse(frames)) {
+          stop();
+          broken = true;
+          return;
+        }
+        resolved[queries[i]] = frames;
+      }
+    }
+  }
+
+  static std::string query(const std::string &module, const std::string &offset) {
+    return "\"" + module + "\" " + offset;
+  }
+
+  std::string rewrite(const std::string &report) {
+    std::stringstream lines(report);
+    std::string line, result;
+    std::smatch match;
+    while (std::getline(lines, line)) {
+      bool replaced = false;
+      if (std::regex_match(line, match, rawFrame())) {
+        auto it = resolved.find(query(match[2], match[3]));
+        if (it != resolved.end() && !it->second.empty() && it->second.front().first != "??") {
+          // Like the online symbolizer, fall back to the module offset
+          // when there is no debug info for the location.
+          std::string module = "(" + match[2].str() + "+" + match[3].str() + ")";
+          for (const auto &frame : it->second) {
+            bool unknown = frame.second.rfind("??", 0) == 0;
+            result += match[1].str() + " in " + frame.first + " " +
+                      (unknown ? module : frame.second) + "\n";
+          }
+          replaced = true;
+        }
+      }
+      if (!replaced) {
+        result += line + "\n";
+      }
+    }
+    if (!report.empty() && report.back() != '\n' && !result.empty()) {
+      result.pop_back();
+    }
+    return result;
+  }
+
+public:
+  explicit Symbolizer(const std::string &tool = findTool()) : tool(tool) {}
+
+  ~Symbolizer() { stop(); }
+
+  Symbolizer(const Symbolizer &) = delete;
+  Symbolizer &operator=(const Symbolizer &) = delete;
+
+  static bool hasRawFrames(const std::string &report) {
+    std::stringstream lines(report);
+    std::string line;
+    while (std::getline(lines, line)) {
+      if (std::regex_match(line, rawFrame())) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Symbolizes a batch of reports with one round of symbolizer queries.
+  // The modules named in the reports must still exist.
+  std::vector<std::string> symbolizeAll(const std::vector<std::string> &reports) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> queries;
+    std::smatch match;
+    for (const auto &report : reports) {
+      std::stringstream lines(report);
+      std::string line;
+      while (std::getline(lines, line)) {
+        if (std::regex_match(line, match, rawFrame())) {
+          std::string key = query(match[2], match[3]);
+          if (!resolved.count(key)) {
+            resolved[key];
+            queries.push_back(key);
+          }
+        }
+      }
+    }
+    resolve(queries);
+
+    std::vector<std::string> result;
+    for (const auto &report : reports) {
+      result.push_back(rewrite(report));
+    }
+    return result;
+  }
+
+  std::string symbolize(const std::string &report) {
+    return symbolizeAll({report}).front();
+  }
+};
+
+#endif // SYMBOLIZER_HPP
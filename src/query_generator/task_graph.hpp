@@ -0,0 +1,142 @@
+#ifndef TASK_GRAPH_HPP
+#define TASK_GRAPH_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <sched.h>
+#include <thread>
+#include <vector>
+
+/** Dependency graph of tasks executed on a pool sized to the CPUs this
+ * process may run on. Every task belongs to a resource class (e.g.
+ * compile, run) with its own concurrency limit, so heavyweight compiles
+ * and short sanitizer runs can be throttled independently while sharing
+ * one set of workers. A task becomes ready once all tasks it depends on
+ * have finished; ready tasks start in the order they were added.
+ * */
+class TaskGraph {
+public:
+  using TaskId = size_t;
+
+private:
+  struct Task {
+    std::function<void()> work;
+    size_t resource = 0;
+    size_t pending = 0;
+    std::vector<TaskId> dependents;
+  };
+
+  std::vector<Task> tasks;
+  std::vector<size_t> limits;
+  std::vector<size_t> active;
+  std::deque<TaskId> ready;
+  size_t finished = 0;
+  std::mutex mutex;
+  std::condition_variable changed;
+
+  // Takes the oldest ready task whose resource has a free slot.
+  bool takeRunnable(TaskId &id) {
+    for (auto it = ready.begin(); it != ready.end(); ++it) {
+      if (active[tasks[*it].resource] < limits[tasks[*it].resource]) {
+        id = *it;
+        ready.erase(it);
+        active[tasks[id].resource]++;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void worker() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      TaskId id;
+      changed.wait(lock, [&] {
+        return finished == tasks.size() || takeRunnable(id);
+      });
+      if (finished == tasks.size()) {
+        return;
+      }
+
+      std::function<void()> work = std::move(tasks[id].work);
+      lock.unlock();
+      work();
+      lock.lock();
+
+      active[tasks[id].resource]--;
+      finished++;
+      for (TaskId dependent : tasks[id].dependents) {
+        if (--tasks[dependent].pending == 0) {
+          ready.push_back(dependent);
+        }
+      }
+      changed.notify_all();
+    }
+  }
+
+public:
+  // CPUs in our affinity mask (which follows taskset and cpusets), or the
+  // hardware thread count when the mask is unavailable.
+  static size_t availableCpus() {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+      return std::max(1, CPU_COUNT(&set));
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // Declares a resource class with the given concurrency limit and
+  // returns its index.
+  size_t addResource(size_t limit) {
+    limits.push_back(std::max<size_t>(1, limit));
+    active.push_back(0);
+    return limits.size() - 1;
+  }
+
+  TaskId addTask(size_t resource, std::function<void()> work,
+                 const std::vector<TaskId> &dependencies = {}) {
+    TaskId id = tasks.size();
+    Task task;
+    task.work = std::move(work);
+    task.resource = resource;
+    task.pending = dependencies.size();
+    tasks.push_back(std::move(task));
+    for (TaskId dependency : dependencies) {
+      tasks[dependency].dependents.push_back(id);
+    }
+    if (dependencies.empty()) {
+      ready.push_back(id);
+    }
+    return id;
+  }
+
+  size_t size() const { return tasks.size(); }
+
+  // Runs every task on `workers` threads (0: one per available CPU, but
+  // never more than the resource limits can keep busy) and returns once
+  // all of them have finished. Tasks must not throw.
+  void run(size_t workers = 0) {
+    size_t usable = 0;
+    for (size_t limit : limits) {
+      usable += limit;
+    }
+    if (workers == 0) {
+      workers = std::min(availableCpus(), usable);
+    }
+    workers = std::max<size_t>(1, std::min(workers, tasks.size()));
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < workers; i++) {
+      threads.emplace_back(&TaskGraph::worker, this);
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+};
+
+#endif // TASK_GRAPH_HPP
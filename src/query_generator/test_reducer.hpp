@@ -0,0 +1,707 @@
+#ifndef TEST_REDUCER_HPP
+#define TEST_REDUCER_HPP
+
+#include "artifact_cache.hpp"
+#include "cache_utils.hpp"
+#include "crash_buckets.hpp"
+#include "differential_oracle.hpp"
+#include "differential_tester.hpp"
+#include "driver_job_cache.hpp"
+#include "pch_cache.hpp"
+#include "process_runner.hpp"
+#include "runtime_budget.hpp"
+#include "sandbox.hpp"
+#include "sanitizer_report.hpp"
+#include "task_graph.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** Delta-debugging reducer for the programs behind bugs.log (compiler
+ * crashes and hangs) and miscompilations.log (diverging builds). A
+ * variant of the program is interesting when it still shows the logged
+ * bug:
+ *
+ *  - crash: the logged command still crashes with the same kind and
+ *    headline (see CrashBuckets);
+ *  - hang: the logged command still misses the logged compile deadline
+ *    (so every interesting variant costs a full deadline);
+ *  - miscompile: the build that agreed with the majority, with ASan and
+ *    UBSan added, compiles and runs clean, and the divergent build still
+ *    differs from it with the same symptom. The sanitizers keep the
+ *    reduction from trading the miscompilation for undefined behavior.
+ *
+ * Passes remove brace blocks (whole constructs, then just their bodies),
+ * then chunks of lines, then chunks of tokens, halving the chunk size
+ * whenever nothing at the current size can go, and repeat until a round
+ * removes nothing. Each step tests one candidate per worker at once and
+ * keeps the first interesting one. Verdicts are cached by the hash of the
+ * test and the variant, in memory and in the artifact cache, so repeated
+ * variants and later runs over the same backlog are not rebuilt. Builds
+ * go through the PCH and driver job caches like every other compile.
+ * */
+class TestReducer {
+public:
+  enum class Kind { Crash, Miscompile, Hang };
+
+  struct Case {
+    Kind kind = Kind::Crash;
+    std::string source;
+    // The crashing command, or the build whose run diverges.
+    std::string command;
+    // Miscompile only: a build that agreed with the majority.
+    std::string reference;
+    // Hang only: the compile deadline that was missed.
+    double deadline = 0;
+  };
+
+private:
+  // A case prepared for testing variants.
+  struct Target {
+    Case testCase;
+    std::string extension;
+    // Identifies the interestingness test in cache keys.
+    std::string key;
+    // Crash signature or divergence symptom of the original.
+    std::string signature;
+    double deadline = 0;
+  };
+
+  static constexpr int maxRounds = 5;
+  static constexpr double compileTimeout = 120.0;
+  static constexpr double runHeadroom = 3.0;
+  static constexpr double runFloor = 2.0;
+
+  PchCache pchCache;
+  DriverJobCache jobCache;
+  ArtifactCache artifacts;
+  size_t jobs;
+  std::string outDir;
+  std::string workDir;
+
+  std::mutex verdictMutex;
+  std::unordered_map<std::string, bool> verdicts;
+  std::atomic<size_t> tests{0};
+  std::atomic<size_t> cacheHits{0};
+  std::atomic<unsigned long> counter{0};
+
+  static std::string sanitizedFlags() {
+    return " -fsanitize=address,undefined -fno-sanitize-recover=all -Werror=uninitialized "
+           "-Werror=return-type";
+  }
+
+  static std::vector<std::string> sanitizedEnv() {
+    std::vector<std::string> env = Sandbox::sanitizerLimits();
+    for (auto &variable : env) {
+      if (variable.rfind("ASAN_OPTIONS=", 0) == 0) {
+        variable += ":detect_leaks=0";
+        return env;
+      }
+    }
+    env.push_back("ASAN_OPTIONS=detect_leaks=0");
+    return env;
+  }
+
+  ProcessRunner::Result compile(const std::string &command, const std::string &sourcePath,
+                                const std::string &outputPath, double timeout = compileTimeout) {
+    size_t split = command.find(' ');
+    std::string compiler = command.substr(0, split);
+    std::string flags = split == std::string::npos ? "" : command.substr(split + 1);
+    std::string pchFlags = pchCache.includeFlags(compiler, flags, sourcePath);
+    ProcessRunner::Options options;
+    options.mergeStderr = true;
+    options.timeoutSeconds = timeout;
+
+    ProcessRunner::Result result;
+    DriverJobCache::Invocation direct;
+    if (jobCache.instantiate(compiler, flags + " " + pchFlags, sourcePath, outputPath, direct)) {
+      result = DriverJobCache::run(direct, options);
+      DriverJobCache::cleanup(direct);
+    } else {
+      std::vector<std::string> argv = ProcessRunner::splitArgs(command + " " + pchFlags);
+      argv.insert(argv.end(), {sourcePath, "-o", outputPath});
+      result = ProcessRunner::run(argv, options);
+    }
+    if (!result.success() && !pchFlags.empty() && PchCache::isPchFailure(result.out)) {
+      std::vector<std::string> argv = ProcessRunner::splitArgs(command);
+      argv.insert(argv.end(), {sourcePath, "-o", outputPath});
+      result = ProcessRunner::run(argv, options);
+    }
+    return result;
+  }
+
+  static DifferentialOracle::Observation run(const std::string &executable, double deadline,
+                                             bool sanitized, std::string *errors = nullptr,
+                                             double *wallSeconds = nullptr) {
+    ProcessRunner::Options options;
+    options.timeoutSeconds = deadline;
+    options.cpuSeconds = deadline;
+    options.sandbox = Sandbox::forGeneratedBinary(sanitized);
+    if (sanitized) {
+      options.env = sanitizedEnv();
+    }
+    ProcessRunner::Result result = ProcessRunner::run({executable}, options);
+
+    DifferentialOracle::Observation observation;
+    observation.ran = result.started;
+    observation.timedOut = result.timedOut || result.cpuLimitHit;
+    observation.exitCode = result.exitCode;
+    observation.signal = result.signal;
+    observation.outputHash = DifferentialOracle::hashOutput(result.outHash);
+    if (errors) {
+      *errors = result.err;
+    }
+    if (wallSeconds) {
+      *wallSeconds = result.wallSeconds;
+    }
+    return observation;
+  }
+
+  // Runs the test on one variant; signature receives what the variant
+  // shows (empty when it is not even a candidate).
+  bool check(const Target &target, const std::string &text, std::string &signature,
+             double *referenceSeconds = nullptr) {
+    signature.clear();
+    std::string base = workDir + "/v" + std::to_string(counter++);
+    std::string sourcePath = base + target.extension;
+    std::ofstream(sourcePath, std::ios::trunc) << text;
+    std::vector<std::string> outputs;
+    auto finish = [&](bool interesting) {
+      std::error_code ec;
+      std::filesystem::remove(sourcePath, ec);
+      for (const auto &output : outputs) {
+        std::filesystem::remove(output, ec);
+      }
+      return interesting;
+    };
+
+    const Case &testCase = target.testCase;
+    if (testCase.kind == Kind::Crash) {
+      outputs.push_back(base);
+      ProcessRunner::Result result = compile(testCase.command, sourcePath, base);
+      if (result.success() || result.timedOut ||
+          !DifferentialTester::isCompilerCrash(result.out, result.exitCode)) {
+        return finish(false);
+      }
+      signature = crashSignature(result.out, result.exitCode);
+      return finish(signature == target.signature);
+    }
+
+    if (testCase.kind == Kind::Hang) {
+      outputs.push_back(base);
+      bool hung = compile(testCase.command, sourcePath, base, target.deadline).timedOut;
+      signature = hung ? "hang" : "";
+      return finish(hung);
+    }
+
+    outputs = {base + "_reference", base + "_divergent"};
+    if (!compile(testCase.reference + sanitizedFlags(), sourcePath, outputs[0]).success() ||
+        !compile(testCase.command, sourcePath, outputs[1]).success()) {
+      return finish(false);
+    }
+    double deadline = target.deadline > 0 ? target.deadline : RuntimeBudget::hangDeadline();
+    std::string errors;
+    DifferentialOracle::Observation reference = run(outputs[0], deadline, true, &errors, referenceSeconds);
+    if (!reference.ran || reference.timedOut || SanitizerReport::isViolation(errors)) {
+      return finish(false);
+    }
+    DifferentialOracle::Observation divergent = run(outputs[1], deadline, false);
+    if (!divergent.ran ||
+        DifferentialOracle::fingerprint(divergent) == DifferentialOracle::fingerprint(reference)) {
+      return finish(false);
+    }
+    signature = DifferentialOracle::symptom(divergent, reference);
+    return finish(signature == target.signature);
+  }
+
+  std::string verdictKey(const Target &target, const std::string &text) const {
+    std::string data = target.key + "\n" + text;
+    return CacheUtils::hashString(data) + CacheUtils::toHex(CacheUtils::fnv1a(data, 0x9e3779b97f4a7c15ULL));
+  }
+
+  bool interesting(const Target &target, const std::string &text) {
+    std::string key = verdictKey(target, text);
+    {
+      std::lock_guard<std::mutex> lock(verdictMutex);
+      auto found = verdicts.find(key);
+      if (found != verdicts.end()) {
+        cacheHits++;
+        return found->second;
+      }
+    }
+    ArtifactCache::Entry entry;
+    bool verdict;
+    if (artifacts.lookup(key, entry)) {
+      cacheHits++;
+      verdict = entry.success;
+    } else {
+      tests++;
+      std::string signature;
+      verdict = check(target, text, signature);
+      entry.success = verdict;
+      entry.verdict = verdict ? "interesting" : "boring";
+      entry.diagnostics = signature;
+      artifacts.store(key, entry);
+    }
+    std::lock_guard<std::mutex> lock(verdictMutex);
+    verdicts[key] = verdict;
+    return verdict;
+  }
+
+  // Tests the candidates concurrently; the index of the first
+  // interesting one, or candidates.size().
+  size_t firstInteresting(const Target &target, const std::vector<std::string> &candidates) {
+    std::atomic<size_t> best{candidates.size()};
+    TaskGraph graph;
+    size_t slots = graph.addResource(jobs);
+    for (size_t i = 0; i < candidates.size(); i++) {
+      graph.addTask(slots, [&, i] {
+        // A later candidate cannot win once an earlier one has.
+        if (i > best.load() || !interesting(target, candidates[i])) {
+          return;
+        }
+        size_t current = best.load();
+        while (i < current && !best.compare_exchange_weak(current, i)) {
+        }
+      });
+    }
+    graph.run(jobs);
+    return best.load();
+  }
+
+  static std::string join(const std::vector<std::string> &units, size_t skipBegin = 0, size_t skipEnd = 0) {
+    std::string text;
+    for (size_t i = 0; i < units.size(); i++) {
+      if (i < skipBegin || i >= skipEnd) {
+        text += units[i];
+      }
+    }
+    return text;
+  }
+
+  // ddmin over units whose concatenation is current: removes chunks of
+  // units, halving the chunk when none of the current size can go.
+  bool reduceUnits(const Target &target, std::vector<std::string> units, std::string &current) {
+    bool reduced = false;
+    size_t chunk = std::max<size_t>(1, units.size() / 2);
+    while (!units.empty()) {
+      bool progress = false;
+      size_t start = 0;
+      while (start < units.size()) {
+        std::vector<std::string> candidates;
+        std::vector<size_t> starts;
+        for (size_t s = start; s < units.size() && candidates.size() < jobs; s += chunk) {
+          candidates.push_back(join(units, s, s + chunk));
+          starts.push_back(s);
+        }
+        size_t hit = firstInteresting(target, candidates);
+        if (hit == candidates.size()) {
+          start = starts.back() + chunk;
+          continue;
+        }
+        units.erase(units.begin() + starts[hit], units.begin() + std::min(units.size(), starts[hit] + chunk));
+        current = std::move(candidates[hit]);
+        start = starts[hit];
+        progress = reduced = true;
+      }
+      if (!progress) {
+        if (chunk == 1) {
+          break;
+        }
+        chunk /= 2;
+      }
+      chunk = std::min(chunk, std::max<size_t>(1, units.size()));
+    }
+    return reduced;
+  }
+
+  static size_t skipLiteral(const std::string &text, size_t i) {
+    char quote = text[i];
+    for (i++; i < text.size() && text[i] != quote && text[i] != '\n'; i++) {
+      if (text[i] == '\\') {
+        i++;
+      }
+    }
+    return std::min(i + 1, text.size());
+  }
+
+  static bool atLineStart(const std::string &text, size_t i) {
+    while (i > 0 && (text[i - 1] == ' ' || text[i - 1] == '\t')) {
+      i--;
+    }
+    return i == 0 || text[i - 1] == '\n';
+  }
+
+  // End of the comment, literal or preprocessor line at i, or i when
+  // there is none.
+  static size_t skipNonCode(const std::string &text, size_t i) {
+    char c = text[i];
+    char next = i + 1 < text.size() ? text[i + 1] : '\0';
+    if (c == '"' || c == '\'') {
+      return skipLiteral(text, i);
+    }
+    if (c == '/' && next == '/') {
+      size_t end = text.find('\n', i);
+      return end == std::string::npos ? text.size() : end;
+    }
+    if (c == '/' && next == '*') {
+      size_t end = text.find("*/", i + 2);
+      return end == std::string::npos ? text.size() : end + 2;
+    }
+    if (c == '#' && atLineStart(text, i)) {
+      size_t end = i;
+      do {
+        end = text.find('\n', end + 1);
+      } while (end != std::string::npos && text[end - 1] == '\\');
+      return end == std::string::npos ? text.size() : end;
+    }
+    return i;
+  }
+
+  // Candidates that drop a brace block: the whole construct (from the end
+  // of the previous statement or directive to the closing brace and an
+  // optional ';'), then only its body. Larger blocks come first.
+  static std::vector<std::string> blockCandidates(const std::string &text) {
+    std::vector<std::pair<size_t, size_t>> blocks;
+    std::vector<size_t> open;
+    for (size_t i = 0; i < text.size(); i++) {
+      size_t skipped = skipNonCode(text, i);
+      if (skipped != i) {
+        i = skipped - 1;
+      } else if (text[i] == '{') {
+        open.push_back(i);
+      } else if (text[i] == '}' && !open.empty()) {
+        blocks.push_back({open.back(), i});
+        open.pop_back();
+      }
+    }
+    std::stable_sort(blocks.begin(), blocks.end(), [](const auto &a, const auto &b) {
+      return a.second - a.first > b.second - b.first;
+    });
+
+    std::vector<std::string> candidates;
+    std::set<std::string> seen;
+    auto add = [&](size_t begin, size_t end) {
+      std::string candidate = text.substr(0, begin) + text.substr(end);
+      if (seen.insert(candidate).second) {
+        candidates.push_back(std::move(candidate));
+      }
+    };
+    for (const auto &[openAt, closeAt] : blocks) {
+      size_t begin = openAt;
+      while (begin > 0 && std::string_view(";{}").find(text[begin - 1]) == std::string_view::npos) {
+        if (text[begin - 1] == '\n' && begin >= 2) {
+          size_t lineStart = text.rfind('\n', begin - 2);
+          lineStart = lineStart == std::string::npos ? 0 : lineStart + 1;
+          size_t first = text.find_first_not_of(" \t", lineStart);
+          if (first != std::string::npos && text[first] == '#') {
+            break;
+          }
+        }
+        begin--;
+      }
+      size_t end = closeAt + 1;
+      size_t after = text.find_first_not_of(" \t\n", end);
+      if (after != std::string::npos && text[after] == ';') {
+        end = after + 1;
+      }
+      add(begin, end);
+      if (text.find_first_not_of(" \t\n", openAt + 1) < closeAt) {
+        add(openAt + 1, closeAt);
+      }
+    }
+    return candidates;
+  }
+
+  bool reduceBlocks(const Target &target, std::string &current) {
+    bool reduced = false;
+    size_t index = 0;
+    while (true) {
+      std::vector<std::string> candidates = blockCandidates(current);
+      if (index >= candidates.size()) {
+        return reduced;
+      }
+      size_t end = std::min(candidates.size(), index + jobs);
+      std::vector<std::string> batch(candidates.begin() + index, candidates.begin() + end);
+      size_t hit = firstInteresting(target, batch);
+      if (hit == batch.size()) {
+        index = end;
+        continue;
+      }
+      current = std::move(batch[hit]);
+      // The accepted block is gone, so index + hit is the next one.
+      index += hit;
+      reduced = true;
+    }
+  }
+
+  static std::vector<std::string> lines(const std::string &text) {
+    std::vector<std::string> units;
+    size_t start = 0;
+    while (start < text.size()) {
+      size_t end = text.find('\n', start);
+      end = end == std::string::npos ? text.size() : end + 1;
+      units.push_back(text.substr(start, end - start));
+      start = end;
+    }
+    return units;
+  }
+
+  // Tokens with their trailing whitespace; comments, literals and
+  // preprocessor lines are single tokens.
+  static std::vector<std::string> tokens(const std::string &text) {
+    static const std::vector<std::string> operators = {"<<=", ">>=", "...", "->", "::", "++", "--", "<<",
+                                                       ">>",  "<=",  ">=",  "==", "!=", "&&", "||", "+=",
+                                                       "-=",  "*=",  "/=",  "%=", "&=", "|=", "^="};
+    auto word = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+    std::vector<std::string> units;
+    size_t i = text.find_first_not_of(" \t\n");
+    if (i == std::string::npos) {
+      return {text};
+    }
+    if (i > 0) {
+      units.push_back(text.substr(0, i));
+    }
+    while (i < text.size()) {
+      size_t end = skipNonCode(text, i);
+      if (end == i && word(text[i])) {
+        bool number = std::isdigit(static_cast<unsigned char>(text[i]));
+        while (end < text.size() && (word(text[end]) || (number && text[end] == '.'))) {
+          end++;
+        }
+      } else if (end == i) {
+        end = i + 1;
+        for (const auto &op : operators) {
+          if (text.compare(i, op.size(), op) == 0) {
+            end = i + op.size();
+            break;
+          }
+        }
+      }
+      end = std::min(text.size(), text.find_first_not_of(" \t\n", end));
+      units.push_back(text.substr(i, end - i));
+      i = end;
+    }
+    return units;
+  }
+
+  // File name part for a command: the compiler's base name and flags.
+  static std::string slug(const std::string &command) {
+    size_t split = command.find(' ');
+    std::string compiler = std::filesystem::path(command.substr(0, split)).filename().string();
+    std::string name;
+    for (char c : compiler + (split == std::string::npos ? "" : command.substr(split))) {
+      name += std::isalnum(static_cast<unsigned char>(c)) || c == '+' || c == '-' || c == '=' ? c : '_';
+    }
+    return name;
+  }
+
+public:
+  explicit TestReducer(size_t workers = 0, const std::string &out = "reduced")
+      : jobs(workers ? workers : TaskGraph::availableCpus()), outDir(out), workDir(out + "/.work") {}
+
+  static const char *name(Kind kind) {
+    switch (kind) {
+    case Kind::Crash:
+      return "crash";
+    case Kind::Hang:
+      return "hang";
+    case Kind::Miscompile:
+      break;
+    }
+    return "miscompile";
+  }
+
+  // Kind and headline of the crash's bucket signature. The backtrace is
+  // left out: frames may shift while the program shrinks.
+  static std::string crashSignature(const std::string &output, int exitCode) {
+    return CrashBuckets::extract(output, exitCode).describe();
+  }
+
+  // Reduces one case; false when the original does not reproduce.
+  bool reduce(const Case &testCase, std::string &reduced) {
+    std::string original = CacheUtils::readFile(testCase.source);
+    if (original.empty()) {
+      std::cerr << "Cannot read " << testCase.source << std::endl;
+      return false;
+    }
+    std::filesystem::create_directories(workDir);
+
+    Target target;
+    target.testCase = testCase;
+    target.extension = std::filesystem::path(testCase.source).extension().string();
+    std::string identity;
+    for (const std::string &command : {testCase.command, testCase.reference}) {
+      if (!command.empty()) {
+        identity += CacheUtils::compilerIdentity(command.substr(0, command.find(' '))) + "\n";
+      }
+    }
+    target.key = std::string(name(testCase.kind)) + "\n" + testCase.command +
+                 "\n" + testCase.reference + "\n" + target.extension + "\n" + identity;
+
+    if (testCase.kind == Kind::Hang) {
+      target.deadline = testCase.deadline > 0 ? testCase.deadline : compileTimeout;
+      target.key += "deadline " + std::to_string(target.deadline) + "\n";
+    }
+    double referenceSeconds = 0;
+    if (!check(target, original, target.signature, &referenceSeconds)) {
+      std::cerr << "Not reproducible: " << testCase.source << " with " << testCase.command << std::endl;
+      return false;
+    }
+    target.key += target.signature;
+    if (testCase.kind == Kind::Miscompile) {
+      target.deadline = std::min(RuntimeBudget::hangDeadline(), std::max(runFloor, runHeadroom * referenceSeconds));
+    }
+
+    reduced = original;
+    for (int round = 0; round < maxRounds; round++) {
+      size_t before = reduced.size();
+      reduceBlocks(target, reduced);
+      reduceUnits(target, lines(reduced), reduced);
+      reduceUnits(target, tokens(reduced), reduced);
+      if (reduced.size() >= before) {
+        break;
+      }
+    }
+    return true;
+  }
+
+  // Entries of bugs.log and miscompilations.log. A miscompilation yields
+  // one case: its first divergent build against the first build that
+  // agreed with the majority. Repeated entries and all but the first
+  // crash or hang of each bucket are dropped.
+  static std::vector<Case> readLog(const std::string &path) {
+    std::vector<Case> cases;
+    std::ifstream log(path);
+    if (!log.is_open()) {
+      std::cerr << "Cannot open " << path << std::endl;
+      return cases;
+    }
+    std::set<std::string> seen;
+    Case current;
+    bool inEntry = false;
+    std::string majority;
+    std::string bucket;
+    std::string errorOutput;
+    bool inOutput = false;
+    std::string line;
+    while (std::getline(log, line)) {
+      if (line == "=== COMPILER CRASH DETECTED ===" || line == "=== COMPILER HANG DETECTED ===" ||
+          line == "=== MISCOMPILATION SUSPECTED ===") {
+        current = Case();
+        current.kind = line.find("CRASH") != std::string::npos  ? Kind::Crash
+                       : line.find("HANG") != std::string::npos ? Kind::Hang
+                                                                : Kind::Miscompile;
+        majority.clear();
+        bucket.clear();
+        errorOutput.clear();
+        inOutput = false;
+        inEntry = true;
+      } else if (!inEntry) {
+        continue;
+      } else if (!inOutput && line.rfind(DifferentialOracle::excerptPrefix, 0) == 0) {
+        // Program output quoted under a build's "--- " line.
+        continue;
+      } else if (line.rfind("===", 0) == 0) {
+        bool complete = !current.source.empty() && !current.command.empty() &&
+                        (current.kind != Kind::Miscompile || !current.reference.empty());
+        size_t deadline = errorOutput.find("Deadline: ");
+        if (deadline != std::string::npos) {
+          current.deadline = std::atof(errorOutput.c_str() + deadline + 10);
+        }
+        if (current.kind == Kind::Hang && bucket.empty()) {
+          bucket = CrashBuckets::hang(current.command, current.source).key();
+        } else if (current.kind == Kind::Crash && bucket.empty()) {
+          // Logs written before bucketing carry only the raw output.
+          int exitCode = 0;
+          if (errorOutput.rfind("Exit code: ", 0) == 0) {
+            exitCode = std::atoi(errorOutput.c_str() + 11);
+          }
+          bucket = CrashBuckets::extract(errorOutput, exitCode, current.command).key();
+        }
+        std::string id = current.kind != Kind::Miscompile
+                             ? "bucket " + bucket
+                             : current.source + "\n" + current.command + "\n" + current.reference;
+        if (complete && seen.insert(id).second) {
+          cases.push_back(current);
+        }
+        inEntry = line.find("DETECTED") != std::string::npos || line.find("SUSPECTED") != std::string::npos;
+      } else if (inOutput) {
+        errorOutput += line + "\n";
+      } else if (line == "Error output:") {
+        inOutput = true;
+      } else if (line.rfind("Bucket: ", 0) == 0) {
+        bucket = line.substr(8);
+      } else if (line.rfind("File: ", 0) == 0) {
+        current.source = line.substr(6);
+      } else if (line.rfind("Compiler: ", 0) == 0 && current.kind != Kind::Miscompile) {
+        current.command = line.substr(10);
+      } else if (line.rfind("Majority (", 0) == 0) {
+        size_t colon = line.find("): ");
+        majority = colon == std::string::npos ? "" : line.substr(colon + 3);
+      } else if (line.rfind("--- ", 0) == 0 && current.kind == Kind::Miscompile) {
+        size_t colon = line.rfind(": ");
+        if (colon == std::string::npos) {
+          continue;
+        }
+        std::string command = line.substr(4, colon - 4);
+        std::string fingerprint = line.substr(colon + 2);
+        std::string &slot = fingerprint == majority ? current.reference : current.command;
+        if (slot.empty()) {
+          slot = command;
+        }
+      }
+    }
+    return cases;
+  }
+
+  // Reduces every case, writing <out>/<stem>.<command>.reduced<ext>.
+  // Returns the number of cases reduced.
+  size_t reduceAll(const std::vector<Case> &cases) {
+    std::filesystem::create_directories(outDir);
+    size_t done = 0;
+    size_t originalBytes = 0, reducedBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &testCase : cases) {
+      auto caseStart = std::chrono::steady_clock::now();
+      size_t testsBefore = tests, hitsBefore = cacheHits;
+      std::string reduced;
+      if (!reduce(testCase, reduced)) {
+        continue;
+      }
+      std::filesystem::path source(testCase.source);
+      std::string outPath = outDir + "/" + source.stem().string() + "." + slug(testCase.command) + ".reduced" +
+                            source.extension().string();
+      std::ofstream(outPath, std::ios::trunc) << reduced;
+      size_t size = std::filesystem::file_size(testCase.source);
+      originalBytes += size;
+      reducedBytes += reduced.size();
+      done++;
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - caseStart).count();
+      std::cout << std::fixed << std::setprecision(1) << "Reduced " << testCase.source << " ("
+                << name(testCase.kind) << ", " << testCase.command << "): "
+                << size << " -> " << reduced.size() << " bytes, " << lines(reduced).size() << " lines, "
+                << tests - testsBefore << " tests, " << cacheHits - hitsBefore << " cached, " << seconds
+                << "s -> " << outPath << std::endl;
+    }
+    std::error_code ec;
+    std::filesystem::remove_all(workDir, ec);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::fixed << std::setprecision(1) << "Reduction: " << done << " of " << cases.size()
+              << " cases reduced, " << originalBytes << " -> " << reducedBytes << " bytes, " << tests
+              << " tests (" << cacheHits << " cached) on " << jobs << " workers in " << seconds << "s" << std::endl;
+    return done;
+  }
+};
+
+#endif // TEST_REDUCER_HPP